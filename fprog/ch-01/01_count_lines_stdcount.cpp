@@ -20,12 +20,17 @@ int count_lines(const std::string &file_name) {
         );
 
     /* This case is to count last line that doesn't end with '\n'.
-     * We check if the stream's fail state is set (ifs.fail()), if it is,
-     * it means the end-of-file was reached before encountering a newline character.
-     * In this case, we increment the newline count to include the last line.
+     * The stream's fail state (ifs.fail()) is set whenever the iterator reaches
+     * the end-of-file, whether the file ends with a newline character or not,
+     * so it cannot tell the two apart. Instead we clear the state, look at the
+     * last character, and increment the count only if it is not a newline.
+     * An empty (or missing) file has no last character and no lines.
      */
-    if (ifs.fail()) {
-        // If the fail state is set, increment the count to include the last line
+    ifs.clear();
+    ifs.seekg(-1, std::ios_base::end);
+    char last;
+    if (ifs.get(last) && last != '\n') {
+        // The last line doesn't end with '\n', increment the count to include it
         ++count;
     }
 
@@ -46,10 +51,10 @@ count_lines_in_files(const std::vector<std::string> &files) {
 
 int main() {
 
-    //std::vector<std::string> files{"01_count_lines.cpp", "02_count_lines.cpp"};
+    //std::vector<std::string> files{"01_count_lines_stdcount.cpp", "02_count_lines_accumulate.cpp"};
     //auto result = count_lines_in_files(files);
 
-    auto results = count_lines_in_files({"01_count_lines.cpp", "02_count_lines.cpp"});
+    auto results = count_lines_in_files({"01_count_lines_stdcount.cpp", "02_count_lines_accumulate.cpp"});
 
     for (auto result: results) {
         std::cout << result << " line(s)" << std::endl;
@@ -0,0 +1,137 @@
+/* README:
+- count number of lines in each file with mmap and SIMD instead of an
+  istream_iterator<char> (see line_count.h, mapped_file.h, simd_count.h),
+  and measure how much faster that is.
+
+[1] 01..03 pay for one istream_iterator increment (a call into the stream
+    buffer, a sentry, a copy of the char) per byte of the file, so they run
+    at a few hundred MB/s at best. count_lines_mmap() looks at the page
+    cache directly and compares 16/32/64 bytes per instruction.
+
+[2] The benchmark writes a few files of random text (lines of 0..120
+    chars) into the current directory, counts them with each variant
+    (best of 3, files already in the page cache), prints GB/s and removes
+    the files again.
+    Usage: ./04_count_lines_simd [total_mb]
+
+[3] All variants print the same total: a last line without '\n' counts,
+    a final '\n' does not start another line.
+
+COMPILE:
+g++ -O2 04_count_lines_simd.cpp -o 04_count_lines_simd
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <random>
+#include <chrono>
+#include <numeric>
+#include <cstdio>
+#include <cstdlib>
+
+#include "istream_count.h"
+#include "line_count.h"
+
+std::vector<std::string> make_files(std::size_t total_bytes, int nfiles) {
+    std::vector<std::string> files;
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> length(0, 120);
+    std::uniform_int_distribution<int> ch(' ', '~');
+
+    for (int i = 0; i < nfiles; ++i) {
+        std::string name = "04_bench_" + std::to_string(i) + ".txt";
+        std::ofstream ofs(name, std::ios::binary);
+        std::string line;
+        for (std::size_t written = 0; written < total_bytes / nfiles; written += line.size()) {
+            line.assign(length(rng), ' ');
+            for (auto &c: line) {
+                c = static_cast<char>(ch(rng));
+            }
+            line += '\n';
+            ofs << line;
+        }
+        files.push_back(name);
+    }
+
+    return files;
+}
+
+std::size_t total_size(const std::vector<std::string> &files) {
+    std::size_t bytes = 0;
+    for (const auto &file: files) {
+        bytes += mapped_file(file).size();
+    }
+    return bytes;
+}
+
+template <typename Count>
+void run(const std::string &name, const std::vector<std::string> &files, Count count) {
+    double best = 1e30;
+    long lines = 0;
+
+    for (int rep = 0; rep < 3; ++rep) {
+        auto start = std::chrono::steady_clock::now();
+        auto results = count(files);
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        lines = std::accumulate(results.begin(), results.end(), 0L);
+    }
+
+    std::cout << std::left << std::setw(30) << name << std::right
+              << std::setw(8) << std::fixed << std::setprecision(2)
+              << total_size(files) / best / 1e9 << " GB/s"
+              << std::setw(12) << lines << " lines" << std::endl;
+}
+
+//mmap + one particular kernel instead of the one count_byte() picks
+std::vector<long> count_with(const count_byte_kernel &kernel, const std::vector<std::string> &files) {
+    std::vector<long> results;
+
+    for (const auto &file_name: files) {
+        mapped_file file(file_name);
+        long newlines = static_cast<long>(kernel.fn(file.data(), file.size(), '\n'));
+        bool open_line = file.size() > 0 && file.data()[file.size() - 1] != '\n';
+        results.push_back(newlines + open_line);
+    }
+
+    return results;
+}
+
+std::vector<long> count_with_read(const std::vector<std::string> &files) {
+    std::vector<long> results;
+
+    for (const auto &file_name: files) {
+        mapped_file file(file_name);
+        results.push_back(count_lines_read(file.fd()));
+    }
+
+    return results;
+}
+
+int main(int argc, char *argv[]) {
+    std::size_t total_mb = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 128;
+    auto files = make_files(total_mb << 20, 4);
+
+    std::cout << files.size() << " files, " << total_size(files) / 1e6 << " MB, "
+              << "count_byte() uses " << count_byte_kernel_name() << std::endl;
+
+    run("01 istream + std::count", files, count_lines_in_files_stdcount);
+    run("02 istream + std::accumulate", files, count_lines_in_files_accumulate);
+    run("03 istream + std::transform", files, count_lines_in_files_transform);
+    run("read() 1MB blocks", files, count_with_read);
+    for (const auto &kernel: count_byte_kernels()) {
+        if (kernel.supported) {
+            run(std::string("mmap + ") + kernel.name, files,
+                [&kernel](const std::vector<std::string> &f) { return count_with(kernel, f); });
+        }
+    }
+    run("count_lines_mmap()", files, count_lines_in_files_mmap);
+
+    for (const auto &file: files) {
+        std::remove(file.c_str());
+    }
+
+    return 0;
+}
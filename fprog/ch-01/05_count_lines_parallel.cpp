@@ -0,0 +1,108 @@
+/* README:
+- count number of lines in many files at once, over a thread pool
+  (see parallel_count.h).
+
+[1] 01..03 count their files one after another. Here the files are
+    scheduled over the workers of multithreading/thread_pool.h, largest
+    first, and files bigger than 64MB are split into chunks counted in
+    parallel, so a couple of huge logs among thousands of small ones do not
+    decide the total time.
+
+[2] The benchmark writes a directory 05_bench/ with many small files and
+    two big ones (listed last, so largest-first scheduling matters), counts
+    them sequentially with count_lines_in_files_mmap() and in parallel with
+    1 and with all hardware threads, checks the counts agree, and prints
+    the aggregate throughput. The directory is removed at the end.
+    Usage: ./05_count_lines_parallel [small_files] [big_mb]
+
+COMPILE:
+g++ -O2 05_count_lines_parallel.cpp -o 05_count_lines_parallel -lpthread
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "parallel_count.h"
+
+void write_file(const std::string &name, std::size_t bytes, std::mt19937 &rng) {
+    std::uniform_int_distribution<int> length(0, 120);
+    std::ofstream ofs(name, std::ios::binary);
+    std::string line;
+
+    for (std::size_t written = 0; written < bytes; written += line.size()) {
+        line.assign(length(rng), 'x');
+        line += '\n';
+        ofs << line;
+    }
+}
+
+std::vector<std::string> make_files(int small_files, std::size_t big_bytes) {
+    std::vector<std::string> files;
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<std::size_t> small_size(1 << 10, 64 << 10);
+
+    ::mkdir("05_bench", 0755);
+    for (int i = 0; i < small_files; ++i) {
+        files.push_back("05_bench/small_" + std::to_string(i) + ".log");
+        write_file(files.back(), small_size(rng), rng);
+    }
+    for (int i = 0; i < 2; ++i) {
+        files.push_back("05_bench/big_" + std::to_string(i) + ".log");
+        write_file(files.back(), big_bytes, rng);
+    }
+
+    return files;
+}
+
+void print(const std::string &name, const count_report &report) {
+    std::cout << std::left << std::setw(22) << name << std::right << std::fixed
+              << std::setprecision(2) << std::setw(7) << report.gb_per_second() << " GB/s"
+              << std::setprecision(0) << std::setw(10) << report.files_per_second() << " files/s"
+              << std::setprecision(3) << std::setw(9) << report.seconds << " s" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    int small_files = argc > 1 ? std::atoi(argv[1]) : 2000;
+    std::size_t big_mb = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 128;
+    auto files = make_files(small_files, big_mb << 20);
+
+    count_report sequential;
+    auto start = std::chrono::steady_clock::now();
+    sequential.lines = count_lines_in_files_mmap(files);
+    sequential.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (const auto &file: files) {
+        sequential.bytes += file_size(file);
+    }
+    print("sequential", sequential);
+
+    unsigned all = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned threads: {1u, all}) {
+        thread_pool pool(threads);
+        count_report report = count_lines_in_files_parallel(files, pool);
+        print("parallel, " + std::to_string(threads) + " thread(s)", report);
+        if (report.lines != sequential.lines) {
+            std::cout << "ERROR: line counts differ from the sequential run" << std::endl;
+        }
+        if (all == 1) {
+            break;
+        }
+    }
+
+    for (const auto &file: files) {
+        std::remove(file.c_str());
+    }
+    ::rmdir("05_bench");
+
+    return 0;
+}
@@ -0,0 +1,108 @@
+/* README:
+- count number of lines in thousands of small files, with the opens, reads
+  and closes batched through io_uring (see batched_reader.h).
+
+[1] For small files the cost is in the syscalls, not in the counting: 01
+    does open, a few reads and close through ifstream, one file after
+    another, and count_lines_mmap() (04) still pays open, fstat, mmap,
+    munmap and close per file. batched_reader keeps 64 files in flight
+    from one thread, with one io_uring_enter per batch.
+
+[2] The benchmark writes 05_bench-like small files into 06_bench/, counts
+    them with 01 (ifstream), count_lines_mmap(), batched_reader over
+    io_uring and batched_reader's pread fallback on a thread pool, checks
+    that the three new ways agree, and prints files/s. The files are in the
+    page cache, so this measures syscall overhead, not the disk.
+    Usage: ./06_count_lines_batched [files]
+
+COMPILE:
+g++ -O2 06_count_lines_batched.cpp -o 06_count_lines_batched -lpthread
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "batched_reader.h"
+#include "istream_count.h"
+
+std::vector<std::string> make_files(int nfiles) {
+    std::vector<std::string> files;
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> size(256, 16 << 10);
+    std::uniform_int_distribution<int> length(0, 120);
+
+    ::mkdir("06_bench", 0755);
+    for (int i = 0; i < nfiles; ++i) {
+        files.push_back("06_bench/" + std::to_string(i) + ".log");
+        std::ofstream ofs(files.back(), std::ios::binary);
+        std::string line;
+        for (int written = 0, total = size(rng); written < total; written += line.size()) {
+            line.assign(length(rng), 'x');
+            line += '\n';
+            ofs << line;
+        }
+    }
+    files.push_back("06_bench/missing.log");
+
+    return files;
+}
+
+template <typename Count>
+auto run(const std::string &name, const std::vector<std::string> &files, Count count) {
+    double best = 1e30;
+    decltype(count(files)) results;
+
+    for (int rep = 0; rep < 3; ++rep) {
+        auto start = std::chrono::steady_clock::now();
+        results = count(files);
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    std::cout << std::left << std::setw(26) << name << std::right << std::fixed
+              << std::setprecision(0) << std::setw(10) << files.size() / best << " files/s" << std::endl;
+    return results;
+}
+
+int main(int argc, char *argv[]) {
+    int nfiles = argc > 1 ? std::atoi(argv[1]) : 5000;
+    auto files = make_files(nfiles);
+
+    batched_reader uring_reader;
+    batched_reader_options fallback_options;
+    fallback_options.force_fallback = true;
+    batched_reader pread_reader(fallback_options);
+
+    std::cout << files.size() << " files, io_uring "
+              << (uring_reader.uses_io_uring() ? "available" : "not available, fallback used")
+              << std::endl;
+
+    run("01 ifstream", files, count_lines_in_files_stdcount);
+    auto mmap_lines = run("count_lines_mmap()", files, count_lines_in_files_mmap);
+    auto uring_lines = run("batched, io_uring", files, [&](const std::vector<std::string> &f) {
+        return count_lines_in_files_batched(f, uring_reader);
+    });
+    auto pread_lines = run("batched, pread pool", files, [&](const std::vector<std::string> &f) {
+        return count_lines_in_files_batched(f, pread_reader);
+    });
+
+    if (uring_lines != mmap_lines || pread_lines != mmap_lines) {
+        std::cout << "ERROR: line counts differ" << std::endl;
+    }
+
+    for (const auto &file: files) {
+        std::remove(file.c_str());
+    }
+    ::rmdir("06_bench");
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+/* README:
+- count number of lines in a directory of files again and again, with the
+  results cached on disk (see line_cache.h).
+
+[1] The first run counts everything and writes 07_bench/.line_count_cache.
+    The second run finds every file unchanged (same inode, size and mtime)
+    and only stat()s them. Then some files get lines appended, a few are
+    rewritten and one is deleted: the third run scans only the appended
+    bytes and the rewritten files.
+
+[2] Every run is checked against count_lines_mmap() (04) on the same files.
+    Usage: ./07_count_lines_cached [files]
+
+COMPILE:
+g++ -O2 07_count_lines_cached.cpp -o 07_count_lines_cached
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "line_cache.h"
+
+void write_lines(const std::string &name, int nlines, std::ios::openmode mode, std::mt19937 &rng) {
+    std::uniform_int_distribution<int> length(0, 120);
+    std::ofstream ofs(name, std::ios::binary | mode);
+    for (int i = 0; i < nlines; ++i) {
+        ofs << std::string(length(rng), 'x') << '\n';
+    }
+}
+
+void run(const std::string &name, const std::vector<std::string> &files) {
+    line_count_cache cache("07_bench/.line_count_cache");
+
+    auto start = std::chrono::steady_clock::now();
+    auto results = count_lines_in_files_cached(files, cache);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    const auto &s = cache.stats();
+    std::cout << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(8) << ms << " ms  unchanged " << s.unchanged << ", appended " << s.appended
+              << ", rescanned " << s.rescanned << ", failed " << s.failed
+              << ", scanned " << s.bytes_scanned / 1e6 << " MB" << std::endl;
+
+    if (results != count_lines_in_files_mmap(files)) {
+        std::cout << "ERROR: cached counts differ from count_lines_mmap()" << std::endl;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int nfiles = argc > 1 ? std::atoi(argv[1]) : 2000;
+    std::mt19937 rng(42);
+    std::vector<std::string> files;
+
+    ::mkdir("07_bench", 0755);
+    std::remove("07_bench/.line_count_cache");
+    for (int i = 0; i < nfiles; ++i) {
+        files.push_back("07_bench/" + std::to_string(i) + ".log");
+        write_lines(files.back(), 2000, std::ios::trunc, rng);
+    }
+
+    run("first", files);
+    run("again", files);
+
+    for (int i = 0; i < nfiles; i += 20) {
+        write_lines(files[i], 10, std::ios::app, rng);      //appended to
+    }
+    for (int i = 1; i < nfiles; i += 100) {
+        write_lines(files[i], 500, std::ios::trunc, rng);   //rewritten
+    }
+    std::remove(files[2].c_str());
+    run("changed", files);
+    run("again", files);
+
+    for (const auto &file: files) {
+        std::remove(file.c_str());
+    }
+    std::remove("07_bench/.line_count_cache");
+    ::rmdir("07_bench");
+
+    return 0;
+}
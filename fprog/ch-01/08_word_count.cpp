@@ -0,0 +1,127 @@
+/* README:
+- count lines, words, bytes and delimiters in one pass, like a fused `wc`
+  (see wc_scan.h).
+
+[1] With file arguments it prints, per file, what `wc` prints (newlines,
+    words, bytes) followed by the number of ',' and ';' bytes and of bytes
+    >= 0x80 (non-ASCII), all from the same scan, chunks of big files
+    counted in parallel on a thread_pool.
+    Usage: ./08_word_count file...
+
+[2] Without arguments it benchmarks: a 256MB file of random words, white
+    space and delimiters is scanned by the scalar kernel, the AVX2 kernel,
+    and the AVX2 kernel in parallel chunks; all three must agree.
+    Usage: ./08_word_count
+
+COMPILE:
+g++ -O2 08_word_count.cpp -o 08_word_count -lpthread
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+
+#include "wc_scan.h"
+
+std::vector<byte_set> delimiter_classes() {
+    byte_set non_ascii;
+    for (int b = 0x80; b < 0x100; ++b) {
+        non_ascii.add(static_cast<char>(b));
+    }
+    return {byte_set(","), byte_set(";"), non_ascii};
+}
+
+void print(const wc_counts &c, const std::string &name) {
+    std::cout << std::setw(10) << c.newlines << std::setw(10) << c.words << std::setw(12) << c.bytes;
+    for (auto n: c.classes) {
+        std::cout << std::setw(10) << n;
+    }
+    std::cout << " " << name << std::endl;
+}
+
+std::string make_file(std::size_t bytes) {
+    const char *pieces[] = {"word", "x", "longer_word", " ", "  ", "\t", "\n", ",", ";", "\r\n", "\xc3\xa9t\xc3\xa9"};
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> pick(0, sizeof(pieces) / sizeof(pieces[0]) - 1);
+    std::string name = "08_bench.txt";
+    std::ofstream ofs(name, std::ios::binary);
+    std::string block;
+
+    for (std::size_t written = 0; written < bytes; written += block.size()) {
+        block.clear();
+        for (int i = 0; i < 4096; ++i) {
+            block += pieces[pick(rng)];
+        }
+        ofs << block;
+    }
+
+    return name;
+}
+
+void benchmark() {
+    std::string file = make_file(std::size_t(256) << 20);
+    thread_pool pool(std::max(1u, std::thread::hardware_concurrency()));
+    wc_scanner scalar(delimiter_classes(), false);
+    wc_scanner vectorized(delimiter_classes());
+
+    struct run_t {
+        const char *name;
+        const wc_scanner &scanner;
+        thread_pool *pool;
+    };
+    wc_counts reference;
+    for (const run_t &run: {run_t{"scalar", scalar, nullptr},
+                            run_t{vectorized.is_vectorized() ? "avx2" : "scalar (no avx2)", vectorized, nullptr},
+                            run_t{"parallel chunks", vectorized, &pool}}) {
+        double best = 1e30;
+        wc_counts counts;
+        for (int rep = 0; rep < 3; ++rep) {
+            auto start = std::chrono::steady_clock::now();
+            counts = run.scanner.scan_file(file, run.pool);
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::cout << std::left << std::setw(18) << run.name << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(6) << counts.bytes / best / 1e9 << " GB/s ";
+        print(counts, "");
+        if (&run.scanner == &scalar) {
+            reference = counts;
+        } else if (counts.newlines != reference.newlines || counts.words != reference.words
+                   || counts.classes != reference.classes) {
+            std::cout << "ERROR: counts differ from the scalar kernel" << std::endl;
+        }
+    }
+
+    std::remove(file.c_str());
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        benchmark();
+        return 0;
+    }
+
+    thread_pool pool(std::max(1u, std::thread::hardware_concurrency()));
+    wc_scanner scanner(delimiter_classes());
+    wc_counts total;
+    for (int i = 1; i < argc; ++i) {
+        bool ok = false;
+        wc_counts counts = scanner.scan_file(argv[i], &pool, std::size_t(16) << 20, &ok);
+        if (!ok) {
+            std::cerr << argv[i] << ": cannot open or read" << std::endl;
+            continue;
+        }
+        print(counts, argv[i]);
+        total += counts;
+    }
+    if (argc > 2) {
+        print(total, "total");
+    }
+
+    return 0;
+}
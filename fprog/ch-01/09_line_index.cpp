@@ -0,0 +1,106 @@
+/* README:
+- jump to line N of a big file through a sparse line index
+  (see line_index.h).
+
+[1] A file of numbered lines ("line 0000000123 ...") is written, and its
+    index is built in parallel on a thread_pool and saved next to it as
+    09_bench.txt.lidx. Opening the index again only reads that file.
+[2] read_lines() of a few ranges, including the very end of the file, is
+    checked against the numbers in the lines and timed against reading up
+    to the same line with std::getline, as 01..03 would have to.
+    Usage: ./09_line_index [mb]
+
+COMPILE:
+g++ -O2 09_line_index.cpp -o 09_line_index -lpthread
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+
+#include "line_index.h"
+
+double ms_since(std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+}
+
+std::uint64_t make_file(const std::string &name, std::size_t bytes) {
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> length(0, 100);
+    std::ofstream ofs(name, std::ios::binary);
+    std::uint64_t lines = 0;
+    char number[32];
+
+    for (std::size_t written = 0; written < bytes; ++lines) {
+        std::snprintf(number, sizeof(number), "line %010llu ", static_cast<unsigned long long>(lines));
+        std::string line = number + std::string(length(rng), 'x') + '\n';
+        ofs << line;
+        written += line.size();
+    }
+    ofs << "last line without newline";
+
+    return lines + 1;
+}
+
+bool check(const std::vector<std::string> &lines, std::uint64_t from, std::uint64_t total) {
+    for (std::size_t i = 0; i < lines.size(); ++i) {
+        std::uint64_t n = from + i;
+        if (n + 1 == total ? lines[i] != "last line without newline"
+                           : lines[i].compare(5, 10, std::to_string(1e10 + n).substr(1, 10)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string getline_to(const std::string &file, std::uint64_t n) {
+    std::ifstream ifs(file);
+    std::string line;
+    for (std::uint64_t i = 0; i <= n && std::getline(ifs, line); ++i) {
+    }
+    return line;
+}
+
+int main(int argc, char *argv[]) {
+    std::size_t mb = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 256;
+    std::string file = "09_bench.txt";
+    std::uint64_t total = make_file(file, mb << 20);
+    thread_pool pool(std::max(1u, std::thread::hardware_concurrency()));
+
+    std::remove((file + ".lidx").c_str());
+    auto start = std::chrono::steady_clock::now();
+    line_index index = line_index::open(file, &pool);
+    std::cout << "built:  " << index.lines() << " lines (expected " << total << "), "
+              << index.checkpoints() << " checkpoints, " << ms_since(start) << " ms" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    index = line_index::open(file, &pool);
+    std::cout << "loaded: " << index.lines() << " lines, " << ms_since(start) << " ms" << std::endl;
+
+    for (std::uint64_t from: {std::uint64_t(0), total / 3, total / 2 + 4095, total - 5}) {
+        start = std::chrono::steady_clock::now();
+        auto lines = index.read_lines(from, from + 10);
+        double indexed = ms_since(start);
+
+        start = std::chrono::steady_clock::now();
+        std::string slow = getline_to(file, from);
+        double scanned = ms_since(start);
+
+        std::cout << "read_lines(" << from << ", " << from + 10 << "): " << lines.size() << " lines, "
+                  << (check(lines, from, total) && (lines.empty() || lines[0] == slow) ? "ok" : "WRONG")
+                  << ", " << std::fixed << std::setprecision(3) << indexed << " ms (getline: "
+                  << scanned << " ms)" << std::defaultfloat << std::endl;
+    }
+
+    std::remove(file.c_str());
+    std::remove((file + ".lidx").c_str());
+
+    return 0;
+}
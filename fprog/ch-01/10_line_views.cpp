@@ -0,0 +1,165 @@
+/* README:
+- read a file line by line as std::string_view and trim and count words
+  without copying a single line (see line_reader.h).
+
+[1] The classic way: std::getline into a std::string, trim2() from
+    ch-02/04_trim_ws.cpp (which takes and returns std::string by value),
+    and an istringstream to split the words. Every line costs a few
+    allocations and copies.
+[2] line_reader over a mapping: every line is a view into the page cache,
+    trim_view() and count_words() only move the ends of the view.
+[3] line_reader with a small 4KB read buffer: same result, and many lines
+    straddle two reads, which the reader stitches together without cutting
+    them.
+
+    All three must agree on lines, words and trimmed bytes. Allocations are
+    counted by replacing the global operator new.
+    Usage: ./10_line_views [mb]
+
+COMPILE:
+g++ -O2 10_line_views.cpp -o 10_line_views
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "line_reader.h"
+
+static std::size_t allocations = 0;
+
+void *operator new(std::size_t size) {
+    ++allocations;
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+struct totals {
+    std::size_t lines = 0;
+    std::size_t words = 0;
+    std::size_t trimmed_bytes = 0;
+
+    bool operator==(const totals &o) const {
+        return lines == o.lines && words == o.words && trimmed_bytes == o.trimmed_bytes;
+    }
+};
+
+//ch-02/04_trim_ws.cpp
+std::string ltrim2(std::string str) {
+    str.erase(str.begin(), std::find_if(str.begin(), str.end(), [](char ch) { return !isspace(ch); }));
+    return str;
+}
+
+std::string rtrim2(std::string str) {
+    str.erase(std::find_if(str.rbegin(), str.rend(), [](char ch) { return !isspace(ch); }).base(), str.end());
+    return str;
+}
+
+std::string trim2(std::string str) {
+    return rtrim2(ltrim2(str));
+}
+
+/******** [1] ************/
+totals with_strings(const std::string &file) {
+    totals t;
+    std::ifstream ifs(file);
+    std::string line;
+    while (std::getline(ifs, line)) {
+        std::string trimmed = trim2(line);
+        std::istringstream words(trimmed);
+        std::string word;
+        while (words >> word) {
+            ++t.words;
+        }
+        ++t.lines;
+        t.trimmed_bytes += trimmed.size();
+    }
+    return t;
+}
+
+/******** [2] [3] ************/
+totals with_views(line_reader reader) {
+    totals t;
+    for (std::string_view line: reader) {
+        std::string_view trimmed = trim_view(line);
+        t.words += count_words(trimmed);
+        ++t.lines;
+        t.trimmed_bytes += trimmed.size();
+    }
+    return t;
+}
+
+std::string make_file(std::size_t bytes) {
+    const char *words[] = {"alpha", "beta", "gamma", "delta", "epsilon"};
+    std::mt19937 rng(42);
+    std::string name = "10_bench.txt";
+    std::ofstream ofs(name, std::ios::binary);
+    std::string line;
+
+    for (std::size_t written = 0; written < bytes; written += line.size()) {
+        line.assign(rng() % 4, ' ');
+        for (int i = 0, n = static_cast<int>(rng() % 20); i < n; ++i) {
+            line += words[rng() % 5];
+            line += rng() % 3 ? " " : " \t ";
+        }
+        line += rng() % 2 ? "\r\n" : "\n";
+        ofs << line;
+    }
+    ofs << "  last line without newline ";
+
+    return name;
+}
+
+template <typename Run>
+void run(const std::string &name, Run count, totals &reference) {
+    std::size_t before = allocations;
+    auto start = std::chrono::steady_clock::now();
+    totals t = count();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::size_t allocs = allocations - before;
+
+    std::cout << std::left << std::setw(26) << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(8) << ms << " ms" << std::setw(11) << t.lines << " lines"
+              << std::setw(11) << t.words << " words" << std::setw(12) << allocs << " allocations"
+              << std::setprecision(3) << " (" << double(allocs) / t.lines << " per line)" << std::endl;
+
+    if (reference.lines == 0) {
+        reference = t;
+    } else if (!(t == reference)) {
+        std::cout << "ERROR: totals differ" << std::endl;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    std::size_t mb = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64;
+    std::string file = make_file(mb << 20);
+    totals reference;
+
+    run("getline + trim2 + stream", [&]() { return with_strings(file); }, reference);
+    run("line_reader, mmap", [&]() { return with_views(line_reader(file)); }, reference);
+    run("line_reader, 4KB buffer", [&]() { return with_views(line_reader(file, 4096)); }, reference);
+
+    std::remove(file.c_str());
+
+    return 0;
+}
@@ -0,0 +1,193 @@
+/* README:
+- run every line counter of ch-01 over the same reproducible corpora
+  (see corpus.h), check that they all agree, and report their throughput.
+
+[1] The corpora are written into 11_corpus/ (tiny files, a huge file, files
+    without a final newline, CRLF files, multi-MB lines, a file of only
+    newlines) and removed at the end. The seed makes every run use the
+    same bytes.
+[2] The reference is a plain byte loop over fread() blocks, written
+    independently of every counter being checked. A counter "agrees" if it
+    returns the reference count for every file of the corpus; any
+    disagreement is listed and makes the program exit with 1.
+[3] Throughput is the best of `reps` runs with the corpus in the page
+    cache, in MB/s and files/s. "cached, cold" starts from an empty cache
+    every time, "cached, warm" reuses it (files unchanged).
+    Usage: ./11_count_lines_corpus [huge_mb] [seed] [reps]
+
+COMPILE:
+g++ -O2 11_count_lines_corpus.cpp -o 11_count_lines_corpus -lpthread
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "corpus.h"
+#include "istream_count.h"
+#include "line_count.h"
+#include "parallel_count.h"
+#include "batched_reader.h"
+#include "line_cache.h"
+#include "wc_scan.h"
+#include "line_index.h"
+#include "line_reader.h"
+
+using counter_fn = std::function<std::vector<long>(const std::vector<std::string> &)>;
+
+/******** [2] ************/
+long count_lines_reference(const std::string &file) {
+    std::FILE *f = std::fopen(file.c_str(), "rb");
+    if (!f) {
+        return -1;
+    }
+    char buffer[1 << 16];
+    long newlines = 0;
+    char last = '\n';
+    std::size_t n;
+    while ((n = std::fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        for (std::size_t i = 0; i < n; ++i) {
+            newlines += buffer[i] == '\n';
+        }
+        last = buffer[n - 1];
+    }
+    std::fclose(f);
+    return last == '\n' ? newlines : newlines + 1;
+}
+
+template <typename Count>
+counter_fn per_file(Count count) {
+    return [count](const std::vector<std::string> &files) {
+        std::vector<long> results;
+        for (const auto &file: files) {
+            results.push_back(static_cast<long>(count(file)));
+        }
+        return results;
+    };
+}
+
+template <typename Count>
+counter_fn widen(Count count) {
+    return [count](const std::vector<std::string> &files) {
+        auto results = count(files);
+        return std::vector<long>(results.begin(), results.end());
+    };
+}
+
+int main(int argc, char *argv[]) {
+    corpus_options options;
+    options.huge_mb = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 128;
+    options.seed = argc > 2 ? static_cast<unsigned>(std::strtoul(argv[2], nullptr, 10)) : 42;
+    int reps = argc > 3 ? std::atoi(argv[3]) : 3;
+
+    const std::string root = "11_corpus";
+    std::vector<corpus> corpora = make_corpora(root, options);
+
+    thread_pool pool(std::max(1u, std::thread::hardware_concurrency()));
+    batched_reader uring_reader;
+    batched_reader_options fallback;
+    fallback.force_fallback = true;
+    batched_reader pread_reader(fallback);
+    const std::string cache_file = root + "/.line_count_cache";
+    wc_scanner scanner;
+
+    std::vector<std::pair<std::string, counter_fn>> counters = {
+        {"01 istream + std::count", widen(count_lines_in_files_stdcount)},
+        {"02 istream + accumulate", widen(count_lines_in_files_accumulate)},
+        {"03 istream + transform", widen(count_lines_in_files_transform)},
+        {"count_lines_mmap", count_lines_in_files_mmap},
+        {"count_lines_read", per_file([](const std::string &file) {
+            int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+            long lines = fd < 0 ? -1 : count_lines_read(fd);
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            return lines;
+        })},
+        {"parallel", [&](const std::vector<std::string> &files) {
+            return count_lines_in_files_parallel(files, pool).lines;
+        }},
+        {uring_reader.uses_io_uring() ? "batched, io_uring" : "batched (no io_uring)",
+         [&](const std::vector<std::string> &files) {
+            return count_lines_in_files_batched(files, uring_reader);
+        }},
+        {"batched, pread", [&](const std::vector<std::string> &files) {
+            return count_lines_in_files_batched(files, pread_reader);
+        }},
+        {"cached, cold", [&](const std::vector<std::string> &files) {
+            std::remove(cache_file.c_str());
+            line_count_cache cache(cache_file);
+            return count_lines_in_files_cached(files, cache);
+        }},
+        {"cached, warm", [&](const std::vector<std::string> &files) {
+            line_count_cache cache(cache_file);
+            return count_lines_in_files_cached(files, cache);
+        }},
+        {"wc_scanner", per_file([&](const std::string &file) {
+            bool ok = false;
+            wc_counts counts = scanner.scan_file(file, &pool, std::size_t(16) << 20, &ok);
+            return ok ? counts.lines() : -1L;
+        })},
+        {"line_index", per_file([&](const std::string &file) {
+            return line_index::build(file, &pool).lines();
+        })},
+        {"line_reader", per_file([](const std::string &file) {
+            long lines = 0;
+            line_reader reader(file);
+            for (std::string_view line: reader) {
+                (void)line;
+                ++lines;
+            }
+            return reader.error() ? -1L : lines;
+        })},
+    };
+
+    bool all_agree = true;
+    for (const auto &c: corpora) {
+        std::vector<long> expected = per_file(count_lines_reference)(c.files);
+        std::cout << c.name << ": " << c.files.size() << " files, " << std::fixed << std::setprecision(1)
+                  << c.bytes / 1e6 << " MB" << std::defaultfloat << std::endl;
+
+        for (const auto &counter: counters) {
+            double best = 1e30;
+            std::vector<long> results;
+            for (int rep = 0; rep < reps; ++rep) {
+                auto start = std::chrono::steady_clock::now();
+                results = counter.second(c.files);
+                best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            }
+
+            std::size_t wrong = 0;
+            for (std::size_t i = 0; i < expected.size(); ++i) {
+                if (i >= results.size() || results[i] != expected[i]) {
+                    if (wrong++ == 0) {
+                        std::cout << "    " << counter.first << ": " << c.files[i] << " expected "
+                                  << expected[i] << ", got " << (i < results.size() ? results[i] : -2) << std::endl;
+                    }
+                }
+            }
+            all_agree = all_agree && wrong == 0;
+
+            std::cout << "  " << std::left << std::setw(26) << counter.first << std::right << std::fixed
+                      << std::setprecision(0) << std::setw(9) << c.bytes / best / 1e6 << " MB/s"
+                      << std::setw(11) << c.files.size() / best << " files/s  "
+                      << (wrong ? std::to_string(wrong) + " WRONG" : std::string("ok"))
+                      << std::defaultfloat << std::endl;
+        }
+    }
+
+    std::remove(cache_file.c_str());
+    remove_corpora(root, corpora);
+
+    std::cout << (all_agree ? "all counters agree" : "COUNTERS DISAGREE") << std::endl;
+    return all_agree ? 0 : 1;
+}
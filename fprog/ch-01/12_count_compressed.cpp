@@ -0,0 +1,238 @@
+/* README:
+- count lines and words of gzip (and, with HAVE_ZSTD, zstd) compressed
+  files with decompression and counting on separate threads (see
+  decompress.h).
+
+[1] With file arguments it prints lines, words and decompressed bytes per
+    file, whatever the compression (plain files work too).
+    Usage: ./12_count_compressed file...
+
+[2] Without arguments it benchmarks: a file of random text is written plain
+    and as .gz (and as a .gz of several members, like a log that was
+    appended to with `gzip >>`); with HAVE_ZSTD also as .zst, of one frame
+    and of several. Then it measures
+    - decompress only: how fast zlib alone produces the bytes,
+    - inline: decompress a block, count it, decompress the next one,
+    - overlapped: for_each_block(), counting on the calling thread while
+      the next blocks are decompressed,
+    and checks that every count equals that of the plain file, and that a
+    copy cut in the middle of a member/frame is reported as truncated. The
+    overlapped pipeline should run at about "decompress only" speed:
+    counting is an order of magnitude faster than inflate, so it hides
+    behind it (with at least two cores).
+    Usage: ./12_count_compressed [total_mb]
+
+COMPILE:
+g++ -O2 12_count_compressed.cpp -o 12_count_compressed -lpthread -lz
+(zstd: g++ -O2 -DHAVE_ZSTD 12_count_compressed.cpp -o 12_count_compressed -lpthread -lz -lzstd)
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <functional>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "decompress.h"
+#include "wc_scan.h"
+
+//lines, words and bytes of a stream of blocks
+class block_counter {
+public:
+    void operator()(const char *data, std::size_t size) {
+        m_counts += m_scanner.scan(data, size, m_space.contains(m_counts.last));
+    }
+
+    const wc_counts &counts() const {
+        return m_counts;
+    }
+
+private:
+    wc_scanner m_scanner;
+    byte_set m_space = byte_set::white_space();
+    wc_counts m_counts = m_scanner.scan(nullptr, 0);
+};
+
+std::string make_text(std::size_t bytes) {
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> length(0, 120);
+    std::uniform_int_distribution<int> ch('!', '~');
+    std::string text;
+    while (text.size() < bytes) {
+        std::string line(length(rng), ' ');
+        for (auto &c: line) {
+            c = rng() % 6 ? static_cast<char>(ch(rng)) : ' ';
+        }
+        text += line + '\n';
+    }
+    return text;
+}
+
+bool write_gzip(const std::string &name, const std::string &text, int members) {
+    gzFile gz = gzopen(name.c_str(), "wb6");
+    if (!gz) {
+        return false;
+    }
+    bool ok = true;
+    std::size_t step = text.size() / members + 1;
+    for (std::size_t offset = 0; ok && offset < text.size(); offset += step) {
+        std::size_t n = std::min(step, text.size() - offset);
+        ok = gzwrite(gz, text.data() + offset, static_cast<unsigned>(n)) == static_cast<int>(n);
+        if (ok && offset + n < text.size()) {
+            //end this member and append a new one to the same file
+            ok = gzclose(gz) == Z_OK && (gz = gzopen(name.c_str(), "ab6")) != nullptr;
+        }
+    }
+    return gz && gzclose(gz) == Z_OK && ok;
+}
+
+#ifdef HAVE_ZSTD
+//frames independent frames one after another, as `zstd -c a >> b` leaves them
+bool write_zstd(const std::string &name, const std::string &text, int frames) {
+    std::FILE *f = std::fopen(name.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    bool ok = true;
+    std::size_t step = text.size() / frames + 1;
+    std::vector<char> out;
+    for (std::size_t offset = 0; ok && offset < text.size(); offset += step) {
+        std::size_t n = std::min(step, text.size() - offset);
+        out.resize(ZSTD_compressBound(n));
+        std::size_t z = ZSTD_compress(out.data(), out.size(), text.data() + offset, n, 3);
+        ok = !ZSTD_isError(z) && std::fwrite(out.data(), 1, z, f) == z;
+    }
+    return std::fclose(f) == 0 && ok;
+}
+#endif
+
+//a copy of file cut in the middle must be an error, not a short count
+void check_truncated(const std::string &file) {
+    std::string cut = file + ".cut";
+    {
+        mapped_file whole(file);
+        std::FILE *f = std::fopen(cut.c_str(), "wb");
+        std::fwrite(whole.data(), 1, whole.size() / 2, f);
+        std::fclose(f);
+    }
+    std::string error;
+    long lines = count_lines_compressed(cut, &error);
+    std::cout << "  " << std::left << std::setw(20) << "cut in half" << std::right
+              << (lines < 0 ? error : "WRONG, " + std::to_string(lines) + " lines") << std::endl;
+    std::remove(cut.c_str());
+}
+
+template <typename Run>
+double best_of_3(Run run) {
+    double best = 1e30;
+    for (int rep = 0; rep < 3; ++rep) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+void report(const std::string &name, std::size_t bytes, double seconds, const wc_counts &counts,
+            const wc_counts &expected) {
+    bool ok = counts.lines() == expected.lines() && counts.words == expected.words && counts.bytes == expected.bytes;
+    std::cout << "  " << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(0)
+              << std::setw(8) << bytes / seconds / 1e6 << " MB/s  " << counts.lines() << " lines, "
+              << counts.words << " words" << (ok ? "" : "  WRONG") << std::defaultfloat << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    bool benchmark = argc == 1 || (argc == 2 && std::string(argv[1]).find_first_not_of("0123456789") == std::string::npos);
+    if (!benchmark) {
+        //[1]
+        int status = 0;
+        for (int i = 1; i < argc; ++i) {
+            block_counter counter;
+            std::string error;
+            if (!for_each_block(argv[i], std::ref(counter), &error)) {
+                std::cerr << error << std::endl;
+                status = 1;
+                continue;
+            }
+            std::cout << std::setw(10) << counter.counts().lines() << std::setw(10) << counter.counts().words
+                      << std::setw(12) << counter.counts().bytes << " " << argv[i] << std::endl;
+        }
+        return status;
+    }
+
+    //[2]
+    std::size_t total_mb = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64;
+    std::string text = make_text(total_mb << 20);
+    const std::string plain = "12_bench.txt", gz = "12_bench.txt.gz", multi = "12_bench_multi.txt.gz";
+    std::vector<std::string> compressed{gz, multi};
+    {
+        std::FILE *f = std::fopen(plain.c_str(), "wb");
+        std::fwrite(text.data(), 1, text.size(), f);
+        std::fclose(f);
+    }
+    if (!write_gzip(gz, text, 1) || !write_gzip(multi, text, 7)) {
+        std::cerr << "cannot write the .gz files" << std::endl;
+        return 1;
+    }
+#ifdef HAVE_ZSTD
+    compressed.push_back("12_bench.txt.zst");
+    compressed.push_back("12_bench_multi.txt.zst");
+    if (!write_zstd(compressed[2], text, 1) || !write_zstd(compressed[3], text, 7)) {
+        std::cerr << "cannot write the .zst files" << std::endl;
+        return 1;
+    }
+#endif
+    text = std::string();
+
+    block_counter reference;
+    for_each_block(plain, std::ref(reference));
+    std::size_t bytes = reference.counts().bytes;
+    std::cout << bytes / 1e6 << " MB of text, " << std::thread::hardware_concurrency() << " cores" << std::endl;
+
+    for (const auto &file: compressed) {
+        std::cout << file << " (" << std::fixed << std::setprecision(1) << mapped_file(file).size() / 1e6 << " MB)"
+                  << std::defaultfloat << std::endl;
+
+        wc_counts counts;
+        double seconds = best_of_3([&]() {
+            std::size_t produced = 0;
+            decompress_inline(file, [&produced](const char *, std::size_t size) { produced += size; });
+            counts = reference.counts();
+            counts.bytes = produced;
+        });
+        report("decompress only", bytes, seconds, counts, reference.counts());
+
+        seconds = best_of_3([&]() {
+            block_counter counter;
+            decompress_inline(file, std::ref(counter));
+            counts = counter.counts();
+        });
+        report("inline", bytes, seconds, counts, reference.counts());
+
+        seconds = best_of_3([&]() {
+            block_counter counter;
+            for_each_block(file, std::ref(counter));
+            counts = counter.counts();
+        });
+        report("overlapped", bytes, seconds, counts, reference.counts());
+
+        check_truncated(file);
+    }
+
+    std::remove(plain.c_str());
+    for (const auto &file: compressed) {
+        std::remove(file.c_str());
+    }
+
+    return 0;
+}
@@ -0,0 +1,155 @@
+/* README:
+- count the lines of every file under a directory, with the tree walked
+  by several getdents64 threads while a thread_pool already counts the
+  files found so far (see dir_walker.h).
+
+[1] With directory arguments it prints, per directory, the number of
+    directories, files and lines, and how long that took.
+    Usage: ./13_count_lines_tree dir...
+
+[2] Without arguments it benchmarks on a tree 13_tree/ of nested
+    directories (fan-out 8, depth 3) holding small files:
+    - enumerate only, with std::filesystem::recursive_directory_iterator
+      and with dir_walker,
+    - walk, then count: dir_walker collects every path into a vector first,
+      then count_lines_in_files_parallel() counts them (parallel_count.h),
+    - streamed: count_lines_in_tree(), enumeration and counting
+      overlapped,
+    and checks that the number of files and the total of lines agree. The
+    tree is removed at the end. Run it once more with the page cache
+    dropped (echo 3 > /proc/sys/vm/drop_caches) to see the walk when the
+    metadata has to come from the disk.
+    Usage: ./13_count_lines_tree [files]
+
+COMPILE:
+g++ -O2 13_count_lines_tree.cpp -o 13_count_lines_tree -lpthread
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <numeric>
+#include <filesystem>
+#include <cstdlib>
+
+#include <sys/stat.h>
+
+#include "dir_walker.h"
+#include "parallel_count.h"
+
+//fanout^depth leaf directories, files_per_dir small files in every directory
+void make_tree(const std::string &dir, int depth, int fanout, int files_per_dir, std::mt19937 &rng) {
+    ::mkdir(dir.c_str(), 0755);
+    std::uniform_int_distribution<int> lines(0, 40);
+    std::uniform_int_distribution<int> length(0, 60);
+
+    for (int i = 0; i < files_per_dir; ++i) {
+        std::ofstream ofs(dir + "/" + std::to_string(i) + ".log", std::ios::binary);
+        for (int n = lines(rng); n > 0; --n) {
+            ofs << std::string(length(rng), 'x') << '\n';
+        }
+    }
+    if (depth > 0) {
+        for (int i = 0; i < fanout; ++i) {
+            make_tree(dir + "/d" + std::to_string(i), depth - 1, fanout, files_per_dir, rng);
+        }
+    }
+}
+
+template <typename Run>
+double timed(Run run) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void print(const std::string &name, std::size_t files, double seconds, long lines = -1) {
+    std::cout << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(3)
+              << std::setw(8) << seconds << " s" << std::setprecision(0) << std::setw(11) << files / seconds
+              << " files/s  " << files << " files";
+    if (lines >= 0) {
+        std::cout << ", " << lines << " lines";
+    }
+    std::cout << std::defaultfloat << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    thread_pool pool(cores);
+
+    bool benchmark = argc == 1 || (argc == 2 && std::string(argv[1]).find_first_not_of("0123456789") == std::string::npos);
+    if (!benchmark) {
+        //[1]
+        for (int i = 1; i < argc; ++i) {
+            tree_count count = count_lines_in_tree(argv[i], pool);
+            std::cout << argv[i] << ": " << count.walk.dirs << " dirs, " << count.files.size() << " files, "
+                      << count.lines() << " lines, " << count.walk.errors << " errors, " << count.seconds << " s"
+                      << std::endl;
+        }
+        return 0;
+    }
+
+    //[2]
+    int files = argc > 1 ? std::atoi(argv[1]) : 20000;
+    const int fanout = 8, depth = 3;
+    int dirs = 0;
+    for (int level = 0, n = 1; level <= depth; ++level, n *= fanout) {
+        dirs += n;
+    }
+    const std::string root = "13_tree";
+    std::mt19937 rng(42);
+    make_tree(root, depth, fanout, std::max(1, files / dirs), rng);
+    std::cout << "walkers: " << dir_walker_options().threads << ", counting workers: " << cores << std::endl;
+
+    std::size_t fs_files = 0;
+    double seconds = timed([&]() {
+        for (const auto &entry: std::filesystem::recursive_directory_iterator(root)) {
+            fs_files += entry.is_regular_file();
+        }
+    });
+    print("enumerate, std::filesystem", fs_files, seconds);
+
+    std::vector<std::string> paths;
+    seconds = timed([&]() {
+        std::mutex mu;
+        dir_walker().walk(root, [&](std::vector<std::string> &batch) {
+            std::lock_guard<std::mutex> locker(mu);
+            for (auto &path: batch) {
+                paths.push_back(std::move(path));
+            }
+        });
+    });
+    print("enumerate, dir_walker", paths.size(), seconds);
+
+    long walk_then_count = 0;
+    seconds = timed([&]() {
+        std::vector<std::string> all;
+        std::mutex mu;
+        dir_walker().walk(root, [&](std::vector<std::string> &batch) {
+            std::lock_guard<std::mutex> locker(mu);
+            for (auto &path: batch) {
+                all.push_back(std::move(path));
+            }
+        });
+        auto lines = count_lines_in_files_parallel(all, pool).lines;
+        walk_then_count = std::accumulate(lines.begin(), lines.end(), 0L);
+    });
+    print("walk, then count", paths.size(), seconds, walk_then_count);
+
+    tree_count streamed = count_lines_in_tree(root, pool);
+    print("streamed", streamed.files.size(), streamed.seconds, streamed.lines());
+
+    if (paths.size() != fs_files || streamed.files.size() != fs_files || streamed.lines() != walk_then_count) {
+        std::cout << "ERROR: file or line counts differ" << std::endl;
+    }
+
+    std::filesystem::remove_all(root);
+
+    return 0;
+}
@@ -0,0 +1,491 @@
+/* README:
+- batched_reader: reads a list of files block by block and hands every block
+  to a callback, keeping many files in flight at once. The I/O layer for
+  counting lines in thousands of small files.
+
+[1] Why
+- For a 4KB file, ifstream (or open + mmap + munmap + close) spends far
+  more time in syscalls than in counting: every open, read and close is a
+  round trip into the kernel, and the thread waits for each one before
+  issuing the next.
+- io_uring (Linux 5.6+) lets one thread queue many opens, reads and closes
+  in shared rings and collect their results later, with one io_uring_enter
+  syscall per batch instead of one syscall per operation.
+
+[2] io_uring without liburing
+- uring: the raw rings, set up with the io_uring_setup syscall and mmap
+  (see <linux/io_uring.h>). The submission queue is an array of indices
+  into the sqes array; we fill an sqe, publish its index and bump the SQ
+  tail with a release store. The kernel fills cqes and bumps the CQ tail;
+  we read them after an acquire load and give them back by bumping the CQ
+  head.
+- Up to depth files are in flight, one slot (and one buffer) each. A slot
+  walks its file through OPENAT -> READ -> ... -> READ (0 bytes) -> CLOSE,
+  one operation at a time, so the blocks of a file arrive in order; when
+  the file is done the slot takes the next file from the list.
+- All callbacks run on the thread that called read_all(). If
+  io_uring_enter itself fails, read_all() throws std::system_error (and
+  later calls use the fallback). Whether it throws for that or because a
+  callback threw, it first cancels and reaps every operation still in the
+  kernel, so no read lands in a freed buffer.
+
+[3] Fallback
+- If io_uring_setup fails (old kernel, seccomp filter in a container) or
+  the kernel lacks one of the three operations (IORING_REGISTER_PROBE),
+  or options.force_fallback is set, read_all() runs one task per file on a
+  thread_pool (multithreading/thread_pool.h) of fallback_threads workers:
+  open, pread() block by block, close. The blocks of one file still arrive
+  in order from one thread, but different files call back concurrently.
+
+[4] read_all(files, on_data, on_done)
+- on_data(index, data, size): the next block of files[index].
+- on_done(index, ok): files[index] is finished; ok is false if it could
+  not be opened or read.
+- count_lines_in_files_batched(files) is the line counter on top of it.
+*/
+
+#ifndef BATCHED_READER_H
+#define BATCHED_READER_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "../../multithreading/thread_pool.h"
+#include "line_count.h"
+
+struct batched_reader_options {
+    unsigned depth = 64;                    //files in flight
+    std::size_t block_size = 128 << 10;
+    unsigned fallback_threads = 8;          //[3] I/O bound, more than the cores is fine
+    bool force_fallback = false;
+};
+
+//[2]
+class uring {
+public:
+    explicit uring(unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        m_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if (m_fd < 0) {
+            return;
+        }
+
+        m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+        }
+        m_sq_ring = ::mmap(nullptr, m_sq_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+        if (m_sq_ring == MAP_FAILED) {
+            m_sq_ring = nullptr;
+            return;
+        }
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            m_cq_ring = m_sq_ring;
+        } else {
+            m_cq_ring = ::mmap(nullptr, m_cq_size, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+            if (m_cq_ring == MAP_FAILED) {
+                m_cq_ring = nullptr;
+                return;
+            }
+        }
+        m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        void *sqes = ::mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            return;
+        }
+        m_sqes = static_cast<io_uring_sqe *>(sqes);
+
+        char *sq = static_cast<char *>(m_sq_ring);
+        m_sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+        m_sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        m_sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        m_sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        m_sq_entries = params.sq_entries;
+
+        char *cq = static_cast<char *>(m_cq_ring);
+        m_cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        m_cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        m_cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    }
+
+    ~uring() {
+        if (m_sqes) {
+            ::munmap(m_sqes, m_sqes_size);
+        }
+        if (m_cq_ring && m_cq_ring != m_sq_ring) {
+            ::munmap(m_cq_ring, m_cq_size);
+        }
+        if (m_sq_ring) {
+            ::munmap(m_sq_ring, m_sq_size);
+        }
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+    }
+
+    uring(const uring &) = delete;
+    uring &operator=(const uring &) = delete;
+
+    bool is_ready() const {
+        return m_sqes != nullptr;
+    }
+
+    //[3] true if the kernel knows every one of ops
+    bool supports(std::initializer_list<int> ops) const {
+        std::vector<char> buffer(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+        auto *probe = reinterpret_cast<io_uring_probe *>(buffer.data());
+        if (::syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+            return false;
+        }
+        for (int op: ops) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //a zeroed sqe to fill in; nullptr if the submission queue is full
+    io_uring_sqe *next_sqe() {
+        unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+        if (m_sq_local_tail - head >= m_sq_entries) {
+            return nullptr;
+        }
+        unsigned index = m_sq_local_tail & m_sq_mask;
+        io_uring_sqe *sqe = &m_sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        m_sq_array[index] = index;
+        ++m_sq_local_tail;
+        return sqe;
+    }
+
+    //publishes the sqes filled since the last call and waits for min_complete cqes
+    int submit_and_wait(unsigned min_complete) {
+        __atomic_store_n(m_sq_tail, m_sq_local_tail, __ATOMIC_RELEASE);
+        for (;;) {
+            //whatever the kernel has not consumed yet (it moves the SQ head)
+            unsigned to_submit = m_sq_local_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+            long r = ::syscall(__NR_io_uring_enter, m_fd, to_submit, min_complete,
+                               IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (r >= 0 || errno != EINTR) {
+                return static_cast<int>(r);
+            }
+        }
+    }
+
+    //calls f(cqe) for every completion available now; a cqe is consumed
+    //before f sees it, so if f throws, the ones not seen yet stay queued
+    template <typename F>
+    unsigned reap(F f) {
+        unsigned head = *m_cq_head;
+        unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+        unsigned n = 0;
+        try {
+            for (; head != tail; ++n) {
+                io_uring_cqe cqe = m_cqes[head & m_cq_mask];
+                ++head;
+                f(cqe);
+            }
+        } catch (...) {
+            __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+            throw;
+        }
+        __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+        return n;
+    }
+
+private:
+    int m_fd = -1;
+    void *m_sq_ring = nullptr;
+    void *m_cq_ring = nullptr;
+    std::size_t m_sq_size = 0;
+    std::size_t m_cq_size = 0;
+    std::size_t m_sqes_size = 0;
+    io_uring_sqe *m_sqes = nullptr;
+    unsigned *m_sq_head = nullptr;
+    unsigned *m_sq_tail = nullptr;
+    unsigned *m_sq_array = nullptr;
+    unsigned m_sq_mask = 0;
+    unsigned m_sq_entries = 0;
+    unsigned m_sq_local_tail = 0;
+    unsigned *m_cq_head = nullptr;
+    unsigned *m_cq_tail = nullptr;
+    unsigned m_cq_mask = 0;
+    io_uring_cqe *m_cqes = nullptr;
+};
+
+class batched_reader {
+public:
+    explicit batched_reader(batched_reader_options options = {}) : m_options(options) {
+        if (m_options.depth == 0) {
+            m_options.depth = 1;
+        }
+        if (!m_options.force_fallback) {
+            m_ring.reset(new uring(m_options.depth));
+            if (!m_ring->is_ready() ||
+                !m_ring->supports({IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE})) {
+                m_ring.reset();
+            }
+        }
+    }
+
+    bool uses_io_uring() const {
+        return m_ring != nullptr;
+    }
+
+    //[4]
+    template <typename OnData, typename OnDone>
+    void read_all(const std::vector<std::string> &files, OnData on_data, OnDone on_done) {
+        if (m_ring) {
+            read_all_uring(files, on_data, on_done);
+        } else {
+            read_all_pread(files, on_data, on_done);
+        }
+    }
+
+private:
+    struct slot {
+        enum state_e { opening, reading, closing } state = opening;
+        std::size_t index = 0;
+        int fd = -1;
+        std::uint64_t offset = 0;
+        bool ok = true;
+        bool busy = false;      //an operation of this slot is in the kernel
+        std::vector<char> buffer;
+    };
+
+    static constexpr std::uint64_t cancel_tag = std::uint64_t(1) << 63;
+
+    //[2]
+    template <typename OnData, typename OnDone>
+    void read_all_uring(const std::vector<std::string> &files, OnData &on_data, OnDone &on_done) {
+        std::vector<slot> slots(std::min<std::size_t>(m_options.depth, files.size()));
+        std::size_t next = 0;
+        std::size_t active = 0;
+        std::size_t in_flight = 0;      //operations whose cqe has not been reaped
+
+        auto prep = [this, &in_flight](slot &s, std::uint64_t user_data, const std::string *path) {
+            io_uring_sqe *sqe = m_ring->next_sqe();     //never full: one op per slot
+            sqe->user_data = user_data;
+            s.busy = true;
+            ++in_flight;
+            switch (s.state) {
+            case slot::opening:
+                sqe->opcode = IORING_OP_OPENAT;
+                sqe->fd = AT_FDCWD;
+                sqe->addr = reinterpret_cast<std::uint64_t>(path->c_str());
+                sqe->open_flags = O_RDONLY | O_CLOEXEC;
+                break;
+            case slot::reading:
+                sqe->opcode = IORING_OP_READ;
+                sqe->fd = s.fd;
+                sqe->addr = reinterpret_cast<std::uint64_t>(s.buffer.data());
+                sqe->len = static_cast<unsigned>(s.buffer.size());
+                sqe->off = s.offset;
+                break;
+            case slot::closing:
+                sqe->opcode = IORING_OP_CLOSE;
+                sqe->fd = s.fd;
+                break;
+            }
+        };
+        auto open_next = [&](std::size_t i) {
+            if (next == files.size()) {
+                --active;
+                return;
+            }
+            slot &s = slots[i];
+            s.state = slot::opening;
+            s.index = next++;
+            s.fd = -1;
+            s.offset = 0;
+            s.ok = true;
+            prep(s, i, &files[s.index]);
+        };
+
+        for (std::size_t i = 0; i < slots.size(); ++i) {
+            slots[i].buffer.resize(m_options.block_size);
+            ++active;
+            open_next(i);
+        }
+
+        bool ring_failed = false;
+        try {
+            while (active > 0) {
+                if (m_ring->submit_and_wait(1) < 0) {
+                    ring_failed = true;
+                    throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+                }
+                m_ring->reap([&](const io_uring_cqe &cqe) {
+                    std::size_t i = static_cast<std::size_t>(cqe.user_data);
+                    slot &s = slots[i];
+                    s.busy = false;
+                    --in_flight;
+                    switch (s.state) {
+                    case slot::opening:
+                        if (cqe.res < 0) {
+                            on_done(s.index, false);
+                            open_next(i);
+                            return;
+                        }
+                        s.fd = cqe.res;
+                        s.state = slot::reading;
+                        break;
+                    case slot::reading:
+                        if (cqe.res > 0) {
+                            on_data(s.index, s.buffer.data(), static_cast<std::size_t>(cqe.res));
+                            s.offset += static_cast<std::uint64_t>(cqe.res);
+                        } else {
+                            s.ok = cqe.res == 0;
+                            s.state = slot::closing;
+                        }
+                        break;
+                    case slot::closing:
+                        s.fd = -1;
+                        on_done(s.index, s.ok);
+                        open_next(i);
+                        return;
+                    }
+                    prep(s, i, nullptr);
+                });
+            }
+        } catch (...) {
+            abandon(slots, in_flight);
+            if (ring_failed) {
+                m_ring.reset();     //later calls use the fallback
+            }
+            throw;
+        }
+    }
+
+    /*[2] read_all_uring() is leaving early (io_uring_enter failed or a
+      callback threw) with operations still in the kernel, which may write
+      into the slot buffers at any time. Cancel them (IORING_OP_ASYNC_CANCEL,
+      if the kernel has it) and reap until every one has completed, closing
+      the fds they opened, before the slots may be freed. If the ring stops
+      working altogether, the slots are leaked rather than freed under the
+      kernel.*/
+    void abandon(std::vector<slot> &slots, std::size_t &in_flight) noexcept {
+        if (m_ring->supports({IORING_OP_ASYNC_CANCEL})) {
+            for (std::size_t i = 0; i < slots.size(); ++i) {
+                io_uring_sqe *sqe = slots[i].busy ? m_ring->next_sqe() : nullptr;
+                if (sqe) {
+                    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                    sqe->addr = i;                  //user_data of the operation to cancel
+                    sqe->user_data = i | cancel_tag;
+                    ++in_flight;
+                }
+            }
+        }
+
+        for (int failures = 0; in_flight > 0;) {
+            unsigned reaped = m_ring->reap([&slots, &in_flight](const io_uring_cqe &cqe) {
+                --in_flight;
+                if (cqe.user_data & cancel_tag) {
+                    return;
+                }
+                slot &s = slots[static_cast<std::size_t>(cqe.user_data)];
+                s.busy = false;
+                if (s.state == slot::opening && cqe.res >= 0) {
+                    ::close(cqe.res);
+                } else if (s.state == slot::closing) {
+                    s.fd = -1;
+                }
+            });
+            if (in_flight == 0 || reaped > 0) {
+                continue;
+            }
+            if (m_ring->submit_and_wait(1) < 0 && ((errno != EAGAIN && errno != EBUSY) || ++failures > 1000)) {
+                new std::vector<slot>(std::move(slots));   //deliberately leaked, see above
+                return;
+            }
+        }
+
+        for (auto &s: slots) {
+            if (s.fd >= 0) {
+                ::close(s.fd);
+                s.fd = -1;
+            }
+        }
+    }
+
+    //[3]
+    template <typename OnData, typename OnDone>
+    void read_all_pread(const std::vector<std::string> &files, OnData on_data, OnDone on_done) {
+        thread_pool pool(m_options.fallback_threads ? m_options.fallback_threads : 1);
+        std::vector<light_future<void>> done;
+        const std::size_t block_size = m_options.block_size;
+
+        for (std::size_t index = 0; index < files.size(); ++index) {
+            done.push_back(pool.spawn([&, index]() {
+                int fd = ::open(files[index].c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd < 0) {
+                    on_done(index, false);
+                    return;
+                }
+                std::vector<char> buffer(block_size);
+                std::uint64_t offset = 0;
+                bool ok = true;
+                for (;;) {
+                    ssize_t n = ::pread(fd, buffer.data(), buffer.size(), static_cast<off_t>(offset));
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (n <= 0) {
+                        ok = n == 0;
+                        break;
+                    }
+                    on_data(index, buffer.data(), static_cast<std::size_t>(n));
+                    offset += static_cast<std::uint64_t>(n);
+                }
+                ::close(fd);
+                on_done(index, ok);
+            }));
+        }
+        for (auto &fu: done) {
+            fu.get();
+        }
+    }
+
+    batched_reader_options m_options;
+    std::unique_ptr<uring> m_ring;
+};
+
+//[4] -1 for files that could not be read
+inline std::vector<long>
+count_lines_in_files_batched(const std::vector<std::string> &files, batched_reader &reader) {
+    std::vector<line_counter> counters(files.size());
+    std::vector<long> results(files.size(), -1);
+
+    reader.read_all(files,
+        [&counters](std::size_t index, const char *data, std::size_t size) {
+            counters[index].feed(data, size);
+        },
+        [&counters, &results](std::size_t index, bool ok) {
+            results[index] = ok ? counters[index].lines() : -1;
+        });
+
+    return results;
+}
+
+#endif //BATCHED_READER_H
@@ -0,0 +1,172 @@
+/* README:
+- make_corpora(dir, options): writes a set of reproducible test corpora for
+  the line counters of ch-01, one sub-directory per corpus. The same seed
+  gives byte for byte the same files.
+
+[1] The corpora, each chosen to break a different assumption:
+- tiny: thousands of files of 0..200 bytes, including empty files, a lone
+  "\n" and a lone "x" (syscall cost per file, empty-file handling).
+- huge: one big file of random lines (throughput, chunking).
+- no_newline: files whose last line has no '\n' (the +1 for the open last
+  line).
+- crlf: "\r\n" line endings, some files without a final one.
+- long_lines: lines of 0.5..4MB (buffers that must grow, lines straddling
+  every chunk boundary).
+- newlines: a file of nothing but '\n' (a match in every byte).
+
+[2] remove_corpora() deletes what make_corpora() wrote.
+*/
+
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct corpus {
+    std::string name;
+    std::string dir;
+    std::vector<std::string> files;
+    std::size_t bytes = 0;
+};
+
+struct corpus_options {
+    unsigned seed = 42;
+    std::size_t huge_mb = 128;
+    int tiny_files = 2000;
+};
+
+namespace corpus_detail {
+
+class writer {
+public:
+    writer(const std::string &root, const std::string &name, std::mt19937 &rng) : m_rng(rng) {
+        m_corpus.name = name;
+        m_corpus.dir = root + "/" + name;
+        ::mkdir(m_corpus.dir.c_str(), 0755);
+    }
+
+    //a line of `length` random printable characters
+    std::string line(std::size_t length, const char *end = "\n") {
+        std::uniform_int_distribution<int> ch('!', '~');
+        std::string s(length, ' ');
+        for (auto &c: s) {
+            c = m_rng() % 8 ? static_cast<char>(ch(m_rng)) : ' ';
+        }
+        return s + end;
+    }
+
+    //a file of random lines of 0..max_length characters, about `bytes` long
+    std::string lines(std::size_t bytes, std::size_t max_length, const char *end = "\n") {
+        std::string s;
+        while (s.size() < bytes) {
+            s += line(m_rng() % (max_length + 1), end);
+        }
+        return s;
+    }
+
+    void file(const std::string &content) {
+        std::string name = m_corpus.dir + "/" + std::to_string(m_corpus.files.size()) + ".txt";
+        std::ofstream ofs(name, std::ios::binary);
+        ofs.write(content.data(), static_cast<std::streamsize>(content.size()));
+        m_corpus.files.push_back(name);
+        m_corpus.bytes += content.size();
+    }
+
+    corpus done() {
+        return m_corpus;
+    }
+
+private:
+    std::mt19937 &m_rng;
+    corpus m_corpus;
+};
+
+} //namespace corpus_detail
+
+//[1]
+inline std::vector<corpus> make_corpora(const std::string &root, const corpus_options &options = {}) {
+    using corpus_detail::writer;
+    std::mt19937 rng(options.seed);
+    std::vector<corpus> corpora;
+    ::mkdir(root.c_str(), 0755);
+
+    {
+        writer w(root, "tiny", rng);
+        w.file("");
+        w.file("\n");
+        w.file("x");
+        for (int i = 3; i < options.tiny_files; ++i) {
+            std::string s = w.lines(rng() % 200, 40);
+            w.file(s.substr(0, rng() % (s.size() + 1)));
+        }
+        corpora.push_back(w.done());
+    }
+    {
+        writer w(root, "huge", rng);
+        std::string content;
+        for (std::size_t left = options.huge_mb << 20; left > 0;) {
+            std::string block = w.lines(std::min<std::size_t>(left, 1 << 20), 120);
+            left -= std::min(left, block.size());
+            content += block;
+        }
+        w.file(content);
+        corpora.push_back(w.done());
+    }
+    {
+        writer w(root, "no_newline", rng);
+        for (int i = 0; i < 200; ++i) {
+            std::string s = w.lines(rng() % (64 << 10), 120);
+            s += w.line(1 + rng() % 80, "");
+            w.file(s);
+        }
+        corpora.push_back(w.done());
+    }
+    {
+        writer w(root, "crlf", rng);
+        for (int i = 0; i < 200; ++i) {
+            std::string s = w.lines(rng() % (64 << 10), 120, "\r\n");
+            w.file(i % 2 ? s : s + w.line(10, ""));
+        }
+        corpora.push_back(w.done());
+    }
+    {
+        writer w(root, "long_lines", rng);
+        for (int i = 0; i < 8; ++i) {
+            std::string s;
+            while (s.size() < (std::size_t(8) << 20)) {
+                s += w.line((std::size_t(512) << 10) + rng() % (std::size_t(3584) << 10));
+            }
+            w.file(i % 2 ? s : s.substr(0, s.size() - 1));
+        }
+        corpora.push_back(w.done());
+    }
+    {
+        writer w(root, "newlines", rng);
+        w.file(std::string(std::size_t(32) << 20, '\n'));
+        corpora.push_back(w.done());
+    }
+
+    return corpora;
+}
+
+//[2]
+inline void remove_corpora(const std::string &root, const std::vector<corpus> &corpora) {
+    for (const auto &c: corpora) {
+        for (const auto &file: c.files) {
+            std::remove(file.c_str());
+        }
+        ::rmdir(c.dir.c_str());
+    }
+    ::rmdir(root.c_str());
+}
+
+#endif //CORPUS_H
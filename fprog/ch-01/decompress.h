@@ -0,0 +1,470 @@
+/* README:
+- Compressed input for the line/word counters: a file is read through a
+  byte_source that hands out its decompressed bytes, and
+  for_each_block() runs the decompression on its own thread while the
+  caller counts the blocks it has already produced.
+
+[1] byte_source: read(out, capacity) fills out with the next decompressed
+    bytes (0 at the end, -1 on error, see error()). open_source(file)
+    looks at the first bytes of the file and picks:
+    - gzip (1f 8b): zlib's inflate with automatic header detection.
+      Several gzip members one after another (cat a.gz b.gz, or a log
+      appended to with gzip >>) are decompressed as one stream.
+    - zstd (28 b5 2f fd): ZSTD_decompressStream, only if compiled with
+      -DHAVE_ZSTD (and -lzstd); otherwise open_source() fails with a
+      message saying so. Consecutive frames are handled too.
+    - anything else: the plain bytes, with read().
+    A stream that ends in the middle of a member/frame is an error
+    ("truncated"), not a silently short count. Bytes after the last gzip
+    member that do not start a new one (zero padding from tape or block
+    devices) end the stream and are ignored, as gzip itself does.
+
+[2] block_pipe: a bounded queue of `depth` reusable blocks between one
+    producer and one consumer (mutex + condition_variable, as in
+    7_condition_variable.cpp; at 1MB per block the lock is taken a few
+    thousand times per GB). The producer decompresses straight into a free
+    block, so no byte is copied between the two stages; when every block
+    is full or being counted, the producer waits, so memory stays bounded
+    at depth * block_size.
+
+[3] for_each_block(file, consume): the decompressor runs on a new thread,
+    consume(data, size) on the calling thread, overlapped; the total time
+    is that of the slower stage, which for gzip is the decompressor.
+    decompress_inline(file, consume) does both on the calling thread, for
+    callers that already run many files in parallel (one task per file on a
+    thread_pool, see count_lines_in_files_compressed()).
+
+[4] count_lines_in_files_compressed(files, pool, errors): -1 for a file that
+    cannot be opened or decompressed; if errors is given, it gets one string
+    per file, in the order of files, holding why (empty for the files that
+    were counted).
+*/
+
+#ifndef DECOMPRESS_H
+#define DECOMPRESS_H
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "../../multithreading/thread_pool.h"
+#include "line_count.h"
+
+//[1]
+class byte_source {
+public:
+    virtual ~byte_source() {
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+    }
+
+    virtual long read(char *out, std::size_t capacity) = 0;
+
+    const std::string &error() const {
+        return m_error;
+    }
+
+protected:
+    explicit byte_source(int fd) : m_fd(fd) {}
+
+    long fail(const std::string &message) {
+        m_error = message;
+        return -1;
+    }
+
+    //raw bytes from the file, retrying on EINTR
+    long read_raw(char *out, std::size_t capacity) {
+        for (;;) {
+            ssize_t n = ::read(m_fd, out, capacity);
+            if (n >= 0 || errno != EINTR) {
+                return n < 0 ? fail(std::strerror(errno)) : static_cast<long>(n);
+            }
+        }
+    }
+
+    int m_fd;
+    std::string m_error;
+};
+
+class plain_source : public byte_source {
+public:
+    explicit plain_source(int fd) : byte_source(fd) {}
+
+    long read(char *out, std::size_t capacity) override {
+        std::size_t filled = 0;
+        while (filled < capacity) {
+            long n = read_raw(out + filled, capacity - filled);
+            if (n < 0) {
+                return n;
+            }
+            if (n == 0) {
+                break;
+            }
+            filled += static_cast<std::size_t>(n);
+        }
+        return static_cast<long>(filled);
+    }
+};
+
+class gzip_source : public byte_source {
+public:
+    explicit gzip_source(int fd) : byte_source(fd), m_in(256 << 10) {
+        std::memset(&m_stream, 0, sizeof(m_stream));
+        m_ok = inflateInit2(&m_stream, 15 + 32) == Z_OK;   //+32: gzip or zlib header
+    }
+
+    ~gzip_source() override {
+        if (m_ok) {
+            inflateEnd(&m_stream);
+        }
+    }
+
+    long read(char *out, std::size_t capacity) override {
+        if (!m_ok) {
+            return fail("inflateInit2 failed");
+        }
+        m_stream.next_out = reinterpret_cast<Bytef *>(out);
+        m_stream.avail_out = static_cast<uInt>(capacity);
+
+        while (m_stream.avail_out > 0 && !m_done) {
+            //after a member, keep reading until the 2 bytes of the next magic are in
+            if (m_stream.avail_in < (m_between_members ? 2u : 1u) && !m_in_eof) {
+                std::size_t kept = m_stream.avail_in;
+                if (kept > 0) {
+                    std::memmove(m_in.data(), m_stream.next_in, kept);
+                }
+                long n = read_raw(m_in.data() + kept, m_in.size() - kept);
+                if (n < 0) {
+                    return n;
+                }
+                m_in_eof = n == 0;
+                m_stream.next_in = reinterpret_cast<Bytef *>(m_in.data());
+                m_stream.avail_in = static_cast<uInt>(kept + static_cast<std::size_t>(n));
+                continue;
+            }
+            if (m_between_members && (m_stream.avail_in < 2 || m_stream.next_in[0] != 0x1f
+                                      || m_stream.next_in[1] != 0x8b)) {
+                m_done = true;  //[1] padding or garbage after the last member: ignored, as gzip does
+                break;
+            }
+            if (m_stream.avail_in == 0) {
+                break;          //end of the file inside a member
+            }
+            int r = inflate(&m_stream, Z_NO_FLUSH);
+            if (r == Z_STREAM_END) {
+                inflateReset(&m_stream);    //another member may follow
+                m_between_members = true;
+                continue;
+            }
+            if (r != Z_OK) {
+                return fail(std::string("gzip: ") + (m_stream.msg ? m_stream.msg : "corrupt data"));
+            }
+            m_between_members = false;
+        }
+
+        long produced = static_cast<long>(capacity - m_stream.avail_out);
+        if (produced == 0 && m_in_eof && !m_between_members) {
+            return fail("gzip: truncated");
+        }
+        return produced;
+    }
+
+private:
+    z_stream m_stream;
+    std::vector<char> m_in;
+    bool m_ok = false;
+    bool m_in_eof = false;
+    bool m_between_members = false;
+    bool m_done = false;
+};
+
+#ifdef HAVE_ZSTD
+class zstd_source : public byte_source {
+public:
+    explicit zstd_source(int fd) : byte_source(fd), m_in(ZSTD_DStreamInSize()), m_stream(ZSTD_createDStream()) {
+        if (m_stream) {
+            ZSTD_initDStream(m_stream);
+        }
+        m_input = {m_in.data(), 0, 0};
+    }
+
+    ~zstd_source() override {
+        ZSTD_freeDStream(m_stream);
+    }
+
+    long read(char *out, std::size_t capacity) override {
+        if (!m_stream) {
+            return fail("ZSTD_createDStream failed");
+        }
+        ZSTD_outBuffer output = {out, capacity, 0};
+
+        while (output.pos < output.size) {
+            if (m_input.pos == m_input.size) {
+                long n = m_in_eof ? 0 : read_raw(m_in.data(), m_in.size());
+                if (n < 0) {
+                    return n;
+                }
+                if (n == 0) {
+                    m_in_eof = true;
+                    break;
+                }
+                m_input = {m_in.data(), static_cast<std::size_t>(n), 0};
+            }
+            std::size_t r = ZSTD_decompressStream(m_stream, &output, &m_input);
+            if (ZSTD_isError(r)) {
+                return fail(std::string("zstd: ") + ZSTD_getErrorName(r));
+            }
+            m_between_frames = r == 0;
+        }
+
+        if (output.pos == 0 && m_in_eof && !m_between_frames) {
+            return fail("zstd: truncated");
+        }
+        return static_cast<long>(output.pos);
+    }
+
+private:
+    std::vector<char> m_in;
+    ZSTD_DStream *m_stream;
+    ZSTD_inBuffer m_input;
+    bool m_in_eof = false;
+    bool m_between_frames = false;
+};
+#endif //HAVE_ZSTD
+
+//[1] nullptr (and *error set) if the file cannot be opened or decoded
+inline std::unique_ptr<byte_source> open_source(const std::string &file_name, std::string *error = nullptr) {
+    int fd = ::open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (error) {
+            *error = file_name + ": " + std::strerror(errno);
+        }
+        return nullptr;
+    }
+
+    unsigned char magic[4] = {0, 0, 0, 0};
+    ssize_t n = ::pread(fd, magic, sizeof(magic), 0);
+    if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+        return std::unique_ptr<byte_source>(new gzip_source(fd));
+    }
+    if (n == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+#ifdef HAVE_ZSTD
+        return std::unique_ptr<byte_source>(new zstd_source(fd));
+#else
+        ::close(fd);
+        if (error) {
+            *error = file_name + ": zstd input, compile with -DHAVE_ZSTD -lzstd";
+        }
+        return nullptr;
+#endif
+    }
+    return std::unique_ptr<byte_source>(new plain_source(fd));
+}
+
+//[2]
+class block_pipe {
+public:
+    struct block {
+        std::vector<char> data;
+        std::size_t size = 0;
+    };
+
+    block_pipe(std::size_t depth, std::size_t block_size) {
+        for (std::size_t i = 0; i < (depth ? depth : 1); ++i) {
+            m_blocks.emplace_back(new block{std::vector<char>(block_size), 0});
+            m_free.push_back(m_blocks.back().get());
+        }
+    }
+
+    //producer: a free block to fill, nullptr if the consumer cancelled
+    block *acquire() {
+        std::unique_lock<std::mutex> locker(m_mu);
+        m_cond.wait(locker, [this]() { return !m_free.empty() || m_cancelled; });
+        if (m_cancelled) {
+            return nullptr;
+        }
+        block *b = m_free.front();
+        m_free.pop_front();
+        return b;
+    }
+
+    //producer: b is filled (b->size bytes)
+    void push(block *b) {
+        {
+            std::lock_guard<std::mutex> locker(m_mu);
+            m_full.push_back(b);
+        }
+        m_cond.notify_all();
+    }
+
+    //producer: nothing more will be pushed
+    void close() {
+        {
+            std::lock_guard<std::mutex> locker(m_mu);
+            m_closed = true;
+        }
+        m_cond.notify_all();
+    }
+
+    //consumer: the next filled block, nullptr once closed and drained
+    block *pop() {
+        std::unique_lock<std::mutex> locker(m_mu);
+        m_cond.wait(locker, [this]() { return !m_full.empty() || m_closed; });
+        if (m_full.empty()) {
+            return nullptr;
+        }
+        block *b = m_full.front();
+        m_full.pop_front();
+        return b;
+    }
+
+    //either side: b can be filled again
+    void release(block *b) {
+        {
+            std::lock_guard<std::mutex> locker(m_mu);
+            m_free.push_back(b);
+        }
+        m_cond.notify_all();
+    }
+
+    //consumer: stop the producer (its acquire() returns nullptr)
+    void cancel() {
+        {
+            std::lock_guard<std::mutex> locker(m_mu);
+            m_cancelled = true;
+        }
+        m_cond.notify_all();
+    }
+
+private:
+    std::vector<std::unique_ptr<block>> m_blocks;
+    std::deque<block *> m_free;
+    std::deque<block *> m_full;
+    std::mutex m_mu;
+    std::condition_variable m_cond;
+    bool m_closed = false;
+    bool m_cancelled = false;
+};
+
+//[3] false (and *error set) if the file cannot be opened or decompressed
+template <typename Consume>
+bool for_each_block(const std::string &file_name, Consume consume, std::string *error = nullptr,
+                    std::size_t block_size = std::size_t(1) << 20, std::size_t depth = 4) {
+    std::unique_ptr<byte_source> source = open_source(file_name, error);
+    if (!source) {
+        return false;
+    }
+
+    block_pipe pipe(depth, block_size);
+    bool failed = false;
+    std::thread producer([&]() {
+        while (block_pipe::block *b = pipe.acquire()) {
+            long n = source->read(b->data.data(), b->data.size());
+            if (n <= 0) {
+                failed = n < 0;
+                pipe.release(b);
+                break;
+            }
+            b->size = static_cast<std::size_t>(n);
+            pipe.push(b);
+        }
+        pipe.close();
+    });
+
+    try {
+        while (block_pipe::block *b = pipe.pop()) {
+            consume(static_cast<const char *>(b->data.data()), b->size);
+            pipe.release(b);
+        }
+    } catch (...) {
+        pipe.cancel();
+        producer.join();
+        throw;
+    }
+    producer.join();
+
+    if (failed && error) {
+        *error = file_name + ": " + source->error();
+    }
+    return !failed;
+}
+
+//[3]
+template <typename Consume>
+bool decompress_inline(const std::string &file_name, Consume consume, std::string *error = nullptr,
+                       std::size_t block_size = std::size_t(1) << 20) {
+    std::unique_ptr<byte_source> source = open_source(file_name, error);
+    if (!source) {
+        return false;
+    }
+
+    std::vector<char> buffer(block_size);
+    for (;;) {
+        long n = source->read(buffer.data(), buffer.size());
+        if (n < 0) {
+            if (error) {
+                *error = file_name + ": " + source->error();
+            }
+            return false;
+        }
+        if (n == 0) {
+            return true;
+        }
+        consume(static_cast<const char *>(buffer.data()), static_cast<std::size_t>(n));
+    }
+}
+
+//-1 if the file cannot be opened or decompressed
+inline long count_lines_compressed(const std::string &file_name, std::string *error = nullptr) {
+    line_counter counter;
+    bool ok = for_each_block(file_name, [&counter](const char *data, std::size_t size) {
+        counter.feed(data, size);
+    }, error);
+    return ok ? counter.lines() : -1;
+}
+
+//[4] one file per pool task, each decompressed and counted inline
+inline std::vector<long>
+count_lines_in_files_compressed(const std::vector<std::string> &files, thread_pool &pool,
+                                std::vector<std::string> *errors = nullptr) {
+    std::vector<std::string> messages(files.size());
+    std::vector<light_future<long>> futures;
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        futures.push_back(pool.spawn([&file = files[i], &error = messages[i]]() {
+            line_counter counter;
+            bool ok = decompress_inline(file, [&counter](const char *data, std::size_t size) {
+                counter.feed(data, size);
+            }, &error);
+            return ok ? counter.lines() : -1L;
+        }));
+    }
+
+    std::vector<long> results;
+    for (auto &fu: futures) {
+        results.push_back(fu.get());
+    }
+    if (errors) {
+        *errors = std::move(messages);
+    }
+    return results;
+}
+
+#endif //DECOMPRESS_H
@@ -0,0 +1,342 @@
+/* README:
+- dir_walker: enumerate a directory tree on several threads with
+  getdents64, handing the regular files to a callback while the walk is
+  still going, instead of building a std::vector<std::string> of every path
+  before the first file is counted.
+- count_lines_in_tree(root, pool): the walker feeds count_lines_mmap()
+  tasks on a thread_pool, so the tree is enumerated and counted at the same
+  time.
+
+[1] The walk
+- A shared stack of directories (mutex + condition_variable) and `threads`
+  walker threads. A walker pops a directory, reads it with getdents64 into
+  a 64KB buffer (hundreds of entries per syscall, where readdir() hands
+  them out one by one), pushes the sub-directories and passes the regular
+  files on. A stack rather than a queue: depth first keeps the number of
+  pending directories small on wide trees.
+- d_type tells files and directories apart without a stat() per entry;
+  only when the file system does not fill it in (DT_UNKNOWN) is the entry
+  fstatat()ed.
+- Symbolic links are not followed (no cycles, no file counted twice);
+  ".", ".." and anything that is neither a directory nor a regular file are
+  skipped. A directory that cannot be opened or read, or an entry whose
+  fstatat() fails, is counted in walk_stats::errors and the walk goes on.
+- The walk is over when the stack is empty and no walker is inside a
+  directory (`m_busy`), since a busy walker may still push more.
+
+[2] walk(root, on_files)
+- on_files(std::vector<std::string> &paths) is called on a walker thread
+  with at most `batch` regular files of one directory, so a directory of a
+  million files is streamed in pieces; it may move the strings out.
+  Several walkers call it at the same time.
+- If on_files throws, the walk stops and walk() rethrows the first
+  exception once every walker has finished.
+- If root is not a directory, it is passed to on_files as a single file
+  (or counted as an error if it does not exist).
+
+[3] count_lines_in_tree(root, pool)
+- Every batch becomes one spawn()ed task that counts its files with
+  count_lines_mmap(), so workers start on the first directory while the
+  walkers are still reading the rest. The walkers are threads of their
+  own, not pool tasks: getdents64 blocks on cold metadata, and a blocked
+  walker must not take a counting worker with it.
+- tree_count::files holds (path, lines) in the order the batches were
+  spawned, not sorted; lines is -1 if the file could not be opened.
+*/
+
+#ifndef DIR_WALKER_H
+#define DIR_WALKER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "../../multithreading/thread_pool.h"
+#include "line_count.h"
+
+struct dir_walker_options {
+    unsigned threads = 4;
+    std::size_t batch = 256;                 //[2] files per on_files() call
+    std::size_t buffer_size = 64 << 10;      //[1] getdents64 buffer
+};
+
+struct walk_stats {
+    std::size_t dirs = 0;
+    std::size_t files = 0;
+    std::size_t errors = 0;
+};
+
+class dir_walker {
+public:
+    explicit dir_walker(dir_walker_options options = {}) : m_options(options) {
+        m_options.threads = std::max(1u, m_options.threads);
+        m_options.batch = std::max<std::size_t>(1, m_options.batch);
+    }
+
+    //[2]
+    template <typename OnFiles>
+    walk_stats walk(const std::string &root, OnFiles on_files) {
+        m_stack.clear();
+        m_busy = 0;
+        m_stopped = false;
+        m_error = nullptr;
+        m_dirs = m_files = m_errors = 0;
+
+        struct stat st;
+        if (::stat(root.c_str(), &st) != 0) {
+            return walk_stats{0, 0, 1};
+        }
+        if (!S_ISDIR(st.st_mode)) {
+            std::vector<std::string> single{root};
+            on_files(single);
+            return walk_stats{0, 1, 0};
+        }
+
+        m_stack.push_back(root);
+        std::vector<std::thread> walkers;
+        for (unsigned i = 0; i < m_options.threads; ++i) {
+            walkers.emplace_back([this, &on_files]() { run(on_files); });
+        }
+        for (auto &t: walkers) {
+            t.join();
+        }
+
+        if (m_error) {
+            std::rethrow_exception(m_error);
+        }
+        return walk_stats{m_dirs.load(), m_files.load(), m_errors.load()};
+    }
+
+private:
+    //linux_dirent64 of getdents64(2); glibc < 2.30 has no wrapper
+    struct dirent64_t {
+        std::uint64_t d_ino;
+        std::int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[1];
+    };
+
+    //[1] the next directory, false once the walk is over
+    bool pop(std::string &dir) {
+        std::unique_lock<std::mutex> locker(m_mu);
+        m_cond.wait(locker, [this]() { return !m_stack.empty() || m_busy == 0 || m_stopped; });
+        if (m_stopped || m_stack.empty()) {
+            return false;
+        }
+        dir = std::move(m_stack.back());
+        m_stack.pop_back();
+        ++m_busy;
+        return true;
+    }
+
+    void push(std::vector<std::string> &dirs) {
+        if (dirs.empty()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> locker(m_mu);
+            for (auto &d: dirs) {
+                m_stack.push_back(std::move(d));
+            }
+        }
+        dirs.clear();
+        m_cond.notify_all();
+    }
+
+    void finished() {
+        bool last;
+        {
+            std::lock_guard<std::mutex> locker(m_mu);
+            last = --m_busy == 0 && m_stack.empty();
+        }
+        if (last) {
+            m_cond.notify_all();
+        }
+    }
+
+    void stop(std::exception_ptr error) {
+        {
+            std::lock_guard<std::mutex> locker(m_mu);
+            if (!m_error) {
+                m_error = error;
+            }
+            m_stopped = true;
+        }
+        m_cond.notify_all();
+    }
+
+    template <typename OnFiles>
+    void run(OnFiles &on_files) {
+        std::vector<char> buffer(m_options.buffer_size);
+        std::vector<std::string> dirs, files;
+        std::string dir;
+
+        while (pop(dir)) {
+            try {
+                read_dir(dir, buffer, dirs, files, on_files);
+            } catch (...) {
+                files.clear();
+                stop(std::current_exception());
+            }
+            push(dirs);
+            finished();
+        }
+    }
+
+    template <typename OnFiles>
+    void read_dir(const std::string &dir, std::vector<char> &buffer, std::vector<std::string> &dirs,
+                  std::vector<std::string> &files, OnFiles &on_files) {
+        int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            ++m_errors;
+            return;
+        }
+        ++m_dirs;
+
+        std::string prefix = dir.back() == '/' ? dir : dir + "/";
+        auto flush = [&]() {
+            if (!files.empty()) {
+                m_files += files.size();
+                on_files(files);
+                files.clear();
+            }
+        };
+
+        struct closer {
+            int fd;
+            ~closer() { ::close(fd); }
+        } close_fd{fd};
+
+        for (;;) {
+            long n = ::syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                ++m_errors;
+                break;
+            }
+            if (n == 0) {
+                break;
+            }
+
+            for (long offset = 0; offset < n;) {
+                const auto *entry = reinterpret_cast<const dirent64_t *>(buffer.data() + offset);
+                offset += entry->d_reclen;
+
+                const char *name = entry->d_name;
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                    continue;
+                }
+
+                unsigned char type = entry->d_type;
+                if (type == DT_UNKNOWN) {
+                    struct stat st;
+                    if (::fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                        ++m_errors;
+                        continue;
+                    }
+                    type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_LNK;
+                }
+
+                if (type == DT_DIR) {
+                    dirs.push_back(prefix + name);
+                } else if (type == DT_REG) {
+                    files.push_back(prefix + name);
+                    if (files.size() >= m_options.batch) {
+                        flush();
+                    }
+                }
+            }
+            //hand what was found on to the other walkers before the next read
+            push(dirs);
+        }
+        flush();
+    }
+
+    dir_walker_options m_options;
+
+    std::vector<std::string> m_stack;
+    std::size_t m_busy = 0;
+    bool m_stopped = false;
+    std::exception_ptr m_error;
+    std::mutex m_mu;
+    std::condition_variable m_cond;
+
+    std::atomic<std::size_t> m_dirs{0};
+    std::atomic<std::size_t> m_files{0};
+    std::atomic<std::size_t> m_errors{0};
+};
+
+//[3]
+struct tree_count {
+    std::vector<std::pair<std::string, long>> files;
+    walk_stats walk;
+    double seconds = 0;
+
+    long lines() const {
+        long total = 0;
+        for (const auto &f: files) {
+            total += f.second > 0 ? f.second : 0;
+        }
+        return total;
+    }
+
+    double files_per_second() const {
+        return seconds > 0 ? files.size() / seconds : 0;
+    }
+};
+
+//[3]
+inline tree_count count_lines_in_tree(const std::string &root, thread_pool &pool, dir_walker_options options = {}) {
+    using batch_result = std::vector<std::pair<std::string, long>>;
+    auto start = std::chrono::steady_clock::now();
+
+    std::mutex mu;
+    std::vector<light_future<batch_result>> futures;
+
+    dir_walker walker(options);
+    tree_count result;
+    result.walk = walker.walk(root, [&](std::vector<std::string> &paths) {
+        auto fu = pool.spawn([batch = std::move(paths)]() mutable {
+            batch_result counted;
+            counted.reserve(batch.size());
+            for (auto &path: batch) {
+                long lines = count_lines_mmap(path);
+                counted.emplace_back(std::move(path), lines);
+            }
+            return counted;
+        });
+        std::lock_guard<std::mutex> locker(mu);
+        futures.push_back(std::move(fu));
+    });
+
+    result.files.reserve(result.walk.files);
+    for (auto &fu: futures) {
+        for (auto &f: fu.get()) {
+            result.files.push_back(std::move(f));
+        }
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+#endif //DIR_WALKER_H
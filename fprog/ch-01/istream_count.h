@@ -0,0 +1,95 @@
+/* README:
+- The count_lines / count_lines_in_files of 01_count_lines_stdcount.cpp,
+  02_count_lines_accumulate.cpp and 03_count_lines_transform.cpp, under
+  distinct names, so benchmarks can run them next to the faster versions.
+- 03 uses the count_lines of 01; only its count_lines_in_files differs.
+*/
+
+#ifndef ISTREAM_COUNT_H
+#define ISTREAM_COUNT_H
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <string>
+#include <vector>
+
+//01_count_lines_stdcount.cpp
+inline int count_lines_stdcount(const std::string &file_name) {
+    std::ifstream ifs(file_name);
+    ifs.unsetf(std::ios_base::skipws);
+
+    int count = std::count(
+        std::istream_iterator<char>(ifs),
+        std::istream_iterator<char>(),
+        '\n'
+        );
+
+    ifs.clear();
+    ifs.seekg(-1, std::ios_base::end);
+    char last;
+    if (ifs.get(last) && last != '\n') {
+        ++count;
+    }
+
+    return count;
+}
+
+inline std::vector<int>
+count_lines_in_files_stdcount(const std::vector<std::string> &files) {
+    std::vector<int> results;
+
+    for (const auto &file: files) {
+        results.push_back(count_lines_stdcount(file));
+    }
+
+    return results;
+}
+
+//02_count_lines_accumulate.cpp
+inline int count_lines_accumulate(const std::string &file) {
+    std::ifstream ifs(file);
+
+    int count = std::accumulate(
+        std::istream_iterator<char>(ifs >> std::noskipws),
+        std::istream_iterator<char>(),
+        0,
+        [](int count, char ch) { return (ch != '\n') ? count : count + 1; }
+    );
+
+    ifs.clear();
+    ifs.seekg(-1, std::ios_base::end);
+    char last;
+    if (ifs.get(last) && last != '\n') {
+        count++;
+    }
+
+    return count;
+}
+
+inline std::vector<int>
+count_lines_in_files_accumulate(const std::vector<std::string> &files) {
+    std::vector<int> results;
+
+    for (const auto &file: files) {
+        results.push_back(count_lines_accumulate(file));
+    }
+
+    return results;
+}
+
+//03_count_lines_transform.cpp
+inline std::vector<int>
+count_lines_in_files_transform(const std::vector<std::string> &files) {
+    std::vector<int> results(files.size());
+
+    std::transform(files.cbegin(), files.cend(),
+        results.begin(),
+        count_lines_stdcount
+        );
+
+    return results;
+}
+
+#endif //ISTREAM_COUNT_H
@@ -0,0 +1,250 @@
+/* README:
+- line_count_cache: remembers the line count of every file it has seen, on
+  disk, so counting the same mostly unchanged directory again costs one
+  stat() per file instead of reading everything.
+
+[1] Identity of a file
+- An entry is keyed by (device, inode) and records size and mtime (ns) at
+  the time it was counted (both from one fstat() of the descriptor that was
+  counted), the number of '\n', the last byte, and a hash of 8 blocks of
+  4KB spread evenly over the counted bytes, the first and the last block
+  included (the whole file if it is below 32KB).
+- Same inode, size and mtime: unchanged, the cached count is returned
+  without opening the file.
+- Same inode, bigger size, and the 8 blocks of the old size still hash the
+  same: treated as appended to (log files). The whole file is mapped, but
+  only the new bytes are read and counted (mmap faults in just the pages
+  that are touched: the new bytes and the 8 blocks), and added to the
+  cached count.
+- Anything else (new inode, file got shorter, rewritten in place): the file
+  is counted from scratch.
+- A rewrite in place of a file that then grows is only caught if it
+  changes one of the 8 blocks: an edit that falls between them is taken
+  for an append, and the cached part of the count is stale until the file
+  is counted from scratch again. Sampling rather than hashing everything
+  is what keeps an append proportional to the appended bytes.
+- Files that cannot be mapped (pipes, empty files, /proc files, which
+  report a size of 0 whatever they hold) are counted with read() and never
+  cached; neither is a file whose size changed between being mapped
+  and the fstat() (it is being written to).
+
+[2] The cache file
+- Plain text, one entry per line, loaded by the constructor. save() writes
+  it to a temporary file and rename()s it over the old one, so a crash
+  never leaves a half written cache behind.
+- Entries of files not seen in this run are kept; an inode that gets reused
+  by another file fails the size/mtime/hash checks above.
+- A file rewritten with the same size within the mtime granularity of the
+  file system looks unchanged; this is the price of not reading it.
+
+[3] stats() tells how the files of the last calls were handled (unchanged,
+    appended, rescanned, failed) and how many bytes were actually scanned.
+*/
+
+#ifndef LINE_CACHE_H
+#define LINE_CACHE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "line_count.h"
+#include "mapped_file.h"
+
+class line_count_cache {
+public:
+    //[3]
+    struct stats_t {
+        std::size_t unchanged = 0;
+        std::size_t appended = 0;
+        std::size_t rescanned = 0;
+        std::size_t failed = 0;
+        std::size_t bytes_scanned = 0;
+    };
+
+    explicit line_count_cache(std::string cache_file) : m_cache_file(std::move(cache_file)) {
+        load();
+    }
+
+    //[1] -1 if the file cannot be opened
+    long count_lines(const std::string &file_name) {
+        struct stat st;
+        if (::stat(file_name.c_str(), &st) != 0) {
+            ++m_stats.failed;
+            return -1;
+        }
+
+        file_key key{static_cast<std::uint64_t>(st.st_dev), static_cast<std::uint64_t>(st.st_ino)};
+        std::uint64_t size = static_cast<std::uint64_t>(st.st_size);
+        std::int64_t mtime = std::int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+
+        auto it = m_entries.find(key);
+        if (it != m_entries.end() && it->second.size == size && it->second.mtime_ns == mtime) {
+            ++m_stats.unchanged;
+            return lines(it->second);
+        }
+        mapped_file file(file_name, false);
+        if (!file.is_open()) {
+            ++m_stats.failed;
+            return -1;
+        }
+        if (!file.is_mapped()) {
+            ++m_stats.rescanned;
+            return count_lines_read(file.fd());
+        }
+
+        //size and mtime of what is counted, not of the stat() above
+        if (::fstat(file.fd(), &st) != 0) {
+            ++m_stats.failed;
+            return -1;
+        }
+        mtime = std::int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        bool cacheable = static_cast<std::uint64_t>(st.st_size) == file.size()
+                         && key == file_key{static_cast<std::uint64_t>(st.st_dev), static_cast<std::uint64_t>(st.st_ino)};
+
+        entry e;
+        std::uint64_t from = 0;
+        if (cacheable && it != m_entries.end() && it->second.size > 0 && it->second.size < file.size()
+            && sample_hash(file.data(), it->second.size) == it->second.hash) {
+            e = it->second;
+            from = e.size;
+            ++m_stats.appended;
+        } else {
+            ++m_stats.rescanned;
+        }
+
+        e.newlines += static_cast<long>(count_byte(file.data() + from, file.size() - from, '\n'));
+        e.last = file.data()[file.size() - 1];
+        e.size = file.size();
+        e.mtime_ns = mtime;
+        e.hash = sample_hash(file.data(), e.size);
+        m_stats.bytes_scanned += file.size() - from;
+        if (cacheable) {
+            m_entries[key] = e;
+            m_dirty = true;
+        }
+
+        return lines(e);
+    }
+
+    //[2] false if the cache file could not be written
+    bool save() {
+        if (!m_dirty) {
+            return true;
+        }
+        std::string tmp = m_cache_file + ".tmp";
+        {
+            std::ofstream ofs(tmp, std::ios::trunc);
+            ofs << "line_count_cache 2\n";
+            for (const auto &kv: m_entries) {
+                const entry &e = kv.second;
+                ofs << kv.first.first << ' ' << kv.first.second << ' ' << e.size << ' '
+                    << e.mtime_ns << ' ' << e.newlines << ' ' << int(static_cast<unsigned char>(e.last))
+                    << ' ' << e.hash << '\n';
+            }
+            if (!ofs.flush()) {
+                std::remove(tmp.c_str());
+                return false;
+            }
+        }
+        if (std::rename(tmp.c_str(), m_cache_file.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        m_dirty = false;
+        return true;
+    }
+
+    const stats_t &stats() const {
+        return m_stats;
+    }
+
+    void reset_stats() {
+        m_stats = stats_t{};
+    }
+
+    std::size_t size() const {
+        return m_entries.size();
+    }
+
+private:
+    using file_key = std::pair<std::uint64_t, std::uint64_t>;     //(device, inode)
+
+    struct entry {
+        std::uint64_t size = 0;
+        std::int64_t mtime_ns = 0;
+        long newlines = 0;
+        char last = '\n';
+        std::uint64_t hash = 0;
+    };
+
+    static long lines(const entry &e) {
+        return e.size == 0 || e.last == '\n' ? e.newlines : e.newlines + 1;
+    }
+
+    //[1] FNV-1a over 8 blocks of (up to) 4KB spread over [0, end), first and last included
+    static std::uint64_t sample_hash(const char *data, std::uint64_t end) {
+        const std::uint64_t block = 4096, blocks = 8;
+        std::uint64_t h = 14695981039346656037ull;
+        if (end <= block * blocks) {
+            for (std::uint64_t i = 0; i < end; ++i) {
+                h = (h ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+            }
+            return h;
+        }
+        for (std::uint64_t b = 0; b < blocks; ++b) {
+            std::uint64_t begin = (end - block) * b / (blocks - 1);
+            for (std::uint64_t i = begin; i < begin + block; ++i) {
+                h = (h ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+            }
+        }
+        return h;
+    }
+
+    void load() {
+        std::ifstream ifs(m_cache_file);
+        std::string header;
+        if (!std::getline(ifs, header) || header != "line_count_cache 2") {
+            return;     //missing or from another version: start empty
+        }
+        std::string line;
+        while (std::getline(ifs, line)) {
+            std::istringstream iss(line);
+            file_key key;
+            entry e;
+            int last;
+            if (iss >> key.first >> key.second >> e.size >> e.mtime_ns >> e.newlines >> last >> e.hash) {
+                e.last = static_cast<char>(last);
+                m_entries[key] = e;
+            }
+        }
+    }
+
+    std::string m_cache_file;
+    std::map<file_key, entry> m_entries;
+    stats_t m_stats;
+    bool m_dirty = false;
+};
+
+inline std::vector<long>
+count_lines_in_files_cached(const std::vector<std::string> &files, line_count_cache &cache) {
+    std::vector<long> results;
+
+    for (const auto &file: files) {
+        results.push_back(cache.count_lines(file));
+    }
+    cache.save();
+
+    return results;
+}
+
+#endif //LINE_CACHE_H
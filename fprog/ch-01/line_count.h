@@ -0,0 +1,100 @@
+/* README:
+- count_lines_mmap(): count_lines of 01..03 on top of mapped_file and
+  count_byte() (mapped_file.h, simd_count.h) instead of an
+  istream_iterator<char>.
+
+[1] What is a line
+- Every '\n' ends a line, and a last line without '\n' counts too:
+  "" has 0 lines, "a" 1, "a\n" 1, "a\nb" 2. "\r\n" ends a line like "\n".
+- line_counter keeps the number of '\n' seen and the last byte, so the same
+  answer comes out whether the file is fed in one piece or in blocks.
+
+[2] count_lines_mmap(file)
+- maps the file and runs count_byte(data, size, '\n') over it; if the file
+  cannot be mapped (pipe, /proc, empty, see mapped_file.h) it reads it with
+  read() in 1MB blocks instead (count_lines_read()).
+- returns -1 if the file cannot be opened at all, instead of a count.
+- count_lines_read() returns -1 as well if read() fails half way (EIO,
+  EISDIR, ...), rather than the count of the bytes read up to then.
+*/
+
+#ifndef LINE_COUNT_H
+#define LINE_COUNT_H
+
+#include <cerrno>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "mapped_file.h"
+#include "simd_count.h"
+
+//[1]
+struct line_counter {
+    long newlines = 0;
+    char last = '\n';
+
+    void feed(const char *data, std::size_t size) {
+        if (size == 0) {
+            return;
+        }
+        newlines += static_cast<long>(count_byte(data, size, '\n'));
+        last = data[size - 1];
+    }
+
+    long lines() const {
+        return last == '\n' ? newlines : newlines + 1;
+    }
+};
+
+inline long count_lines_read(int fd) {
+    std::vector<char> buffer(1 << 20);
+    line_counter counter;
+
+    for (;;) {
+        ssize_t n = ::read(fd, buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        counter.feed(buffer.data(), static_cast<std::size_t>(n));
+    }
+
+    return counter.lines();
+}
+
+//[2]
+inline long count_lines_mmap(const std::string &file_name) {
+    mapped_file file(file_name);
+
+    if (!file.is_open()) {
+        return -1;
+    }
+    if (!file.is_mapped()) {
+        return count_lines_read(file.fd());
+    }
+
+    line_counter counter;
+    counter.feed(file.data(), file.size());
+    return counter.lines();
+}
+
+inline std::vector<long>
+count_lines_in_files_mmap(const std::vector<std::string> &files) {
+    std::vector<long> results;
+
+    for (const auto &file: files) {
+        results.push_back(count_lines_mmap(file));
+    }
+
+    return results;
+}
+
+#endif //LINE_COUNT_H
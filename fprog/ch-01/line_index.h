@@ -0,0 +1,326 @@
+/* README:
+- line_index: the byte offset of every K-th line of a file, so that line N
+  of a multi-GB log can be read without counting the N lines before it.
+- read_lines(file, from, to): lines [from, to) (0-based, without '\n'),
+  using the index next to the file, building it first if there is none.
+
+[1] Building, in parallel (see parallel_count.h for the chunking)
+- pass 1: the file is cut into chunks and every chunk counts its '\n'
+  with count_byte() (simd_count.h). A prefix sum over the counts gives
+  the number of the first line that starts in each chunk.
+- pass 2: every chunk walks its '\n' with memchr and records the start of
+  each line whose number is a multiple of K. The chunk lists are simply
+  concatenated, in order.
+- With K = 4096 the index costs 8 bytes per 4096 lines, a few hundred KB
+  for a GB of typical log lines.
+
+[2] Persisted next to the file as <file>.lidx: a small header (magic, K,
+    size and mtime of the file it was built from, number of lines) and the
+    offsets. open() uses it only if size and mtime still match and the
+    header and offsets are consistent (one offset per K lines, increasing,
+    inside the file; anything else is a stale or corrupt .lidx), otherwise
+    it rebuilds it and tries to save it again (written to a temporary file
+    and renamed, as in line_cache.h; a read-only directory just means the
+    index lives in memory only).
+
+[3] read_lines() starts at the checkpoint of line from / K, reads from there
+    with pread() in 64KB blocks, skips at most K - 1 lines and returns the
+    lines it was asked for. Lines are counted as in line_count.h: a last
+    line without '\n' is a line too.
+*/
+
+#ifndef LINE_INDEX_H
+#define LINE_INDEX_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../../multithreading/thread_pool.h"
+#include "mapped_file.h"
+#include "simd_count.h"
+
+class line_index {
+public:
+    static constexpr std::uint64_t default_every = 4096;
+
+    //[2] the index of file, loaded from <file>.lidx or built (and saved)
+    static line_index open(const std::string &file_name, thread_pool *pool = nullptr,
+                           std::uint64_t every = default_every) {
+        line_index index;
+        if (index.load(file_name, every)) {
+            return index;
+        }
+        index = build(file_name, pool, every);
+        if (index.is_valid()) {
+            index.save();
+        }
+        return index;
+    }
+
+    //[1] is_valid() is false if the file cannot be mapped
+    static line_index build(const std::string &file_name, thread_pool *pool = nullptr,
+                            std::uint64_t every = default_every,
+                            std::size_t chunk_size = std::size_t(64) << 20) {
+        line_index index;
+        index.m_file_name = file_name;
+        index.m_every = every ? every : 1;
+
+        auto file = std::make_shared<mapped_file>(file_name, pool == nullptr);
+        struct stat st;
+        if (!file->is_open() || ::fstat(file->fd(), &st) != 0 || !S_ISREG(st.st_mode)) {
+            return index;
+        }
+        index.m_size = file->size();
+        index.m_mtime_ns = mtime_ns(st);
+        index.m_valid = true;
+        index.m_offsets.push_back(0);
+        if (!file->is_mapped()) {
+            return index;   //empty file: no lines
+        }
+
+        std::vector<std::pair<std::size_t, std::size_t>> chunks;
+        for (std::size_t offset = 0; offset < file->size(); offset += chunk_size) {
+            chunks.emplace_back(offset, std::min(chunk_size, file->size() - offset));
+        }
+
+        //pass 1
+        std::vector<std::uint64_t> newlines(chunks.size());
+        for_each_chunk(pool, chunks.size(), [&](std::size_t i) {
+            file->prefetch(chunks[i].first, chunks[i].second);
+            newlines[i] = count_byte(file->data() + chunks[i].first, chunks[i].second, '\n');
+        });
+
+        //pass 2
+        std::vector<std::vector<std::uint64_t>> offsets(chunks.size());
+        std::uint64_t every_k = index.m_every;
+        std::uint64_t first_line = 0;   //number of the line after the chunk's first '\n'
+        std::vector<std::uint64_t> first_lines;
+        for (auto n: newlines) {
+            first_lines.push_back(first_line + 1);
+            first_line += n;
+        }
+        for_each_chunk(pool, chunks.size(), [&](std::size_t i) {
+            const char *begin = file->data() + chunks[i].first;
+            const char *end = begin + chunks[i].second;
+            const char *file_end = file->data() + file->size();
+            std::uint64_t line = first_lines[i];
+            for (const char *p = begin; p < end; ++line) {
+                p = static_cast<const char *>(std::memchr(p, '\n', end - p));
+                if (!p) {
+                    break;
+                }
+                ++p;    //start of line `line`
+                if (line % every_k == 0 && p < file_end) {
+                    offsets[i].push_back(static_cast<std::uint64_t>(p - file->data()));
+                }
+            }
+        });
+
+        for (const auto &list: offsets) {
+            index.m_offsets.insert(index.m_offsets.end(), list.begin(), list.end());
+        }
+        index.m_lines = first_line + (file->data()[file->size() - 1] != '\n');
+        return index;
+    }
+
+    bool is_valid() const {
+        return m_valid;
+    }
+
+    std::uint64_t lines() const {
+        return m_lines;
+    }
+
+    std::uint64_t every() const {
+        return m_every;
+    }
+
+    std::size_t checkpoints() const {
+        return m_offsets.size();
+    }
+
+    //[3]
+    std::vector<std::string> read_lines(std::uint64_t from, std::uint64_t to) const {
+        std::vector<std::string> result;
+        to = std::min(to, m_lines);
+        if (!m_valid || from >= to) {
+            return result;
+        }
+
+        int fd = ::open(m_file_name.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return result;
+        }
+
+        std::uint64_t line = from / m_every * m_every;
+        std::uint64_t offset = m_offsets[from / m_every];
+        std::vector<char> buffer(64 << 10);
+        std::string current;
+
+        while (line < to) {
+            ssize_t n = ::pread(fd, buffer.data(), buffer.size(), static_cast<off_t>(offset));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            offset += static_cast<std::uint64_t>(n);
+            const char *p = buffer.data();
+            const char *end = p + n;
+            while (p < end && line < to) {
+                const char *nl = static_cast<const char *>(std::memchr(p, '\n', end - p));
+                const char *stop = nl ? nl : end;
+                if (line >= from) {
+                    current.append(p, stop);
+                }
+                if (!nl) {
+                    break;
+                }
+                if (line >= from) {
+                    result.push_back(std::move(current));
+                    current.clear();
+                }
+                ++line;
+                p = nl + 1;
+            }
+        }
+        if (line < to && line >= from && !current.empty()) {
+            result.push_back(std::move(current));   //last line without '\n'
+        }
+
+        ::close(fd);
+        return result;
+    }
+
+    //[2]
+    bool save() const {
+        std::string path = m_file_name + ".lidx";
+        std::string tmp = path + ".tmp";
+        {
+            std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+            header h{};
+            std::memcpy(h.magic, magic, sizeof(h.magic));
+            h.every = m_every;
+            h.size = m_size;
+            h.mtime_ns = m_mtime_ns;
+            h.lines = m_lines;
+            h.count = m_offsets.size();
+            ofs.write(reinterpret_cast<const char *>(&h), sizeof(h));
+            ofs.write(reinterpret_cast<const char *>(m_offsets.data()),
+                      static_cast<std::streamsize>(m_offsets.size() * sizeof(std::uint64_t)));
+            if (!ofs.flush()) {
+                std::remove(tmp.c_str());
+                return false;
+            }
+        }
+        if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr char magic[8] = {'L', 'I', 'D', 'X', '0', '0', '0', '1'};
+
+    struct header {
+        char magic[8];
+        std::uint64_t every;
+        std::uint64_t size;
+        std::int64_t mtime_ns;
+        std::uint64_t lines;
+        std::uint64_t count;
+    };
+
+    static std::int64_t mtime_ns(const struct stat &st) {
+        return std::int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    }
+
+    template <typename F>
+    static void for_each_chunk(thread_pool *pool, std::size_t n, F f) {
+        if (!pool) {
+            for (std::size_t i = 0; i < n; ++i) {
+                f(i);
+            }
+            return;
+        }
+        std::vector<light_future<void>> done;
+        for (std::size_t i = 0; i < n; ++i) {
+            done.push_back(pool->spawn([&f, i]() { f(i); }));
+        }
+        for (auto &fu: done) {
+            fu.get();
+        }
+    }
+
+    //[2] what build() produces: 0 first, then increasing, all inside the file
+    static bool valid_offsets(const std::vector<std::uint64_t> &offsets, std::uint64_t size) {
+        if (offsets.empty() || offsets[0] != 0) {
+            return false;
+        }
+        for (std::size_t i = 1; i < offsets.size(); ++i) {
+            if (offsets[i] <= offsets[i - 1] || offsets[i] >= size) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool load(const std::string &file_name, std::uint64_t every) {
+        struct stat st;
+        if (::stat(file_name.c_str(), &st) != 0) {
+            return false;
+        }
+        std::ifstream ifs(file_name + ".lidx", std::ios::binary);
+        header h;
+        if (!ifs.read(reinterpret_cast<char *>(&h), sizeof(h))
+            || std::memcmp(h.magic, magic, sizeof(magic)) != 0 || h.every != every
+            || h.size != static_cast<std::uint64_t>(st.st_size) || h.mtime_ns != mtime_ns(st)
+            || h.every == 0 || h.lines > h.size
+            || h.count != std::max<std::uint64_t>(1, (h.lines + h.every - 1) / h.every)) {
+            return false;
+        }
+        m_offsets.resize(h.count);
+        if (!ifs.read(reinterpret_cast<char *>(m_offsets.data()),
+                      static_cast<std::streamsize>(h.count * sizeof(std::uint64_t)))
+            || !valid_offsets(m_offsets, h.size)) {
+            m_offsets.clear();
+            return false;
+        }
+        m_file_name = file_name;
+        m_every = h.every;
+        m_size = h.size;
+        m_mtime_ns = h.mtime_ns;
+        m_lines = h.lines;
+        m_valid = true;
+        return true;
+    }
+
+    std::string m_file_name;
+    std::uint64_t m_every = default_every;
+    std::uint64_t m_size = 0;
+    std::int64_t m_mtime_ns = 0;
+    std::uint64_t m_lines = 0;
+    std::vector<std::uint64_t> m_offsets;   //m_offsets[i]: start of line i * m_every
+    bool m_valid = false;
+};
+
+inline std::vector<std::string>
+read_lines(const std::string &file_name, std::uint64_t from, std::uint64_t to, thread_pool *pool = nullptr) {
+    return line_index::open(file_name, pool).read_lines(from, to);
+}
+
+#endif //LINE_INDEX_H
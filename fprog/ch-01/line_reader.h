@@ -0,0 +1,267 @@
+/* README:
+- line_reader: hands out the lines of a file (or of a buffer in memory) as
+  std::string_view, pointing straight into a mapping or a read buffer. No
+  std::string and no allocation per line.
+- trim_view(), count_words(): downstream stages that take a string_view
+  and return one, so a whole pipeline runs without copying a line.
+
+[1] Sources
+- line_reader(file): maps the file (see mapped_file.h); every line is a
+  view into the mapping and stays valid as long as the reader lives.
+- line_reader(file, buffer_size): reads the file with read() into a buffer
+  of buffer_size bytes instead (also used for files that cannot be mapped,
+  with 1MB). A view is valid only until the next call to next().
+- line_reader::of(text): the lines of a buffer that is already in memory.
+
+[2] Lines that straddle two reads: when the buffer holds no '\n' after the
+    current position, the unfinished line is moved to the front of the
+    buffer and the rest of the buffer is refilled; only the partial line is
+    copied, once per refill. A line longer than the whole buffer doubles
+    the buffer, so no line is ever cut in two.
+
+[3] A line is everything up to (not including) the next '\n'; a last line
+    without '\n' is a line too (as in line_count.h). A "\r\n" file gives
+    lines that end with '\r'; trim_view() removes it with the other white
+    space.
+
+[4] Iteration: while (reader.next(line)) {...}, or a range-for over the
+    reader (input iterators, one pass).
+
+[5] Errors: next() returns false both at the end of the file and when a
+    read() fails; error() tells them apart. After an error, the unfinished
+    line in the buffer is dropped rather than handed out cut short.
+*/
+
+#ifndef LINE_READER_H
+#define LINE_READER_H
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "mapped_file.h"
+
+class line_reader {
+public:
+    //[1]
+    explicit line_reader(const std::string &file_name, std::size_t buffer_size = 0) {
+        if (buffer_size == 0) {
+            m_file = mapped_file(file_name);
+            if (m_file.is_mapped()) {
+                m_data = m_file.data();
+                m_end = m_file.size();
+                return;
+            }
+            m_fd = m_file.fd();
+        } else {
+            m_fd = ::open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+            m_own_fd = m_fd >= 0;
+        }
+        m_buffer.resize(buffer_size ? buffer_size : std::size_t(1) << 20);
+        m_chunked = true;
+    }
+
+    line_reader(line_reader &&other) noexcept :
+        m_file(std::move(other.m_file)),
+        m_fd(std::exchange(other.m_fd, -1)),
+        m_own_fd(std::exchange(other.m_own_fd, false)),
+        m_buffer(std::move(other.m_buffer)),
+        m_data(other.m_data),
+        m_pos(other.m_pos),
+        m_end(other.m_end),
+        m_chunked(other.m_chunked),
+        m_eof(other.m_eof),
+        m_error(other.m_error) {}
+
+    line_reader(const line_reader &) = delete;
+    line_reader &operator=(const line_reader &) = delete;
+    line_reader &operator=(line_reader &&) = delete;
+
+    ~line_reader() {
+        if (m_own_fd) {
+            ::close(m_fd);
+        }
+    }
+
+    static line_reader of(std::string_view text) {
+        line_reader reader;
+        reader.m_data = text.data();
+        reader.m_end = text.size();
+        return reader;
+    }
+
+    bool is_open() const {
+        return m_data != nullptr || m_fd >= 0;
+    }
+
+    //[5] a read() failed: the lines handed out so far are not all of them
+    bool error() const {
+        return m_error;
+    }
+
+    //[3]
+    bool next(std::string_view &line) {
+        for (;;) {
+            const char *begin = m_data + m_pos;
+            const char *nl = m_end > m_pos
+                ? static_cast<const char *>(std::memchr(begin, '\n', m_end - m_pos)) : nullptr;
+            if (nl) {
+                line = std::string_view(begin, static_cast<std::size_t>(nl - begin));
+                m_pos = static_cast<std::size_t>(nl - m_data) + 1;
+                return true;
+            }
+            if (!m_chunked || m_eof) {
+                if (m_pos < m_end && !m_error) {
+                    line = std::string_view(begin, m_end - m_pos);
+                    m_pos = m_end;
+                    return true;
+                }
+                return false;
+            }
+            refill();
+        }
+    }
+
+    //[4]
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const std::string_view *;
+        using reference = const std::string_view &;
+
+        iterator() = default;
+
+        explicit iterator(line_reader *reader) : m_reader(reader) {
+            ++*this;
+        }
+
+        reference operator*() const {
+            return m_line;
+        }
+
+        pointer operator->() const {
+            return &m_line;
+        }
+
+        iterator &operator++() {
+            if (m_reader && !m_reader->next(m_line)) {
+                m_reader = nullptr;
+            }
+            return *this;
+        }
+
+        bool operator==(const iterator &other) const {
+            return m_reader == other.m_reader;
+        }
+
+        bool operator!=(const iterator &other) const {
+            return m_reader != other.m_reader;
+        }
+
+    private:
+        line_reader *m_reader = nullptr;
+        std::string_view m_line;
+    };
+
+    iterator begin() {
+        return iterator(this);
+    }
+
+    iterator end() {
+        return iterator();
+    }
+
+private:
+    line_reader() = default;
+
+    //[2]
+    void refill() {
+        std::size_t partial = m_end - m_pos;
+        if (m_pos > 0) {
+            std::memmove(m_buffer.data(), m_buffer.data() + m_pos, partial);
+        } else if (partial == m_buffer.size()) {
+            m_buffer.resize(m_buffer.size() * 2);
+        }
+        m_pos = 0;
+        m_end = partial;
+        m_data = m_buffer.data();
+
+        for (;;) {
+            ssize_t n = ::read(m_fd, m_buffer.data() + m_end, m_buffer.size() - m_end);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                m_eof = true;
+                m_error = n < 0;    //[5]
+            } else {
+                m_end += static_cast<std::size_t>(n);
+            }
+            return;
+        }
+    }
+
+    mapped_file m_file;
+    int m_fd = -1;              //chunked mode: m_file's or our own
+    bool m_own_fd = false;
+    std::vector<char> m_buffer;
+    const char *m_data = nullptr;
+    std::size_t m_pos = 0;
+    std::size_t m_end = 0;
+    bool m_chunked = false;
+    bool m_eof = false;
+    bool m_error = false;
+};
+
+inline bool is_white_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+//the view without leading and trailing white space (see ch-02/04_trim_ws.cpp)
+inline std::string_view trim_view(std::string_view s) {
+    std::size_t begin = 0;
+    while (begin < s.size() && is_white_space(s[begin])) {
+        ++begin;
+    }
+    std::size_t end = s.size();
+    while (end > begin && is_white_space(s[end - 1])) {
+        --end;
+    }
+    return s.substr(begin, end - begin);
+}
+
+//calls f(word) for every run of non white space in s
+template <typename F>
+void for_each_word(std::string_view s, F f) {
+    std::size_t i = 0;
+    while (i < s.size()) {
+        while (i < s.size() && is_white_space(s[i])) {
+            ++i;
+        }
+        std::size_t begin = i;
+        while (i < s.size() && !is_white_space(s[i])) {
+            ++i;
+        }
+        if (i > begin) {
+            f(s.substr(begin, i - begin));
+        }
+    }
+}
+
+inline std::size_t count_words(std::string_view s) {
+    std::size_t words = 0;
+    for_each_word(s, [&words](std::string_view) { ++words; });
+    return words;
+}
+
+#endif //LINE_READER_H
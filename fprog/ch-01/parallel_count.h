@@ -0,0 +1,135 @@
+/* README:
+- count_lines_in_files_parallel(files, pool): count_lines_in_files of 01..03
+  with the files spread over the workers of a thread_pool
+  (multithreading/thread_pool.h) instead of counted one after another.
+
+[1] Scheduling
+- Every file is stat()ed first and the files are handed to the pool largest
+  first (tasks posted from outside the pool are taken in FIFO order). A big
+  file that happens to be last in the list would otherwise start last and
+  keep one worker busy while all the others sit idle.
+- A file bigger than chunk_size is mapped once, without MAP_POPULATE (see
+  mapped_file.h), and cut into chunk_size pieces that are counted by
+  separate tasks, so one huge log keeps every worker busy. Its line count is
+  the sum of the '\n' in its chunks, plus one if its last byte is not '\n'.
+- Every other file is one task: count_lines_mmap() (see line_count.h) on a
+  worker.
+
+[2] count_report
+- lines: one count per file, in the order of files; -1 if the file could not
+  be opened.
+- bytes, seconds: bytes scanned and wall time of the whole call, for the
+  aggregate throughput (gb_per_second(), files_per_second()).
+*/
+
+#ifndef PARALLEL_COUNT_H
+#define PARALLEL_COUNT_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "../../multithreading/thread_pool.h"
+#include "line_count.h"
+
+//[2]
+struct count_report {
+    std::vector<long> lines;
+    std::size_t bytes = 0;
+    double seconds = 0;
+
+    double gb_per_second() const {
+        return seconds > 0 ? bytes / seconds / 1e9 : 0;
+    }
+
+    double files_per_second() const {
+        return seconds > 0 ? lines.size() / seconds : 0;
+    }
+};
+
+inline std::size_t file_size(const std::string &file_name) {
+    struct stat st;
+    if (::stat(file_name.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return 0;
+    }
+    return static_cast<std::size_t>(st.st_size);
+}
+
+//[1]
+inline count_report
+count_lines_in_files_parallel(const std::vector<std::string> &files, thread_pool &pool,
+                              std::size_t chunk_size = std::size_t(64) << 20) {
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::pair<std::size_t, std::size_t>> by_size;  //(size, index)
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        by_size.emplace_back(file_size(files[i]), i);
+    }
+    std::stable_sort(by_size.begin(), by_size.end(),
+                     [](const auto &a, const auto &b) { return a.first > b.first; });
+
+    struct whole_file {
+        std::size_t index;
+        std::size_t size;
+        light_future<long> lines;
+    };
+    struct chunked_file {
+        std::size_t index;
+        std::shared_ptr<mapped_file> file;
+        std::vector<light_future<long>> newlines;
+    };
+    std::vector<whole_file> whole;
+    std::vector<chunked_file> chunked;
+
+    for (const auto &entry: by_size) {
+        std::size_t size = entry.first;
+        std::size_t index = entry.second;
+
+        if (size > chunk_size) {
+            auto file = std::make_shared<mapped_file>(files[index], false);
+            if (file->is_mapped()) {
+                chunked_file c{index, file, {}};
+                for (std::size_t offset = 0; offset < file->size(); offset += chunk_size) {
+                    std::size_t length = std::min(chunk_size, file->size() - offset);
+                    c.newlines.push_back(pool.spawn([file, offset, length]() {
+                        file->prefetch(offset, length);
+                        return static_cast<long>(count_byte(file->data() + offset, length, '\n'));
+                    }));
+                }
+                chunked.push_back(std::move(c));
+                continue;
+            }
+        }
+        whole.push_back({index, size, pool.spawn(count_lines_mmap, files[index])});
+    }
+
+    count_report report;
+    report.lines.assign(files.size(), -1);
+
+    for (auto &c: chunked) {
+        long newlines = 0;
+        for (auto &fu: c.newlines) {
+            newlines += fu.get();
+        }
+        bool open_line = c.file->data()[c.file->size() - 1] != '\n';
+        report.lines[c.index] = newlines + open_line;
+        report.bytes += c.file->size();
+    }
+    for (auto &w: whole) {
+        report.lines[w.index] = w.lines.get();
+        if (report.lines[w.index] >= 0) {
+            report.bytes += w.size;
+        }
+    }
+
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return report;
+}
+
+#endif //PARALLEL_COUNT_H
@@ -0,0 +1,149 @@
+/* README:
+- count_byte(data, size, c): how many bytes in [data, data + size) are equal
+  to c. The kernel of the fast count_lines (see line_count.h).
+
+[1] Kernels
+- scalar: std::count over the buffer, one byte per step.
+- sse2 / avx2: compare 16 / 32 bytes at once against c (cmpeq gives 0xff
+  per matching byte), subtract the result from a vector of byte counters,
+  and every 255 steps (before a byte counter can overflow) add the byte
+  counters up with sad_epu8. No branch per match, no popcount per step.
+- avx512: compare 64 bytes at once into a 64-bit mask and popcount it.
+
+[2] Dispatch
+- The kernels are compiled with __attribute__((target(...))), so this
+  header needs no -mavx2 and the binary still runs on machines without
+  AVX2. count_byte() asks the CPU once (__builtin_cpu_supports) and keeps
+  a pointer to the widest kernel it supports.
+- count_byte_kernels() lists every kernel with a flag saying whether this
+  CPU can run it, for benchmarks and tests.
+*/
+
+#ifndef SIMD_COUNT_H
+#define SIMD_COUNT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_COUNT_X86 1
+#endif
+
+using count_byte_fn = std::size_t (*)(const char *, std::size_t, char);
+
+struct count_byte_kernel {
+    const char *name;
+    count_byte_fn fn;
+    bool supported;
+};
+
+namespace simd_detail {
+
+inline std::size_t count_byte_scalar(const char *p, std::size_t n, char c) {
+    return static_cast<std::size_t>(std::count(p, p + n, c));
+}
+
+#ifdef SIMD_COUNT_X86
+
+__attribute__((target("sse2")))
+inline std::size_t count_byte_sse2(const char *p, std::size_t n, char c) {
+    const __m128i needle = _mm_set1_epi8(c);
+    const __m128i zero = _mm_setzero_si128();
+    std::size_t count = 0;
+    std::size_t i = 0;
+
+    while (n - i >= 16) {
+        std::size_t steps = std::min<std::size_t>((n - i) / 16, 255);
+        __m128i acc = zero;
+        for (std::size_t s = 0; s < steps; ++s, i += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+            acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(v, needle));
+        }
+        __m128i sums = _mm_sad_epu8(acc, zero);
+        count += static_cast<std::size_t>(_mm_cvtsi128_si32(sums))
+               + static_cast<std::size_t>(_mm_cvtsi128_si32(_mm_unpackhi_epi64(sums, sums)));
+    }
+
+    return count + count_byte_scalar(p + i, n - i, c);
+}
+
+__attribute__((target("avx2")))
+inline std::size_t count_byte_avx2(const char *p, std::size_t n, char c) {
+    const __m256i needle = _mm256_set1_epi8(c);
+    const __m256i zero = _mm256_setzero_si256();
+    std::size_t count = 0;
+    std::size_t i = 0;
+
+    while (n - i >= 32) {
+        std::size_t steps = std::min<std::size_t>((n - i) / 32, 255);
+        __m256i acc = zero;
+        for (std::size_t s = 0; s < steps; ++s, i += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+            acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(v, needle));
+        }
+        __m256i sums = _mm256_sad_epu8(acc, zero);
+        __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+        count += static_cast<std::size_t>(_mm_cvtsi128_si32(half))
+               + static_cast<std::size_t>(_mm_cvtsi128_si32(_mm_unpackhi_epi64(half, half)));
+    }
+
+    return count + count_byte_sse2(p + i, n - i, c);
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt")))
+inline std::size_t count_byte_avx512(const char *p, std::size_t n, char c) {
+    const __m512i needle = _mm512_set1_epi8(c);
+    std::size_t count = 0;
+    std::size_t i = 0;
+
+    for (; n - i >= 64; i += 64) {
+        __m512i v = _mm512_loadu_si512(p + i);
+        count += static_cast<std::size_t>(_mm_popcnt_u64(_mm512_cmpeq_epi8_mask(v, needle)));
+    }
+
+    return count + count_byte_avx2(p + i, n - i, c);
+}
+
+#endif //SIMD_COUNT_X86
+
+inline std::vector<count_byte_kernel> kernels() {
+    std::vector<count_byte_kernel> list{{"scalar", count_byte_scalar, true}};
+#ifdef SIMD_COUNT_X86
+    __builtin_cpu_init();
+    list.push_back({"sse2", count_byte_sse2, __builtin_cpu_supports("sse2") != 0});
+    list.push_back({"avx2", count_byte_avx2, __builtin_cpu_supports("avx2") != 0});
+    list.push_back({"avx512", count_byte_avx512,
+                    __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("popcnt")});
+#endif
+    return list;
+}
+
+//[2] the widest supported kernel (kernels() is ordered narrow to wide)
+inline const count_byte_kernel &best_kernel() {
+    static const count_byte_kernel best = []() {
+        auto list = kernels();
+        auto it = std::find_if(list.rbegin(), list.rend(),
+                               [](const count_byte_kernel &k) { return k.supported; });
+        return *it;
+    }();
+    return best;
+}
+
+} //namespace simd_detail
+
+inline std::vector<count_byte_kernel> count_byte_kernels() {
+    return simd_detail::kernels();
+}
+
+inline const char *count_byte_kernel_name() {
+    return simd_detail::best_kernel().name;
+}
+
+inline std::size_t count_byte(const char *data, std::size_t size, char c) {
+    return simd_detail::best_kernel().fn(data, size, c);
+}
+
+#endif //SIMD_COUNT_H
@@ -0,0 +1,311 @@
+/* README:
+- wc_scanner: one pass over a buffer or file that counts, at the same time,
+  newlines, words, bytes, and the bytes of any number of byte classes
+  (delimiter sets) - a fused `wc` plus a byte-class histogram. Built on the
+  same pieces as count_lines_mmap() (mapped_file.h, line_count.h).
+
+[1] byte_set: any set of the 256 byte values. Membership of 32 bytes at
+    once (AVX2) is two table lookups with vpshufb:
+    - the low nibble of every byte picks a row from one of two 16-byte
+      tables (one for bytes < 0x80, one for bytes >= 0x80, chosen with
+      vpblendvb on the top bit); a row has bit (high nibble & 7) set for
+      every member with that low nibble.
+    - the high nibble picks 1 << (high nibble & 7); the byte is a member if
+      row & bit != 0.
+    This is exact for every set, not only for ASCII ones.
+
+[2] Words are counted like wc: a word starts at a byte that is not white
+    space (" \t\n\v\f\r") and follows white space or the start of the
+    input. Per 32 bytes: ws = white space mask, starts = ~ws & (ws << 1 |
+    carry from the previous block), count = popcount(starts).
+    A chunk that does not start the input passes the byte before it
+    (prev_space), so chunks can be scanned independently and their counts
+    simply added.
+
+[3] scan_file(file, pool, chunk_size): maps the file and, with a pool,
+    scans chunk_size pieces on the pool's workers (see parallel_count.h
+    for the same idea applied to count_lines). Without a pool, or for a
+    file that cannot be mapped, it scans on the calling thread (read() in
+    1MB blocks for the latter). *ok tells whether the counts are those of
+    the whole file: it is false if the file cannot be opened or a read()
+    fails, and the counts are then those of an empty file, not a short
+    count.
+
+[4] The AVX2 kernel is picked at run time like count_byte() in
+    simd_count.h; the scalar kernel (one table lookup per byte and class)
+    is the fallback and the reference.
+*/
+
+#ifndef WC_SCAN_H
+#define WC_SCAN_H
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../../multithreading/thread_pool.h"
+#include "mapped_file.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WC_SCAN_X86 1
+#endif
+
+//[1]
+class byte_set {
+public:
+    byte_set() = default;
+
+    explicit byte_set(const std::string &bytes) {
+        for (char c: bytes) {
+            add(c);
+        }
+    }
+
+    static byte_set white_space() {
+        return byte_set(" \t\n\v\f\r");
+    }
+
+    void add(char c) {
+        unsigned char b = static_cast<unsigned char>(c);
+        m_member[b] = true;
+        std::uint8_t bit = static_cast<std::uint8_t>(1u << ((b >> 4) & 7));
+        (b < 0x80 ? m_low_table : m_high_table)[b & 15] |= bit;
+    }
+
+    bool contains(char c) const {
+        return m_member[static_cast<unsigned char>(c)];
+    }
+
+    const std::uint8_t *low_table() const {
+        return m_low_table.data();
+    }
+
+    const std::uint8_t *high_table() const {
+        return m_high_table.data();
+    }
+
+private:
+    std::array<bool, 256> m_member{};
+    std::array<std::uint8_t, 16> m_low_table{};     //rows for bytes < 0x80
+    std::array<std::uint8_t, 16> m_high_table{};    //rows for bytes >= 0x80
+};
+
+struct wc_counts {
+    std::uint64_t newlines = 0;
+    std::uint64_t words = 0;
+    std::uint64_t bytes = 0;
+    std::vector<std::uint64_t> classes;     //one count per byte_set of the scanner
+    char last = '\n';
+
+    //as line_counter in line_count.h: a last line without '\n' counts too
+    std::uint64_t lines() const {
+        return last == '\n' ? newlines : newlines + 1;
+    }
+
+    //appends the counts of the input that comes right after this one
+    wc_counts &operator+=(const wc_counts &next) {
+        newlines += next.newlines;
+        words += next.words;
+        if (classes.size() < next.classes.size()) {
+            classes.resize(next.classes.size());
+        }
+        for (std::size_t i = 0; i < next.classes.size(); ++i) {
+            classes[i] += next.classes[i];
+        }
+        if (next.bytes) {
+            last = next.last;
+        }
+        bytes += next.bytes;
+        return *this;
+    }
+};
+
+namespace wc_detail {
+
+inline void scan_scalar(const byte_set *sets, std::size_t nsets, const char *p, std::size_t n,
+                        bool prev_space, wc_counts &counts) {
+    static const byte_set space = byte_set::white_space();
+
+    for (std::size_t i = 0; i < n; ++i) {
+        char c = p[i];
+        bool is_space = space.contains(c);
+        counts.newlines += c == '\n';
+        counts.words += !is_space && prev_space;
+        prev_space = is_space;
+        for (std::size_t k = 0; k < nsets; ++k) {
+            counts.classes[k] += sets[k].contains(c);
+        }
+    }
+}
+
+#ifdef WC_SCAN_X86
+
+struct avx2_set {
+    __m256i low, high;
+};
+
+__attribute__((target("avx2")))
+inline avx2_set load_set(const byte_set &set) {
+    __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i *>(set.low_table()));
+    __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i *>(set.high_table()));
+    return {_mm256_broadcastsi128_si256(low), _mm256_broadcastsi128_si256(high)};
+}
+
+//[1] bit i set if byte i of v is in the set
+__attribute__((target("avx2")))
+inline std::uint32_t members(const avx2_set &set, __m256i lo, __m256i bit, __m256i v) {
+    __m256i row = _mm256_blendv_epi8(_mm256_shuffle_epi8(set.low, lo),
+                                     _mm256_shuffle_epi8(set.high, lo), v);
+    __m256i miss = _mm256_cmpeq_epi8(_mm256_and_si256(row, bit), _mm256_setzero_si256());
+    return ~static_cast<std::uint32_t>(_mm256_movemask_epi8(miss));
+}
+
+__attribute__((target("avx2,popcnt")))
+inline void scan_avx2(const byte_set *sets, std::size_t nsets, const char *p, std::size_t n,
+                      bool prev_space, wc_counts &counts) {
+    static const byte_set space_set = byte_set::white_space();
+    const avx2_set space = load_set(space_set);
+
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i bits = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+                                          1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    std::uint64_t carry = prev_space ? 1 : 0;
+    std::size_t i = 0;
+
+    for (; n - i >= 32; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+        __m256i lo = _mm256_and_si256(v, nibble);
+        __m256i bit = _mm256_shuffle_epi8(bits, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+
+        std::uint32_t nl = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline)));
+        counts.newlines += static_cast<std::uint64_t>(_mm_popcnt_u32(nl));
+
+        //[2]
+        std::uint64_t ws = members(space, lo, bit, v);
+        std::uint64_t starts = ~ws & ((ws << 1) | carry) & 0xffffffffu;
+        counts.words += static_cast<std::uint64_t>(_mm_popcnt_u64(starts));
+        carry = ws >> 31;
+
+        for (std::size_t k = 0; k < nsets; ++k) {
+            counts.classes[k] += static_cast<std::uint64_t>(_mm_popcnt_u32(members(load_set(sets[k]), lo, bit, v)));
+        }
+    }
+
+    scan_scalar(sets, nsets, p + i, n - i, carry != 0, counts);
+}
+
+#endif //WC_SCAN_X86
+
+using scan_fn = void (*)(const byte_set *, std::size_t, const char *, std::size_t, bool, wc_counts &);
+
+//[4]
+inline scan_fn best_scan() {
+#ifdef WC_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        return scan_avx2;
+    }
+#endif
+    return scan_scalar;
+}
+
+} //namespace wc_detail
+
+class wc_scanner {
+public:
+    explicit wc_scanner(std::vector<byte_set> classes = {}, bool vectorized = true) :
+        m_classes(std::move(classes)),
+        m_scan(vectorized ? wc_detail::best_scan() : wc_detail::scan_scalar) {}
+
+    bool is_vectorized() const {
+        return m_scan != wc_detail::scan_scalar;
+    }
+
+    //[2] prev_space: the byte before data is white space (or there is none)
+    wc_counts scan(const char *data, std::size_t size, bool prev_space = true) const {
+        wc_counts counts;
+        counts.classes.assign(m_classes.size(), 0);
+        if (size == 0) {
+            return counts;
+        }
+        m_scan(m_classes.data(), m_classes.size(), data, size, prev_space, counts);
+        counts.bytes = size;
+        counts.last = data[size - 1];
+        return counts;
+    }
+
+    //[3] bytes is 0 and last is '\n' if the file cannot be opened or read; see ok
+    wc_counts scan_file(const std::string &file_name, thread_pool *pool = nullptr,
+                        std::size_t chunk_size = std::size_t(16) << 20, bool *ok = nullptr) const {
+        auto file = std::make_shared<mapped_file>(file_name, pool == nullptr);
+        if (ok) {
+            *ok = file->is_open();
+        }
+        if (!file->is_open()) {
+            return scan(nullptr, 0);
+        }
+        if (!file->is_mapped()) {
+            wc_counts counts;
+            if (!scan_fd(file->fd(), counts)) {
+                if (ok) {
+                    *ok = false;
+                }
+                return scan(nullptr, 0);
+            }
+            return counts;
+        }
+        if (!pool || file->size() <= chunk_size) {
+            return scan(file->data(), file->size());
+        }
+
+        std::vector<light_future<wc_counts>> chunks;
+        for (std::size_t offset = 0; offset < file->size(); offset += chunk_size) {
+            std::size_t length = std::min(chunk_size, file->size() - offset);
+            chunks.push_back(pool->spawn([this, file, offset, length]() {
+                file->prefetch(offset, length);
+                bool prev_space = offset == 0 || byte_set::white_space().contains(file->data()[offset - 1]);
+                return scan(file->data() + offset, length, prev_space);
+            }));
+        }
+        wc_counts total = scan(nullptr, 0);
+        for (auto &fu: chunks) {
+            total += fu.get();
+        }
+        return total;
+    }
+
+private:
+    //false on a read() error
+    bool scan_fd(int fd, wc_counts &total) const {
+        static const byte_set space = byte_set::white_space();
+        std::vector<char> buffer(1 << 20);
+        total = scan(nullptr, 0);
+
+        for (;;) {
+            ssize_t n = ::read(fd, buffer.data(), buffer.size());
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                return false;
+            }
+            if (n == 0) {
+                return true;
+            }
+            total += scan(buffer.data(), static_cast<std::size_t>(n), space.contains(total.last));
+        }
+    }
+
+    std::vector<byte_set> m_classes;
+    wc_detail::scan_fn m_scan;
+};
+
+#endif //WC_SCAN_H
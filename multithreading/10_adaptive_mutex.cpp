@@ -0,0 +1,144 @@
+/*README:
+ * We will learn about:
+ * - Spin-then-park locking: adaptive_mutex (see adaptive_mutex.h)
+ * - Writing our own Lockable type that works with lock_guard<> and std::lock()
+ *
+ * [1] The critical section in Logger::log() (see 2_lock_guard.cpp) is tiny:
+ *     append a string to a stream. When std::mutex is contended, the waiting
+ *     thread usually goes to sleep in the kernel (futex) right away, even
+ *     though the owner would have released the lock a few hundred
+ *     nanoseconds later. Sleeping and waking up costs microseconds.
+ * [2] adaptive_mutex spins for a short while (with `pause` and exponential
+ *     backoff) hoping that the lock is released soon, and only then parks the
+ *     thread on a futex.
+ * [3] adaptive_mutex provides lock(), try_lock() and unlock(), so:
+ *       lock_guard<adaptive_mutex> locker(mu);
+ *       std::lock(mu1, mu2);
+ *     work exactly as with std::mutex.
+ * [4] benchmark(): N threads increment a shared counter inside a tiny
+ *     critical section, with std::mutex and with adaptive_mutex.
+ *     Spinning helps only when the lock owner is running on another core;
+ *     on a single core machine the spin phase is wasted and both locks
+ *     behave about the same.
+ *
+ * COMPILE:
+ * g++ -O2 10_adaptive_mutex.cpp -o 10_adaptive_mutex -lpthread
+ * */
+
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <chrono>
+#include "adaptive_mutex.h"
+
+using namespace std;
+
+#define MAX_LOOP 10
+
+/* Logger from 2_lock_guard.cpp, with adaptive_mutex instead of mutex */
+class Logger
+{
+private:
+    ostringstream oss;
+    adaptive_mutex mu;
+public:
+    void log(string msg) {
+        lock_guard<adaptive_mutex> locker(mu); //[3]
+        oss << msg;
+    }
+
+    string str() {
+        lock_guard<adaptive_mutex> locker(mu);
+        return oss.str();
+    }
+};
+
+void thread1(Logger& logger)
+{
+    for (int i=0; i<MAX_LOOP; i++) {
+        logger.log("thread1: " + to_string(i) + "\n");
+    }
+}
+
+void thread2(Logger& logger)
+{
+    for (int i=0; i>-MAX_LOOP; i--) {
+        logger.log("thread2: " + to_string(i) + "\n");
+    }
+}
+
+/* [3] std::lock() with two adaptive_mutex objects, deadlock free */
+void transfer(adaptive_mutex& mu1, adaptive_mutex& mu2, int& from, int& to,
+              int amount)
+{
+    std::lock(mu1, mu2);
+    lock_guard<adaptive_mutex> locker1(mu1, std::adopt_lock);
+    lock_guard<adaptive_mutex> locker2(mu2, std::adopt_lock);
+    from -= amount;
+    to += amount;
+}
+
+template <typename Mutex>
+double run_contention(int nthreads, long ops_per_thread)
+{
+    Mutex mu;
+    long counter = 0;
+    vector<thread> threads;
+
+    auto start = chrono::steady_clock::now();
+    for (int t = 0; t < nthreads; t++) {
+        threads.emplace_back([&]() {
+            for (long i = 0; i < ops_per_thread; i++) {
+                lock_guard<Mutex> locker(mu);
+                counter++;
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    auto end = chrono::steady_clock::now();
+
+    if (counter != nthreads * ops_per_thread) {
+        cout << "ERROR: counter mismatch " << counter << endl;
+    }
+    double ns = chrono::duration<double, nano>(end - start).count();
+    return ns / (nthreads * ops_per_thread);
+}
+
+void benchmark()
+{
+    const long ops = 1000000;
+    cout << "threads  std::mutex(ns/op)  adaptive_mutex(ns/op)" << endl;
+    for (int n : {1, 2, 4, 8, 16}) {
+        double a = run_contention<std::mutex>(n, ops / n);
+        double b = run_contention<adaptive_mutex>(n, ops / n);
+        cout << n << "\t " << a << "\t\t    " << b << endl;
+    }
+}
+
+int main()
+{
+    Logger logger;
+    std::thread t1(thread1, std::ref(logger));
+    std::thread t2(thread2, std::ref(logger));
+    t1.join();
+    t2.join();
+    cout << logger.str();
+
+    adaptive_mutex mu1, mu2;
+    int a = 100, b = 100;
+    std::thread t3(transfer, std::ref(mu1), std::ref(mu2), std::ref(a), std::ref(b), 10);
+    std::thread t4(transfer, std::ref(mu2), std::ref(mu1), std::ref(b), std::ref(a), 30);
+    t3.join();
+    t4.join();
+    cout << "a: " << a << " b: " << b << endl;
+
+    benchmark();
+
+    cout << "main() done" << endl;
+    return 0;
+}
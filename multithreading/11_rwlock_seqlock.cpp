@@ -0,0 +1,253 @@
+/*README:
+ * We will learn about:
+ * - Read-mostly shared state
+ * - distributed_rwlock (see distributed_rwlock.h) with shared_lock<>
+ * - seqlock<T> (see seqlock.h) for small POD snapshots
+ *
+ * [1] In 2_lock_guard.cpp every access to the Logger takes the exclusive
+ *     mutex mu. But a real logger mostly *reads* its state: every log() call
+ *     checks the configured level and most debug messages are dropped. Only
+ *     set_level() writes.
+ *     -> The level table is protected by a distributed_rwlock. log() takes
+ *        shared_lock<distributed_rwlock>, set_level() takes
+ *        lock_guard<distributed_rwlock>.
+ * [2] Monitoring threads want to read the logger statistics (messages
+ *     written, messages dropped, bytes written) often.
+ *     -> The stats are a small POD published through seqlock<log_stats>.
+ *        A reader gets a consistent snapshot without writing to any shared
+ *        cache line.
+ * [3] The output stream itself is still written under an exclusive mutex,
+ *     since writing is not a read-only operation.
+ * [4] benchmark(): mutex vs std::shared_mutex vs distributed_rwlock on a
+ *     read-mostly workload, and mutex vs seqlock for snapshot reads.
+ *
+ * COMPILE:
+ * g++ -O2 11_rwlock_seqlock.cpp -o 11_rwlock_seqlock -lpthread
+ * */
+
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <chrono>
+#include "distributed_rwlock.h"
+#include "seqlock.h"
+
+using namespace std;
+
+#define MAX_LOOP 10
+
+enum log_level { debug = 0, info = 1, error = 2 };
+
+struct log_stats {
+    uint64_t written;
+    uint64_t dropped;
+    uint64_t bytes;
+};
+
+class Logger
+{
+private:
+    ostringstream oss;
+    mutex mu;                       //[3]
+
+    log_level levels[2] = {info, info};  //per-thread-group level
+    distributed_rwlock level_mu;    //[1]
+
+    seqlock<log_stats> stats;       //[2]
+
+public:
+    void set_level(int group, log_level lvl) {
+        lock_guard<distributed_rwlock> locker(level_mu);
+        levels[group] = lvl;
+    }
+
+    void log(int group, log_level lvl, const string& msg) {
+        bool enabled;
+        {
+            shared_lock<distributed_rwlock> locker(level_mu);
+            enabled = lvl >= levels[group];
+        }
+
+        if (!enabled) {
+            stats.update([](log_stats& s) { s.dropped++; });
+            return;
+        }
+
+        {
+            lock_guard<mutex> locker(mu);
+            oss << msg;
+        }
+        stats.update([&](log_stats& s) { s.written++; s.bytes += msg.size(); });
+    }
+
+    log_stats snapshot() const {
+        return stats.load();
+    }
+
+    string str() {
+        lock_guard<mutex> locker(mu);
+        return oss.str();
+    }
+};
+
+void thread1(Logger& logger)
+{
+    for (int i=0; i<MAX_LOOP; i++) {
+        logger.log(0, (i % 2) ? debug : info, "thread1: " + to_string(i) + "\n");
+    }
+}
+
+void thread2(Logger& logger)
+{
+    for (int i=0; i>-MAX_LOOP; i--) {
+        logger.log(1, (i % 2) ? debug : info, "thread2: " + to_string(i) + "\n");
+        if (i == -4) {
+            logger.set_level(1, debug); //from now on thread2 logs debug too
+        }
+    }
+}
+
+/******** benchmark ************/
+template <typename Lock, typename ReadGuard, typename WriteGuard>
+double run_read_mostly(int nthreads, long ops_per_thread, int write_every)
+{
+    Lock mu;
+    long shared_value = 0;
+    vector<thread> threads;
+
+    auto start = chrono::steady_clock::now();
+    for (int t = 0; t < nthreads; t++) {
+        threads.emplace_back([&]() {
+            long sink = 0;
+            for (long i = 0; i < ops_per_thread; i++) {
+                if (i % write_every == 0) {
+                    WriteGuard locker(mu);
+                    shared_value++;
+                } else {
+                    ReadGuard locker(mu);
+                    sink += shared_value;
+                }
+            }
+            volatile long keep = sink;
+            (void)keep;
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    auto end = chrono::steady_clock::now();
+    return chrono::duration<double, nano>(end - start).count() / (nthreads * ops_per_thread);
+}
+
+struct snapshot_t {
+    uint64_t a, b, c;
+};
+
+double run_snapshot_mutex(int nthreads, long ops)
+{
+    mutex mu;
+    snapshot_t snap{0, 0, 0};
+    vector<thread> threads;
+    auto start = chrono::steady_clock::now();
+    for (int t = 0; t < nthreads; t++) {
+        threads.emplace_back([&, t]() {
+            uint64_t sink = 0;
+            for (long i = 0; i < ops; i++) {
+                lock_guard<mutex> locker(mu);
+                if (t == 0 && i % 1000 == 0) {
+                    snap.a++; snap.b++; snap.c++;
+                } else {
+                    sink += snap.a + snap.b + snap.c;
+                }
+            }
+            volatile uint64_t keep = sink;
+            (void)keep;
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    auto end = chrono::steady_clock::now();
+    return chrono::duration<double, nano>(end - start).count() / (nthreads * ops);
+}
+
+double run_snapshot_seqlock(int nthreads, long ops)
+{
+    seqlock<snapshot_t> snap;
+    vector<thread> threads;
+    atomic<bool> torn{false};
+    auto start = chrono::steady_clock::now();
+    for (int t = 0; t < nthreads; t++) {
+        threads.emplace_back([&, t]() {
+            uint64_t sink = 0;
+            for (long i = 0; i < ops; i++) {
+                if (t == 0 && i % 1000 == 0) {
+                    snap.update([](snapshot_t& s) { s.a++; s.b++; s.c++; });
+                } else {
+                    snapshot_t s = snap.load();
+                    if (s.a != s.b || s.b != s.c) {
+                        torn.store(true, memory_order_relaxed);
+                    }
+                    sink += s.a;
+                }
+            }
+            volatile uint64_t keep = sink;
+            (void)keep;
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    auto end = chrono::steady_clock::now();
+    if (torn) {
+        cout << "ERROR: torn snapshot" << endl;
+    }
+    return chrono::duration<double, nano>(end - start).count() / (nthreads * ops);
+}
+
+void benchmark()
+{
+    const long ops = 1000000;
+    const int write_every = 1000;
+
+    cout << "read-mostly (1 write per " << write_every << " ops), ns/op" << endl;
+    cout << "threads  mutex   shared_mutex  distributed_rwlock" << endl;
+    for (int n : {1, 2, 4, 8}) {
+        double a = run_read_mostly<mutex, lock_guard<mutex>, lock_guard<mutex>>(n, ops / n, write_every);
+        double b = run_read_mostly<shared_mutex, shared_lock<shared_mutex>, lock_guard<shared_mutex>>(n, ops / n, write_every);
+        double c = run_read_mostly<distributed_rwlock, shared_lock<distributed_rwlock>, lock_guard<distributed_rwlock>>(n, ops / n, write_every);
+        cout << n << "\t " << a << "\t " << b << "\t" << c << endl;
+    }
+
+    cout << "snapshot reads, ns/op" << endl;
+    cout << "threads  mutex   seqlock" << endl;
+    for (int n : {1, 2, 4, 8}) {
+        double a = run_snapshot_mutex(n, ops / n);
+        double b = run_snapshot_seqlock(n, ops / n);
+        cout << n << "\t " << a << "\t " << b << endl;
+    }
+}
+
+int main()
+{
+    Logger logger;
+    std::thread t1(thread1, std::ref(logger));
+    std::thread t2(thread2, std::ref(logger));
+    t1.join();
+    t2.join();
+    cout << logger.str();
+
+    log_stats s = logger.snapshot();
+    cout << "written: " << s.written << " dropped: " << s.dropped
+         << " bytes: " << s.bytes << endl;
+
+    benchmark();
+
+    cout << "main() done" << endl;
+    return 0;
+}
@@ -0,0 +1,151 @@
+/*README:
+ * We will learn about:
+ * - Lock-free bounded MPMC queue: mpmc_queue<T> (see mpmc_queue.h)
+ * - Comparing it with the deque + mutex + condition_variable pattern of
+ *   7_condition_variable.cpp (see blocking_queue.h)
+ *
+ * [1] In 7_condition_variable.cpp and 9_packaged_task.cpp every producer and
+ *     every consumer takes the same mutex mu, so they run one at a time, and
+ *     each push() calls cond.notify_one() which may end up in a futex
+ *     syscall.
+ * [2] mpmc_queue claims slots with a CAS on a position counter, so producers
+ *     and consumers proceed in parallel, and it only touches the futex when a
+ *     consumer is actually sleeping on an empty queue (or a producer on a
+ *     full queue).
+ * [3] producer3() -> consumer3() below is the same example as in
+ *     7_condition_variable.cpp, written with mpmc_queue.
+ * [4] benchmark():
+ *     - throughput: P producers and C consumers pass N integers.
+ *     - latency: two threads ping-pong one integer through two queues; half
+ *       the round trip time is the one-way latency.
+ *     On a machine with a single core every hand-off is a context switch, so
+ *     the latency numbers there mostly measure the scheduler; the spin phase
+ *     of mpmc_queue only pays off when both threads have their own core.
+ *
+ * COMPILE:
+ * g++ -O2 12_mpmc_queue.cpp -o 12_mpmc_queue -lpthread
+ * */
+
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include "mpmc_queue.h"
+#include "blocking_queue.h"
+
+using namespace std;
+
+mpmc_queue<int> q(1024);
+
+/******** producer3() -> consumer3() ************/
+void producer3()
+{
+    int i = 10;
+    while (i) {
+        q.push(i);
+        this_thread::sleep_for(chrono::milliseconds(10));
+        i--;
+    }
+}
+
+void consumer3()
+{
+    int data = 0;
+    while (data != 1) {
+        data = q.pop(); //sleeps on the futex while the queue is empty
+        cout << "consumed: " << data << endl;
+    }
+}
+
+/******** benchmark ************/
+template <typename Queue>
+double run_throughput(Queue& queue, int producers, int consumers, long items)
+{
+    vector<thread> threads;
+    atomic<long> sum{0};
+    long per_producer = items / producers;
+    long total = per_producer * producers;
+
+    auto start = chrono::steady_clock::now();
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&]() {
+            for (long i = 1; i <= per_producer; i++) {
+                queue.push(1);
+            }
+        });
+    }
+    for (int c = 0; c < consumers; c++) {
+        //consumer c takes its share of the items, the last one the remainder
+        long share = total / consumers + (c == consumers - 1 ? total % consumers : 0);
+        threads.emplace_back([&, share]() {
+            long local = 0;
+            for (long i = 0; i < share; i++) {
+                local += queue.pop();
+            }
+            sum += local;
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    auto end = chrono::steady_clock::now();
+
+    if (sum != total) {
+        cout << "ERROR: lost items " << sum << " != " << total << endl;
+    }
+    double sec = chrono::duration<double>(end - start).count();
+    return total / sec / 1e6;
+}
+
+template <typename Queue>
+double run_latency(Queue& ping, Queue& pong, long rounds)
+{
+    thread echo([&]() {
+        for (long i = 0; i < rounds; i++) {
+            pong.push(ping.pop());
+        }
+    });
+
+    auto start = chrono::steady_clock::now();
+    for (long i = 0; i < rounds; i++) {
+        ping.push((int)i);
+        pong.pop();
+    }
+    auto end = chrono::steady_clock::now();
+    echo.join();
+
+    return chrono::duration<double, nano>(end - start).count() / rounds / 2;
+}
+
+void benchmark()
+{
+    const long items = 2000000;
+
+    cout << "throughput (Mitems/s)" << endl;
+    cout << "P x C   blocking_queue  mpmc_queue" << endl;
+    for (int n : {1, 2, 4}) {
+        blocking_queue<int> bq;
+        mpmc_queue<int> mq(1024);
+        double a = run_throughput(bq, n, n, items);
+        double b = run_throughput(mq, n, n, items);
+        cout << n << " x " << n << "\t" << a << "\t\t" << b << endl;
+    }
+
+    const long rounds = 20000;
+    blocking_queue<int> bping, bpong;
+    mpmc_queue<int> mping(64), mpong(64);
+    cout << "one-way latency (ns)" << endl;
+    cout << "blocking_queue: " << run_latency(bping, bpong, rounds) << endl;
+    cout << "mpmc_queue:     " << run_latency(mping, mpong, rounds) << endl;
+}
+
+int main() {
+    thread t1(producer3);
+    thread t2(consumer3);
+    t1.join();
+    t2.join();
+
+    benchmark();
+
+    return 0;
+}
@@ -0,0 +1,173 @@
+/*README:
+ * We will learn about:
+ * - Wait-free SPSC ring buffer: spsc_queue<T> (see spsc_queue.h)
+ * - Batch push/pop
+ * - Pinning a thread to a core: pthread_setaffinity_np()
+ *
+ * [1] producer3() -> consumer3() in 7_condition_variable.cpp has exactly one
+ *     producer and one consumer. For that case a mutex protected deque is
+ *     overkill: spsc_queue needs no lock and no CAS, only one load and one
+ *     store per operation on the fast path.
+ * [2] Pipeline stages: stage1 -> spsc_queue -> stage2. Each queue has one
+ *     writer and one reader, so a chain of stages can use spsc_queue between
+ *     every pair.
+ * [3] benchmark(): producer and consumer pinned to two different cores
+ *     (core 0 and core 1), passing N integers:
+ *     - blocking_queue (the 7_condition_variable.cpp pattern)
+ *     - spsc_queue, one item at a time
+ *     - spsc_queue, batches of 64 items
+ *     - spsc_queue<int, true> (blocking), batches of 64 items
+ *     With two dedicated cores the batched spsc_queue moves tens of millions
+ *     of messages per second. If the machine has a single core, both threads
+ *     share it and the numbers are limited by the scheduler.
+ *
+ * COMPILE:
+ * g++ -O2 13_spsc_queue.cpp -o 13_spsc_queue -lpthread
+ * */
+
+#include <iostream>
+#include <thread>
+#include <string>
+#include <chrono>
+#include <pthread.h>
+#include "spsc_queue.h"
+#include "blocking_queue.h"
+
+using namespace std;
+
+bool pin_to_core(thread& th, unsigned core)
+{
+    unsigned ncores = thread::hardware_concurrency();
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(ncores ? core % ncores : 0, &set);
+    return pthread_setaffinity_np(th.native_handle(), sizeof(set), &set) == 0;
+}
+
+/******** [2] stage1 -> stage2 -> stage3 ************/
+void pipeline()
+{
+    spsc_queue<string, true> q1(16);
+    spsc_queue<size_t, true> q2(16);
+
+    thread stage1([&]() {
+        for (int i = 10; i >= 0; i--) {
+            q1.push("msg-" + to_string(i)); //empty string ends the stream
+        }
+        q1.push("");
+    });
+    thread stage2([&]() {
+        for (;;) {
+            string s = q1.pop();
+            q2.push(s.size());
+            if (s.empty()) {
+                break;
+            }
+        }
+    });
+
+    size_t len;
+    while ((len = q2.pop()) != 0) {
+        cout << "consumed length: " << len << endl;
+    }
+    stage1.join();
+    stage2.join();
+}
+
+/******** [3] benchmark ************/
+template <typename Producer, typename Consumer>
+double run(Producer producer, Consumer consumer, long items)
+{
+    auto start = chrono::steady_clock::now();
+    thread p(producer);
+    thread c(consumer);
+    pin_to_core(p, 0);
+    pin_to_core(c, 1);
+    p.join();
+    c.join();
+    auto end = chrono::steady_clock::now();
+    return items / chrono::duration<double>(end - start).count() / 1e6;
+}
+
+void check(long sum, long items)
+{
+    if (sum != items * (items - 1) / 2) {
+        cout << "ERROR: checksum mismatch" << endl;
+    }
+}
+
+void benchmark()
+{
+    const long items = 10000000;
+    const size_t batch = 64;
+    long sum;
+
+    cout << "throughput (Mmsgs/s)" << endl;
+
+    {
+        blocking_queue<long> q;
+        sum = 0;
+        double r = run([&]() { for (long i = 0; i < items; i++) q.push(i); },
+                       [&]() { for (long i = 0; i < items; i++) sum += q.pop(); },
+                       items);
+        check(sum, items);
+        cout << "blocking_queue:          " << r << endl;
+    }
+
+    {
+        spsc_queue<long> q(4096);
+        sum = 0;
+        double r = run([&]() { for (long i = 0; i < items; i++) q.push(i); },
+                       [&]() { for (long i = 0; i < items; i++) sum += q.pop(); },
+                       items);
+        check(sum, items);
+        cout << "spsc_queue:              " << r << endl;
+    }
+
+    auto batched = [&](auto& q) {
+        sum = 0;
+        return run(
+            [&]() {
+                long buf[batch];
+                for (long i = 0; i < items; i += batch) {
+                    size_t n = 0;
+                    for (long j = i; j < items && n < batch; j++) {
+                        buf[n++] = j;
+                    }
+                    q.push_n(buf, n);
+                }
+            },
+            [&]() {
+                long buf[batch];
+                long got = 0;
+                while (got < items) {
+                    size_t n = q.pop_n(buf, batch);
+                    for (size_t k = 0; k < n; k++) {
+                        sum += buf[k];
+                    }
+                    got += n;
+                }
+            },
+            items);
+    };
+
+    {
+        spsc_queue<long> q(4096);
+        double r = batched(q);
+        check(sum, items);
+        cout << "spsc_queue, batch 64:    " << r << endl;
+    }
+
+    {
+        spsc_queue<long, true> q(4096);
+        double r = batched(q);
+        check(sum, items);
+        cout << "spsc_queue<blocking>, 64: " << r << endl;
+    }
+}
+
+int main() {
+    pipeline();
+    benchmark();
+    return 0;
+}
@@ -0,0 +1,184 @@
+/*README:
+ * We will learn about:
+ * - Batch dequeue: blocking_queue::pop_bulk(out, max)
+ * - Notify coalescing: notify only on the empty -> non-empty transition
+ * - Measuring wake-ups: notify calls and context switches (getrusage())
+ *
+ * [1] consumer3() in 7_condition_variable.cpp wakes up, pops exactly one
+ *     item, unlocks and loops; producer3() calls cond.notify_one() on every
+ *     push. Under heavy load that is one lock round trip and potentially one
+ *     futex syscall per item. naive_queue below is exactly that pattern.
+ * [2] blocking_queue (see blocking_queue.h) notifies only when the queue goes
+ *     from empty to non-empty and a consumer is actually sleeping, and
+ *     pop_bulk() drains up to max items per wake-up.
+ * [3] benchmark(): P producers push N items, one consumer pops them using
+ *     - naive_queue, pop() one item at a time, notify per push
+ *     - blocking_queue, pop() one item at a time, coalesced notify
+ *     - blocking_queue, pop_bulk() 64 items at a time, coalesced notify
+ *     For each we print throughput, the number of notify_one() calls, and
+ *     the number of voluntary context switches of the process (a thread
+ *     that sleeps on the futex causes one).
+ *     To see the real futex syscall count run:
+ *       strace -f -c -e trace=futex ./14_batch_dequeue
+ *
+ * COMPILE:
+ * g++ -O2 14_batch_dequeue.cpp -o 14_batch_dequeue -lpthread
+ * */
+
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <chrono>
+#include <sys/resource.h>
+#include "blocking_queue.h"
+
+using namespace std;
+
+/* [1] The 7_condition_variable.cpp pattern, counting its notify calls */
+template <typename T>
+class naive_queue
+{
+private:
+    deque<T> dq;
+    mutex mu;
+    condition_variable cond;
+    unsigned long notifies = 0;
+
+public:
+    void push(T value) {
+        unique_lock<mutex> locker(mu);
+        dq.push_back(move(value));
+        notifies++;
+        locker.unlock();
+        cond.notify_one();
+    }
+
+    T pop() {
+        unique_lock<mutex> locker(mu);
+        cond.wait(locker, [this](){ return !dq.empty(); });
+        T value = move(dq.front());
+        dq.pop_front();
+        return value;
+    }
+
+    unsigned long notify_count() {
+        lock_guard<mutex> locker(mu);
+        return notifies;
+    }
+};
+
+long voluntary_context_switches()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_nvcsw;
+}
+
+template <typename Queue, typename Consume>
+void run(const char* name, Queue& q, int producers, long items, Consume consume)
+{
+    vector<thread> threads;
+    long per_producer = items / producers;
+    long total = per_producer * producers;
+
+    long csw_before = voluntary_context_switches();
+    auto start = chrono::steady_clock::now();
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&]() {
+            for (long i = 0; i < per_producer; i++) {
+                q.push(1);
+            }
+        });
+    }
+    long sum = consume(q, total);
+    for (auto& th : threads) {
+        th.join();
+    }
+    auto end = chrono::steady_clock::now();
+    long csw = voluntary_context_switches() - csw_before;
+
+    if (sum != total) {
+        cout << "ERROR: lost items" << endl;
+    }
+    double sec = chrono::duration<double>(end - start).count();
+    cout << name << "\t" << total / sec / 1e6 << " Mitems/s\t"
+              << q.notify_count() << " notifies\t"
+              << csw << " ctx switches" << endl;
+}
+
+void benchmark()
+{
+    const long items = 2000000;
+
+    auto pop_one = [](auto& q, long total) {
+        long sum = 0;
+        for (long i = 0; i < total; i++) {
+            sum += q.pop();
+        }
+        return sum;
+    };
+
+    auto pop_64 = [](auto& q, long total) {
+        long sum = 0;
+        long got = 0;
+        vector<int> buf;
+        buf.reserve(64);
+        while (got < total) {
+            buf.clear();
+            got += q.pop_bulk(back_inserter(buf), 64);
+            for (int v : buf) {
+                sum += v;
+            }
+        }
+        return sum;
+    };
+
+    for (int p : {1, 2, 4}) {
+        cout << "producers: " << p << endl;
+        {
+            naive_queue<int> q;
+            run("naive pop()      ", q, p, items, pop_one);
+        }
+        {
+            blocking_queue<int> q;
+            run("coalesced pop()  ", q, p, items, pop_one);
+        }
+        {
+            blocking_queue<int> q;
+            run("coalesced bulk 64", q, p, items, pop_64);
+        }
+    }
+}
+
+int main() {
+    //producer3() -> consumer3() with pop_bulk()
+    blocking_queue<int> q;
+    thread t1([&]() {
+        for (int i = 10; i > 0; i--) {
+            q.push(i);
+            if (i % 3 == 0) {
+                this_thread::sleep_for(chrono::milliseconds(10));
+            }
+        }
+    });
+
+    int data = 0;
+    while (data != 1) {
+        vector<int> batch;
+        q.pop_bulk(back_inserter(batch), 8);
+        cout << "consumed batch of " << batch.size() << ":";
+        for (int v : batch) {
+            cout << " " << v;
+            data = v;
+        }
+        cout << endl;
+    }
+    t1.join();
+
+    benchmark();
+
+    return 0;
+}
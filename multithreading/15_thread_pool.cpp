@@ -0,0 +1,135 @@
+/*README:
+ * We will learn about:
+ * - A reusable fixed-size thread pool (see thread_pool.h)
+ * - Why spawning one std::thread per task is expensive
+ *
+ * [1] main3() in 9_packaged_task.cpp runs a packaged_task on a brand new
+ *     std::thread. Creating and joining an OS thread costs tens of
+ *     microseconds, far more than factorial(5) itself.
+ * [2] thread_pool creates its workers once. submit() only pushes the task
+ *     into the queue and wakes a worker, and returns a std::future.
+ * [3] benchmark():
+ *     - latency: submit one task and wait for its future, repeated; the
+ *       average submit -> complete time.
+ *     - throughput: submit N tasks, then wait for all futures; tasks/sec.
+ *     Both are compared with spawning a std::thread per task as in main3().
+ *
+ * COMPILE:
+ * g++ -O2 15_thread_pool.cpp -o 15_thread_pool -lpthread
+ * */
+
+#include <iostream>
+#include <future>
+#include <thread>
+#include <vector>
+#include <string>
+#include <chrono>
+#include "thread_pool.h"
+
+using namespace std;
+
+int factorial(int N) {
+    int result = 1;
+    for (int i=N; i>1; i--) {
+        result *= i;
+    }
+    return result;
+}
+
+/* [1] main3(): one thread per task */
+future<int> spawn_thread_task(int n, vector<thread>& threads) {
+    packaged_task<int(int)> task(factorial);
+    future<int> fu = task.get_future();
+    threads.emplace_back(std::move(task), n);
+    return fu;
+}
+
+void benchmark(thread_pool& pool)
+{
+    const int latency_rounds = 5000;
+    const int throughput_tasks = 50000;
+    const int wave = 250;
+
+    //latency
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < latency_rounds; i++) {
+        vector<thread> threads;
+        spawn_thread_task(5, threads).get();
+        threads[0].join();
+    }
+    auto end = chrono::steady_clock::now();
+    double thread_lat = chrono::duration<double, micro>(end - start).count() / latency_rounds;
+
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < latency_rounds; i++) {
+        pool.submit(factorial, 5).get();
+    }
+    end = chrono::steady_clock::now();
+    double pool_lat = chrono::duration<double, micro>(end - start).count() / latency_rounds;
+
+    //throughput, threads are spawned in waves since we would run out of
+    //threads (std::system_error) if all of them were alive at once
+    start = chrono::steady_clock::now();
+    for (int done = 0; done < throughput_tasks; done += wave) {
+        vector<thread> threads;
+        vector<future<int>> futures;
+        for (int i = 0; i < wave; i++) {
+            futures.push_back(spawn_thread_task(5, threads));
+        }
+        for (auto& fu : futures) {
+            fu.get();
+        }
+        for (auto& th : threads) {
+            th.join();
+        }
+    }
+    end = chrono::steady_clock::now();
+    double thread_tput = throughput_tasks / chrono::duration<double>(end - start).count();
+
+    start = chrono::steady_clock::now();
+    {
+        vector<future<int>> futures;
+        futures.reserve(throughput_tasks);
+        for (int i = 0; i < throughput_tasks; i++) {
+            futures.push_back(pool.submit(factorial, 5));
+        }
+        for (auto& fu : futures) {
+            fu.get();
+        }
+    }
+    end = chrono::steady_clock::now();
+    double pool_tput = throughput_tasks / chrono::duration<double>(end - start).count();
+
+    cout << "                  latency(us)  throughput(tasks/s)" << endl;
+    cout << "thread per task:  " << thread_lat << "\t" << thread_tput << endl;
+    cout << "thread_pool(" << pool.size() << "):   " << pool_lat << "\t" << pool_tput << endl;
+}
+
+int main()
+{
+    thread_pool pool(4);
+
+    //any callable: function + args, lambda, functor
+    future<int> fu1 = pool.submit(factorial, 5);
+    future<string> fu2 = pool.submit([](string s) { return s + " from pool"; }, string("hello"));
+    future<void> fu3 = pool.submit([]() { throw runtime_error("task failed"); });
+
+    cout << "factorial(5): " << fu1.get() << endl;
+    cout << fu2.get() << endl;
+    try {
+        fu3.get();
+    } catch (const exception& e) {
+        cout << "exception: " << e.what() << endl;
+    }
+
+    benchmark(pool);
+
+    pool.shutdown(); //also done by the destructor
+    try {
+        pool.submit(factorial, 3);
+    } catch (const exception& e) {
+        cout << "exception: " << e.what() << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,118 @@
+/*README:
+ * We will learn about:
+ * - Work stealing: per-worker Chase-Lev deques (see chase_lev_deque.h and
+ *   thread_pool.h)
+ * - Fork-join parallelism without blocking worker threads
+ *
+ * [1] factorial(N) from 9_packaged_task.cpp multiplies N, N-1, ..., 2. The
+ *     product of a range can be split: product(lo, hi) = product(lo, mid) *
+ *     product(mid+1, hi). parallel_product() forks the left half as a new
+ *     task, computes the right half itself and then joins.
+ *     (To keep the numbers in 64 bits the product is taken modulo a prime.)
+ * [2] If a task joined with fu.get(), the worker running it would sleep until
+ *     the child finishes. With recursive splitting every worker soon ends up
+ *     sleeping in fu.get() while the children sit in the queue with nobody
+ *     to run them: a deadlock. pool.wait(fu) instead runs other queued tasks
+ *     while it waits, so even a pool of 2 workers completes a split that is
+ *     20 levels deep.
+ * [3] Tasks forked by a worker go to its own deque (lock-free push/pop);
+ *     idle workers steal the oldest (biggest) halves from the other end.
+ * [4] benchmark():
+ *     - serial product vs parallel_product for a large N
+ *     - fine-grained fork-join (one task per leaf of size 1000): tasks/sec
+ *     On a single core machine there is no speedup to be had; the numbers
+ *     then show the scheduling overhead.
+ *
+ * COMPILE:
+ * g++ -O2 16_work_stealing.cpp -o 16_work_stealing -lpthread
+ * */
+
+#include <iostream>
+#include <future>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include "thread_pool.h"
+
+using namespace std;
+
+const uint64_t MOD = 1000000007ULL;
+
+uint64_t serial_product(uint64_t lo, uint64_t hi) {
+    uint64_t result = 1;
+    for (uint64_t i = lo; i <= hi; i++) {
+        result = result * i % MOD;
+    }
+    return result;
+}
+
+atomic<long> tasks_forked{0};
+
+//[1]
+uint64_t parallel_product(thread_pool& pool, uint64_t lo, uint64_t hi, uint64_t cutoff) {
+    if (hi - lo < cutoff) {
+        return serial_product(lo, hi);
+    }
+    uint64_t mid = lo + (hi - lo) / 2;
+
+    future<uint64_t> left = pool.submit(parallel_product, std::ref(pool), lo, mid, cutoff);
+    tasks_forked.fetch_add(1, memory_order_relaxed);
+    uint64_t right = parallel_product(pool, mid + 1, hi, cutoff);
+
+    pool.wait(left); //[2] runs other tasks instead of sleeping
+    return left.get() * right % MOD;
+}
+
+uint64_t factorial(thread_pool& pool, uint64_t n, uint64_t cutoff) {
+    if (n < 2) {
+        return 1;
+    }
+    return pool.submit(parallel_product, std::ref(pool), 2, n, cutoff).get();
+}
+
+void benchmark()
+{
+    thread_pool pool;
+    const uint64_t N = 200000000;
+
+    auto start = chrono::steady_clock::now();
+    uint64_t a = serial_product(2, N);
+    auto end = chrono::steady_clock::now();
+    double serial_ms = chrono::duration<double, milli>(end - start).count();
+
+    start = chrono::steady_clock::now();
+    uint64_t b = factorial(pool, N, 1000000);
+    end = chrono::steady_clock::now();
+    double parallel_ms = chrono::duration<double, milli>(end - start).count();
+
+    if (a != b) {
+        cout << "ERROR: results differ" << endl;
+    }
+    cout << "N = " << N << ", " << pool.size() << " workers" << endl;
+    cout << "serial:   " << serial_ms << " ms" << endl;
+    cout << "parallel: " << parallel_ms << " ms" << endl;
+
+    tasks_forked = 0;
+    start = chrono::steady_clock::now();
+    factorial(pool, 10000000, 1000);
+    end = chrono::steady_clock::now();
+    double sec = chrono::duration<double>(end - start).count();
+    cout << "fine-grained: " << tasks_forked << " tasks, "
+         << tasks_forked / sec << " tasks/s" << endl;
+}
+
+int main()
+{
+    {
+        //[2] deep recursion on just 2 workers
+        thread_pool pool(2);
+        cout << "20! mod p = " << factorial(pool, 20, 1) << endl;
+        cout << "serial    = " << serial_product(2, 20) << endl;
+        cout << "2^20 leaves on 2 workers: "
+             << factorial(pool, 1 << 20, 1) << endl;
+    }
+
+    benchmark();
+
+    return 0;
+}
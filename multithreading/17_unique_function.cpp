@@ -0,0 +1,229 @@
+/*README:
+ * We will learn about:
+ * - Move-only type erasure with small buffer optimization: unique_function
+ *   (see unique_function.h)
+ * - A promise/future pair with recycled shared state: light_promise /
+ *   light_future (see light_future.h, recycled.h)
+ * - Counting heap allocations by replacing the global operator new
+ *
+ * [1] Queuing a std::packaged_task<int()> as in main6() of
+ *     9_packaged_task.cpp allocates a shared state (for the future) and
+ *     the type-erased callable on the heap, for every single task.
+ * [2] unique_function stores a closure of up to 64 bytes inline, and
+ *     light_future's shared state is taken from a per-thread cache, so
+ *     thread_pool::spawn() and thread_pool::post() allocate nothing once the
+ *     caches are warm.
+ * [3] benchmark(): N tasks each, allocations per task and tasks/sec for
+ *     - the 9_packaged_task.cpp pattern: deque<packaged_task<int()>> drained
+ *       by one thread
+ *     - thread_pool::submit() -> std::future
+ *     - thread_pool::spawn()  -> light_future
+ *     - thread_pool::post()   (no future at all)
+ *
+ * COMPILE:
+ * g++ -O2 17_unique_function.cpp -o 17_unique_function -lpthread
+ * */
+
+#include <iostream>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include "thread_pool.h"
+
+using namespace std;
+
+/******** counting allocator ************/
+//every replaceable allocation function goes through count_alloc()/count_free(),
+//so new/delete, new[]/delete[], sized and aligned forms all pair up
+atomic<long> alloc_count{0};
+
+void* count_alloc(size_t size, size_t align = alignof(max_align_t)) {
+    alloc_count.fetch_add(1, memory_order_relaxed);
+    size = size ? size : 1;
+    void* p = align <= alignof(max_align_t) ? malloc(size)
+                                             : aligned_alloc(align, (size + align - 1) / align * align);
+    if (!p) {
+        throw bad_alloc();
+    }
+    return p;
+}
+
+//not inlined: GCC would otherwise see free() of a pointer from operator new
+//at the call site and warn (-Wmismatched-new-delete at -O1/-Os)
+[[gnu::noinline]] void count_free(void* p) noexcept {
+    free(p);
+}
+
+void* operator new(size_t size) { return count_alloc(size); }
+void* operator new[](size_t size) { return count_alloc(size); }
+void* operator new(size_t size, align_val_t al) { return count_alloc(size, static_cast<size_t>(al)); }
+void* operator new[](size_t size, align_val_t al) { return count_alloc(size, static_cast<size_t>(al)); }
+
+void operator delete(void* p) noexcept { count_free(p); }
+void operator delete[](void* p) noexcept { count_free(p); }
+void operator delete(void* p, size_t) noexcept { count_free(p); }
+void operator delete[](void* p, size_t) noexcept { count_free(p); }
+void operator delete(void* p, align_val_t) noexcept { count_free(p); }
+void operator delete[](void* p, align_val_t) noexcept { count_free(p); }
+void operator delete(void* p, size_t, align_val_t) noexcept { count_free(p); }
+void operator delete[](void* p, size_t, align_val_t) noexcept { count_free(p); }
+
+int factorial(int N) {
+    int result = 1;
+    for (int i=N; i>1; i--) {
+        result *= i;
+    }
+    return result;
+}
+
+/******** [1] the 9_packaged_task.cpp pattern ************/
+long run_packaged_task_queue(int ntasks, long& checksum)
+{
+    deque<packaged_task<int()>> task_q;
+    mutex mu;
+    condition_variable cond;
+    vector<future<int>> futures;
+    futures.reserve(ntasks);
+
+    long before = alloc_count;
+    thread t1([&]() {
+        for (int i = 0; i < ntasks; i++) {
+            packaged_task<int()> task;
+            {
+                unique_lock<mutex> locker(mu);
+                cond.wait(locker, [&](){ return !task_q.empty(); });
+                task = std::move(task_q.front());
+                task_q.pop_front();
+            }
+            task();
+        }
+    });
+    for (int i = 0; i < ntasks; i++) {
+        packaged_task<int()> task(std::bind(factorial, 5));
+        futures.push_back(task.get_future());
+        {
+            lock_guard<mutex> locker(mu);
+            task_q.push_back(std::move(task));
+        }
+        cond.notify_one();
+    }
+    for (auto& fu : futures) {
+        checksum += fu.get();
+    }
+    t1.join();
+    return alloc_count - before;
+}
+
+template <typename Run>
+void measure(const char* name, int ntasks, Run run)
+{
+    long checksum = 0;
+    run(ntasks, checksum);          //warm up the caches
+    checksum = 0;
+
+    auto start = chrono::steady_clock::now();
+    long allocs = run(ntasks, checksum);
+    auto end = chrono::steady_clock::now();
+
+    if (checksum != 120L * ntasks) {
+        cout << "ERROR: wrong checksum" << endl;
+    }
+    double sec = chrono::duration<double>(end - start).count();
+    cout << name << (double)allocs / ntasks << " allocs/task\t"
+         << ntasks / sec << " tasks/s" << endl;
+}
+
+void benchmark()
+{
+    const int ntasks = 200000;
+    thread_pool pool(2);
+
+    measure("deque<packaged_task>: ", ntasks, run_packaged_task_queue);
+
+    measure("pool.submit():        ", ntasks, [&](int n, long& checksum) {
+        vector<future<int>> futures;
+        futures.reserve(n);
+        long before = alloc_count;
+        for (int i = 0; i < n; i++) {
+            futures.push_back(pool.submit(factorial, 5));
+        }
+        for (auto& fu : futures) {
+            checksum += fu.get();
+        }
+        return alloc_count - before;
+    });
+
+    measure("pool.spawn():         ", ntasks, [&](int n, long& checksum) {
+        //futures are consumed in windows so the vector never reallocates
+        const int window = 1000;
+        vector<light_future<int>> futures(window);
+        long before = alloc_count;
+        for (int i = 0; i < n; i += window) {
+            for (int k = 0; k < window; k++) {
+                futures[k] = pool.spawn(factorial, 5);
+            }
+            for (int k = 0; k < window; k++) {
+                checksum += futures[k].get();
+            }
+        }
+        return alloc_count - before;
+    });
+
+    measure("pool.post():          ", ntasks, [&](int n, long& checksum) {
+        atomic<long> sum{0};
+        atomic<int> done{0};
+        long before = alloc_count;
+        for (int i = 0; i < n; i++) {
+            pool.post([&]() {
+                sum.fetch_add(factorial(5), memory_order_relaxed);
+                done.fetch_add(1, memory_order_release);
+            });
+        }
+        while (done.load(memory_order_acquire) != n) {
+            this_thread::yield();
+        }
+        checksum += sum;
+        return alloc_count - before;
+    });
+}
+
+int main()
+{
+    //unique_function holds move-only callables
+    unique_ptr<string> msg(new string("move-only capture"));
+    unique_function<size_t(int)> f = [msg = std::move(msg)](int k) { return msg->size() * k; };
+    unique_function<size_t(int)> g = std::move(f);
+    cout << "g(2): " << g(2) << " f is " << (f ? "set" : "empty") << endl;
+
+    //light_promise -> light_future, like std::promise -> std::future
+    light_promise<int> prom;
+    light_future<int> fut = prom.get_future();
+    thread t1([&prom]() { prom.set_value(factorial(5)); });
+    cout << "light_future: " << fut.get() << endl;
+    t1.join();
+
+    //broken promise
+    light_future<int> fut2;
+    {
+        light_promise<int> prom2;
+        fut2 = prom2.get_future();
+    }
+    try {
+        fut2.get();
+    } catch (const future_error& e) {
+        cout << "exception: " << e.what() << endl;
+    }
+
+    benchmark();
+
+    return 0;
+}
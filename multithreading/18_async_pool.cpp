@@ -0,0 +1,121 @@
+/*README:
+ * We will learn about:
+ * - pool_async(): std::async() backed by a shared thread pool
+ *   (see async_pool.h)
+ * - Why std::launch::async does not scale to a million tasks
+ *
+ * [1] The examples of 8_async.cpp, with std::async replaced by pool_async.
+ *     The launch policy keeps its meaning: deferred runs lazily on the
+ *     thread calling get(), async runs on a pool worker.
+ * [2] benchmark(): spawns N tasks (1M by default) with
+ *     - pool_async(std::launch::async, ...)
+ *     - pool_async(std::launch::deferred, ...)
+ *     - std::async(std::launch::async, ...), for comparison. Every call
+ *       creates an OS thread, so this one is run on fewer tasks (100k by
+ *       default) and in waves of 1000: keeping 1M futures (and threads)
+ *       alive at once would hit the thread limit.
+ *     Usage: ./18_async_pool [pool_tasks] [std_async_tasks]
+ *
+ * COMPILE:
+ * g++ -O2 18_async_pool.cpp -o 18_async_pool -lpthread
+ * */
+
+#include <iostream>
+#include <future>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include "async_pool.h"
+
+using namespace std;
+
+int factorial3(int n) {
+    int fact = 1;
+    for(int i=n; i>1; i--) {
+        fact *= i;
+    }
+    return fact;
+}
+
+int factorial4(std::future<int>& fut) {
+    int n = fut.get();
+    return factorial3(n);
+}
+
+int factorial5(std::shared_future<int> sfut) {
+    int n = sfut.get();
+    return factorial3(n);
+}
+
+template <typename Launch>
+double run(long ntasks, long wave, Launch launch)
+{
+    auto start = chrono::steady_clock::now();
+    long sum = 0;
+    vector<future<int>> futures;
+    futures.reserve(wave);
+    for (long done = 0; done < ntasks; done += wave) {
+        futures.clear();
+        for (long i = 0; i < wave && done + i < ntasks; i++) {
+            futures.push_back(launch());
+        }
+        for (auto& fu : futures) {
+            sum += fu.get();
+        }
+    }
+    auto end = chrono::steady_clock::now();
+    if (sum != 24 * ntasks) {
+        cout << "ERROR: wrong sum" << endl;
+    }
+    return ntasks / chrono::duration<double>(end - start).count();
+}
+
+void benchmark(long pool_tasks, long std_tasks)
+{
+    const long wave = 1000;
+    cout << "tasks/s" << endl;
+    cout << "pool_async(async):    " << run(pool_tasks, pool_tasks, []() {
+        return pool_async(launch::async, factorial3, 4);
+    }) << "  (" << pool_tasks << " tasks, " << default_pool().size() << " workers)" << endl;
+    cout << "pool_async(deferred): " << run(pool_tasks, pool_tasks, []() {
+        return pool_async(launch::deferred, factorial3, 4);
+    }) << "  (" << pool_tasks << " tasks)" << endl;
+    cout << "std::async(async):    " << run(std_tasks, wave, []() {
+        return std::async(launch::async, factorial3, 4);
+    }) << "  (" << std_tasks << " tasks, one thread each)" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    long pool_tasks = argc > 1 ? atol(argv[1]) : 1000000;
+    long std_tasks = argc > 2 ? atol(argv[2]) : 100000;
+
+    //[1] default policy: async | deferred
+    future<int> fu = pool_async(factorial3, 4);
+    cout << fu.get() << endl;
+
+    future<int> fu1 = pool_async(launch::deferred, factorial3, 4);
+    cout << fu1.get() << endl; //runs here, on the main thread
+
+    future<int> fu2 = pool_async(launch::async, factorial3, 4);
+    cout << fu2.get() << endl;
+
+    //promise -> future into a pooled task
+    promise<int> prom;
+    future<int> fut = prom.get_future();
+    future<int> fu3 = pool_async(launch::async, factorial4, std::ref(fut));
+    prom.set_value(3);
+    cout << fu3.get() << endl;
+
+    //shared_future into several pooled tasks
+    promise<int> prom1;
+    shared_future<int> sfut1 = prom1.get_future().share();
+    future<int> fu4 = pool_async(launch::async, factorial5, sfut1);
+    future<int> fu5 = pool_async(launch::async, factorial5, sfut1);
+    prom1.set_value(5);
+    cout << fu4.get() << " " << fu5.get() << endl;
+
+    benchmark(pool_tasks, std_tasks);
+
+    return 0;
+}
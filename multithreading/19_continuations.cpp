@@ -0,0 +1,166 @@
+/*README:
+ * We will learn about:
+ * - Future continuations: then(), when_all(), when_any() (see light_future.h)
+ * - Running a dependency graph without parking threads
+ *
+ * [1] factorial4(std::future<int>&) and factorial5(std::shared_future<int>)
+ *     in 8_async.cpp call fut.get() at the start, so the thread running them
+ *     sits idle until the parent thread sets the promise. Every dependent
+ *     computation holds a thread hostage.
+ * [2] With continuations the dependent computation is attached to the
+ *     future instead:
+ *       light_future<int> n = prom.get_future();
+ *       light_future<int> fact = std::move(n).then(factorial);
+ *     factorial is queued on default_pool() only once n is ready.
+ * [3] when_all(futures) is ready when all inputs are; when_any(futures)
+ *     when the first one is. Both return futures, so they can be chained
+ *     with then() too.
+ * [4] benchmark():
+ *     - a chain of N dependent steps, each one "wait for the previous
+ *       result, add 1":
+ *       - 8_async.cpp style: std::async(std::launch::async) per step, each
+ *         blocking in get() on its predecessor. All N threads are alive and
+ *         parked at the same time.
+ *       - then(): each step is queued when its input is ready; no thread
+ *         ever waits.
+ *     - fan-in: N spawned tasks joined with when_all().then(sum).
+ *
+ * COMPILE:
+ * g++ -O2 19_continuations.cpp -o 19_continuations -lpthread
+ * */
+
+#include <iostream>
+#include <future>
+#include <vector>
+#include <string>
+#include <chrono>
+#include "async_pool.h"
+
+using namespace std;
+
+int factorial(int n) {
+    int fact = 1;
+    for(int i=n; i>1; i--) {
+        fact *= i;
+    }
+    return fact;
+}
+
+/******** [4] benchmark ************/
+int add_one_blocking(shared_future<int> prev) {
+    return prev.get() + 1;  //parks this thread until prev is ready
+}
+
+void benchmark()
+{
+    const int chain = 1000;
+
+    //8_async.cpp style
+    auto start = chrono::steady_clock::now();
+    {
+        promise<int> prom;
+        shared_future<int> prev = prom.get_future().share();
+        for (int i = 0; i < chain; i++) {
+            prev = std::async(launch::async, add_one_blocking, prev).share();
+        }
+        prom.set_value(0);
+        if (prev.get() != chain) {
+            cout << "ERROR: wrong chain result" << endl;
+        }
+    }
+    auto end = chrono::steady_clock::now();
+    cout << "chain of " << chain << ", std::async + get(): "
+         << chrono::duration<double, milli>(end - start).count() << " ms" << endl;
+
+    //then()
+    const int long_chain = 100000;
+    start = chrono::steady_clock::now();
+    {
+        light_promise<int> prom;
+        light_future<int> fu = prom.get_future();
+        for (int i = 0; i < long_chain; i++) {
+            fu = std::move(fu).then([](int v) { return v + 1; });
+        }
+        prom.set_value(0);
+        if (fu.get() != long_chain) {
+            cout << "ERROR: wrong chain result" << endl;
+        }
+    }
+    end = chrono::steady_clock::now();
+    cout << "chain of " << long_chain << ", then(): "
+         << chrono::duration<double, milli>(end - start).count() << " ms" << endl;
+
+    //fan-in
+    const int fan = 100000;
+    start = chrono::steady_clock::now();
+    {
+        vector<light_future<int>> parts;
+        parts.reserve(fan);
+        for (int i = 0; i < fan; i++) {
+            parts.push_back(default_pool().spawn(factorial, 5));
+        }
+        long total = when_all(std::move(parts)).then([](vector<light_future<int>> done) {
+            long sum = 0;
+            for (auto& f : done) {
+                sum += f.get();
+            }
+            return sum;
+        }).get();
+        if (total != 120L * fan) {
+            cout << "ERROR: wrong fan-in result" << endl;
+        }
+    }
+    end = chrono::steady_clock::now();
+    cout << "fan-in of " << fan << ", when_all().then(): "
+         << chrono::duration<double, milli>(end - start).count() << " ms" << endl;
+}
+
+int main()
+{
+    //[2] promise -> then(factorial) -> then(print)
+    light_promise<int> prom;
+    light_future<void> done = prom.get_future()
+        .then(factorial)
+        .then([](int fact) { cout << "factorial(3): " << fact << endl; });
+    prom.set_value(3);
+    done.get();
+
+    //[2] exceptions skip the remaining steps and reach the end of the chain
+    light_promise<int> prom2;
+    light_future<string> msg = prom2.get_future()
+        .then([](int) -> int { throw runtime_error("step failed"); })
+        .then([](int v) { return to_string(v); });
+    prom2.set_value(1);
+    try {
+        msg.get();
+    } catch (const exception& e) {
+        cout << "exception: " << e.what() << endl;
+    }
+
+    //[3] when_all
+    vector<light_future<int>> facts;
+    for (int n = 1; n <= 5; n++) {
+        facts.push_back(default_pool().spawn(factorial, n));
+    }
+    int sum = when_all(std::move(facts)).then([](vector<light_future<int>> ready) {
+        int s = 0;
+        for (auto& f : ready) {
+            s += f.get();
+        }
+        return s;
+    }).get();
+    cout << "1! + 2! + 3! + 4! + 5! = " << sum << endl;
+
+    //[3] when_any: the promise that is never set loses
+    light_promise<int> slow;
+    vector<light_future<int>> racers;
+    racers.push_back(slow.get_future());
+    racers.push_back(default_pool().spawn(factorial, 6));
+    when_any_result<int> first = when_any(std::move(racers)).get();
+    cout << "when_any: input " << first.index << " won with "
+         << first.futures[first.index].get() << endl;
+
+    benchmark();
+
+    return 0;
+}
@@ -0,0 +1,196 @@
+/*README:
+ * We will learn about:
+ * - C++20 coroutines: task<T>, co_await, co_return (see coro_task.h)
+ * - Resuming coroutines on pool threads: co_await schedule(pool)
+ * - Awaitable queue and timers (see coro_awaitables.h)
+ *
+ * [1] 8_async.cpp and 9_packaged_task.cpp express "do this, then that" with
+ *     threads and futures; whoever calls fu.get() blocks a whole thread.
+ *     In a coroutine, `int x = co_await child();` suspends only the
+ *     coroutine; the thread goes on running other coroutines.
+ * [2] producer3() -> consumer3() of 7_condition_variable.cpp as coroutines:
+ *     the consumer co_awaits q.pop(), the producer co_awaits a timer
+ *     instead of calling sleep_for().
+ * [3] Symmetric transfer: depth(n) awaits depth(n-1) ... 100,000 levels
+ *     deep. Each level finishes by transferring control straight to its
+ *     parent, so the thread stack does not grow with the depth.
+ *     (Needs optimization, e.g. -O2, so that the transfer becomes a tail
+ *     call.)
+ * [4] benchmark(): N concurrent operations that each wait 10ms and then
+ *     compute factorial(5):
+ *     - N coroutines on the pool: time, and heap bytes per operation
+ *       (coroutine frame plus bookkeeping), counted by replacing the global
+ *       operator new
+ *     - the same with one std::thread per operation (each with its own
+ *       stack, 8 MB of address space by default) for a smaller N
+ *
+ * COMPILE:
+ * g++ -std=c++20 -O2 20_coroutines.cpp -o 20_coroutines -lpthread
+ * */
+
+#include <iostream>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include "coro_task.h"
+#include "coro_awaitables.h"
+
+using namespace std;
+
+/******** counting allocator ************/
+//every replaceable allocation function goes through count_alloc()/count_free(),
+//so new/delete, new[]/delete[], sized and aligned forms all pair up
+atomic<long> alloc_bytes{0};
+
+void* count_alloc(size_t size, size_t align = alignof(max_align_t)) {
+    alloc_bytes.fetch_add(size, memory_order_relaxed);
+    size = size ? size : 1;
+    void* p = align <= alignof(max_align_t) ? malloc(size)
+                                             : aligned_alloc(align, (size + align - 1) / align * align);
+    if (!p) {
+        throw bad_alloc();
+    }
+    return p;
+}
+
+//not inlined: GCC would otherwise see free() of a pointer from operator new
+//at the call site and warn (-Wmismatched-new-delete at -O1/-Os)
+[[gnu::noinline]] void count_free(void* p) noexcept {
+    free(p);
+}
+
+void* operator new(size_t size) { return count_alloc(size); }
+void* operator new[](size_t size) { return count_alloc(size); }
+void* operator new(size_t size, align_val_t al) { return count_alloc(size, static_cast<size_t>(al)); }
+void* operator new[](size_t size, align_val_t al) { return count_alloc(size, static_cast<size_t>(al)); }
+
+void operator delete(void* p) noexcept { count_free(p); }
+void operator delete[](void* p) noexcept { count_free(p); }
+void operator delete(void* p, size_t) noexcept { count_free(p); }
+void operator delete[](void* p, size_t) noexcept { count_free(p); }
+void operator delete(void* p, align_val_t) noexcept { count_free(p); }
+void operator delete[](void* p, align_val_t) noexcept { count_free(p); }
+void operator delete(void* p, size_t, align_val_t) noexcept { count_free(p); }
+void operator delete[](void* p, size_t, align_val_t) noexcept { count_free(p); }
+
+int factorial(int n) {
+    int fact = 1;
+    for(int i=n; i>1; i--) {
+        fact *= i;
+    }
+    return fact;
+}
+
+/******** [1] ************/
+task<int> factorial_task(int n) {
+    co_return factorial(n);
+}
+
+task<int> sum_of_factorials(thread_pool& pool, int upto) {
+    co_await schedule(pool);    //continue on a pool thread
+    int sum = 0;
+    for (int n = 1; n <= upto; n++) {
+        sum += co_await factorial_task(n);
+    }
+    co_return sum;
+}
+
+/******** [2] ************/
+task<> producer3(async_queue<int>& q, timer_service& timers) {
+    for (int i = 10; i > 0; i--) {
+        q.push(i);
+        co_await sleep_for(timers, chrono::milliseconds(10));
+    }
+}
+
+task<> consumer3(async_queue<int>& q) {
+    int data = 0;
+    while (data != 1) {
+        data = co_await q.pop();
+        cout << "consumed: " << data << endl;
+    }
+}
+
+/******** [3] ************/
+task<long> depth(long n) {
+    if (n == 0) {
+        co_return 0;
+    }
+    co_return 1 + co_await depth(n - 1);
+}
+
+/******** [4] benchmark ************/
+task<int> wait_then_compute(thread_pool& pool, timer_service& timers) {
+    co_await schedule(pool);
+    co_await sleep_for(timers, chrono::milliseconds(10));
+    co_return factorial(5);
+}
+
+void benchmark(thread_pool& pool, timer_service& timers)
+{
+    const int ncoro = 50000;
+    const int nthreads = 2000;
+
+    vector<light_future<int>> futures;
+    futures.reserve(ncoro);
+
+    long bytes_before = alloc_bytes;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < ncoro; i++) {
+        futures.push_back(co_spawn(pool, wait_then_compute(pool, timers)));
+    }
+    long bytes = alloc_bytes - bytes_before;
+    long sum = 0;
+    for (auto& fu : futures) {
+        sum += fu.get();
+    }
+    auto end = chrono::steady_clock::now();
+    if (sum != 120L * ncoro) {
+        cout << "ERROR: wrong sum" << endl;
+    }
+    cout << ncoro << " coroutines: "
+         << chrono::duration<double, milli>(end - start).count() << " ms, "
+         << bytes / ncoro << " heap bytes each" << endl;
+
+    start = chrono::steady_clock::now();
+    {
+        vector<thread> threads;
+        atomic<long> tsum{0};
+        for (int i = 0; i < nthreads; i++) {
+            threads.emplace_back([&tsum]() {
+                this_thread::sleep_for(chrono::milliseconds(10));
+                tsum += factorial(5);
+            });
+        }
+        for (auto& th : threads) {
+            th.join();
+        }
+    }
+    end = chrono::steady_clock::now();
+    cout << nthreads << " threads:     "
+         << chrono::duration<double, milli>(end - start).count() << " ms, "
+         << "a stack each" << endl;
+}
+
+int main()
+{
+    thread_pool pool(4);
+    timer_service timers(pool);
+
+    cout << "1! + ... + 5! = " << sync_wait(sum_of_factorials(pool, 5)) << endl;
+
+    async_queue<int> q(pool);
+    light_future<void> c = co_spawn(pool, consumer3(q));
+    light_future<void> p = co_spawn(pool, producer3(q, timers));
+    p.get();
+    c.get();
+
+    cout << "depth: " << sync_wait(depth(100000)) << endl;
+
+    benchmark(pool, timers);
+
+    return 0;
+}
@@ -0,0 +1,216 @@
+/*README:
+ * We will learn about:
+ * - Reading the CPU topology from sysfs (see cpu_topology.h)
+ * - Pinning threads to CPUs, and naming them
+ * - A thread pool that places its workers on the topology
+ *   (thread_pool_options in thread_pool.h)
+ *
+ * [1] 1_thread_mgmt.cpp prints std::thread::hardware_concurrency(). Here we
+ *     print what is behind that number: logical CPUs, physical cores,
+ *     packages and which CPUs are SMT siblings.
+ * [2] A pool with named, pinned workers, one per physical core. Each task
+ *     reports the name and the CPU of the worker that ran it
+ *     (try `top -H -p <pid>` while it runs).
+ * [3] benchmark_locality(): one thread per physical core, each repeatedly
+ *     updating its own buffer (1 MB by default, about the size of an L2).
+ *     Between passes a thread sleeps for a moment, like a worker waiting for
+ *     its next task. On wake-up the scheduler may put an unpinned thread on
+ *     another core, whose caches do not hold its buffer: the pass runs from
+ *     L3/DRAM instead of L2. Pinned threads always come back to the same
+ *     core. Reported: time spent in the passes and the number of times a
+ *     thread woke up on a different CPU.
+ * [4] benchmark_smt(): two threads streaming over their own buffers, placed
+ *     on two SMT siblings of one core (they share its L1/L2) and on two
+ *     different cores. Skipped if the machine has no SMT or only one core.
+ *     Usage: ./21_affinity [buffer_kb] [passes]
+ *
+ * COMPILE:
+ * g++ -O2 21_affinity.cpp -o 21_affinity -lpthread
+ * */
+
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sched.h>
+#include "cpu_topology.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+/******** [1] ************/
+void print_topology(const cpu_topology& topo)
+{
+    cout << "hardware_concurrency: " << thread::hardware_concurrency()
+         << ", usable CPUs: " << topo.cpus().size()
+         << ", physical cores: " << topo.physical_cores() << endl;
+    for (const cpu_info& c : topo.cpus()) {
+        cout << "  cpu " << c.cpu << ": package " << c.package << ", core " << c.core
+             << ", siblings {";
+        vector<unsigned> sib = topo.siblings(c.cpu);
+        for (size_t i = 0; i < sib.size(); i++) {
+            cout << (i ? "," : "") << sib[i];
+        }
+        cout << "}" << endl;
+    }
+}
+
+/******** [2] ************/
+void pool_demo()
+{
+    thread_pool_options opts;
+    opts.pin = true;
+    opts.avoid_smt = true;
+    opts.name = "demo";
+    thread_pool pool(opts);
+
+    for (size_t i = 0; i < pool.size(); i++) {
+        cout << "demo-" << i << " pinned to cpu " << pool.worker_cpu(i) << endl;
+    }
+
+    mutex mu;
+    set<pair<string, int>> seen;
+    vector<light_future<void>> done;
+    for (size_t i = 0; i < 4 * pool.size(); i++) {
+        done.push_back(pool.spawn([&]() {
+            this_thread::sleep_for(chrono::milliseconds(1));
+            lock_guard<mutex> locker(mu);
+            seen.insert({this_thread_name(), sched_getcpu()});
+        }));
+    }
+    for (auto& fu : done) {
+        fu.get();
+    }
+    for (const auto& s : seen) {
+        cout << "  task ran on " << s.first << " (cpu " << s.second << ")" << endl;
+    }
+}
+
+/******** [3] and [4] ************/
+struct pass_result {
+    double seconds = 0;     //time spent in passes only, not sleeping
+    long migrations = 0;
+};
+
+//pin < 0: leave the thread where the scheduler puts it
+pass_result run_passes(int pin, size_t bytes, int passes, bool nap)
+{
+    if (pin >= 0) {
+        pin_this_thread(static_cast<unsigned>(pin));
+    }
+    //first touch from the thread that will use the buffer
+    vector<uint64_t> buf(bytes / sizeof(uint64_t), 1);
+
+    pass_result r;
+    int last_cpu = sched_getcpu();
+    for (int p = 0; p < passes; p++) {
+        if (nap) {
+            this_thread::sleep_for(chrono::microseconds(200));
+        }
+        int cpu = sched_getcpu();
+        if (cpu != last_cpu) {
+            r.migrations++;
+            last_cpu = cpu;
+        }
+        auto start = chrono::steady_clock::now();
+        uint64_t carry = p;
+        for (auto& x : buf) {
+            x += carry;
+            carry = x >> 7;
+        }
+        r.seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (buf[0] == 42) {
+            cout << "";     //keep the loop from being optimized away
+        }
+    }
+    return r;
+}
+
+pass_result run_group(const vector<int>& pins, size_t bytes, int passes, bool nap)
+{
+    vector<pass_result> results(pins.size());
+    vector<thread> threads;
+    for (size_t i = 0; i < pins.size(); i++) {
+        threads.emplace_back([&, i]() {
+            name_this_thread("bench-" + to_string(i));
+            results[i] = run_passes(pins[i], bytes, passes, nap);
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    pass_result total;
+    for (const auto& r : results) {
+        total.seconds += r.seconds;
+        total.migrations += r.migrations;
+    }
+    return total;
+}
+
+void benchmark_locality(const cpu_topology& topo, size_t bytes, int passes)
+{
+    vector<unsigned> cpus = topo.placement(topo.physical_cores(), true);
+    vector<int> pinned(cpus.begin(), cpus.end());
+    vector<int> unpinned(cpus.size(), -1);
+
+    pass_result u = run_group(unpinned, bytes, passes, true);
+    pass_result p = run_group(pinned, bytes, passes, true);
+
+    double gb = double(bytes) * passes * cpus.size() / 1e9;
+    cout << cpus.size() << " threads x " << passes << " passes over "
+         << bytes / 1024 << " KB each" << endl;
+    cout << "  unpinned: " << gb / u.seconds * cpus.size() << " GB/s, "
+         << u.migrations << " migrations" << endl;
+    cout << "  pinned:   " << gb / p.seconds * cpus.size() << " GB/s, "
+         << p.migrations << " migrations" << endl;
+}
+
+void benchmark_smt(const cpu_topology& topo, size_t bytes, int passes)
+{
+    vector<unsigned> cores = topo.placement(topo.physical_cores(), true);
+    vector<unsigned> sib;
+    for (const cpu_info& c : topo.cpus()) {
+        sib = topo.siblings(c.cpu);
+        if (sib.size() >= 2) {
+            break;
+        }
+    }
+    if (sib.size() < 2 || cores.size() < 2) {
+        cout << "SMT benchmark skipped: needs SMT siblings and at least 2 cores" << endl;
+        return;
+    }
+
+    pass_result same = run_group({int(sib[0]), int(sib[1])}, bytes, passes, false);
+    pass_result apart = run_group({int(cores[0]), int(cores[1])}, bytes, passes, false);
+
+    double gb = double(bytes) * passes * 2 / 1e9;
+    cout << "2 threads x " << passes << " passes over " << bytes / 1024 << " KB each" << endl;
+    cout << "  SMT siblings (cpu " << sib[0] << "," << sib[1] << "): "
+         << gb / same.seconds * 2 << " GB/s" << endl;
+    cout << "  separate cores (cpu " << cores[0] << "," << cores[1] << "): "
+         << gb / apart.seconds * 2 << " GB/s" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t kb = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1024;
+    int passes = argc > 2 ? atoi(argv[2]) : 2000;
+
+    cpu_topology topo;
+    print_topology(topo);
+    cout << endl;
+
+    pool_demo();
+    cout << endl;
+
+    benchmark_locality(topo, kb * 1024, passes);
+    benchmark_smt(topo, kb * 1024, passes);
+
+    return 0;
+}
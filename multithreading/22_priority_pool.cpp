@@ -0,0 +1,141 @@
+/*README:
+ * We will learn about:
+ * - Priority lanes and earliest-deadline-first scheduling (see
+ *   priority_pool.h)
+ * - Starvation protection (aging)
+ * - Per-priority queue latency histograms (see latency_histogram.h)
+ *
+ * [1] mixed_load(): the same workload under each schedule_policy:
+ *     - a batch of low priority jobs (200us each, 500 per worker) is queued
+ *       all at once,
+ *     - meanwhile a "request" thread submits a short high priority task
+ *       every 500us and a normal priority task every 2ms.
+ *     With fifo the requests queue up behind the whole batch; with lanes
+ *     they start almost immediately and the batch still finishes in about
+ *     the same time. With edf the same holds until the batch's own
+ *     deadlines (100ms after it was queued) come due; from then on the
+ *     overdue batch jobs are the most urgent work.
+ * [2] starvation(): one low priority task queued behind a flood of high
+ *     priority tasks (~300ms of work), strict lanes vs lanes with a 20ms
+ *     starvation_limit.
+ *
+ * COMPILE:
+ * g++ -O2 22_priority_pool.cpp -o 22_priority_pool -lpthread
+ * */
+
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "priority_pool.h"
+
+using namespace std;
+
+void spin_for(chrono::microseconds d) {
+    auto end = chrono::steady_clock::now() + d;
+    while (chrono::steady_clock::now() < end) {
+    }
+}
+
+const char* policy_name(schedule_policy p) {
+    switch (p) {
+    case schedule_policy::fifo:
+        return "fifo";
+    case schedule_policy::lanes:
+        return "lanes";
+    case schedule_policy::edf:
+        return "edf";
+    }
+    return "?";
+}
+
+void report(const priority_pool& pool) {
+    const char* names[] = {"high", "normal", "low"};
+    for (size_t p = 0; p < priority_levels; p++) {
+        priority prio = static_cast<priority>(p);
+        cout << "    " << names[p] << ": " << pool.queue_latency(prio)
+             << ", deadline misses " << pool.deadline_misses(prio) << endl;
+    }
+}
+
+/******** [1] ************/
+void mixed_load(schedule_policy policy)
+{
+    priority_pool_options opts;
+    opts.policy = policy;
+    priority_pool pool(opts);
+
+    auto start = chrono::steady_clock::now();
+    vector<light_future<void>> batch;
+    for (size_t i = 0; i < 500 * pool.size(); i++) {
+        batch.push_back(pool.submit(priority::low, spin_for, chrono::microseconds(200)));
+    }
+
+    atomic<bool> batch_done{false};
+    thread requests([&]() {
+        vector<light_future<void>> replies;
+        for (int i = 0; !batch_done.load(); i++) {
+            replies.push_back(pool.submit(priority::high, spin_for, chrono::microseconds(20)));
+            if (i % 4 == 0) {
+                replies.push_back(pool.submit(priority::normal, spin_for, chrono::microseconds(100)));
+            }
+            this_thread::sleep_for(chrono::microseconds(500));
+        }
+        for (auto& fu : replies) {
+            fu.get();
+        }
+    });
+
+    for (auto& fu : batch) {
+        fu.get();
+    }
+    auto end = chrono::steady_clock::now();
+    batch_done = true;
+    requests.join();
+
+    cout << policy_name(policy) << ": batch of " << batch.size() << " done in "
+         << chrono::duration<double, milli>(end - start).count() << " ms" << endl;
+    report(pool);
+}
+
+/******** [2] ************/
+void starvation(chrono::milliseconds limit)
+{
+    priority_pool_options opts;
+    opts.policy = schedule_policy::lanes;
+    opts.starvation_limit = limit;
+    priority_pool pool(opts);
+
+    //keep every worker busy while the queue is filled
+    vector<light_future<void>> flood;
+    for (size_t i = 0; i < pool.size(); i++) {
+        flood.push_back(pool.submit(priority::high, spin_for, chrono::milliseconds(5)));
+    }
+    auto start = chrono::steady_clock::now();
+    light_future<chrono::steady_clock::time_point> low = pool.submit(priority::low, []() {
+        return chrono::steady_clock::now();
+    });
+    for (size_t i = 0; i < 3000 * pool.size(); i++) {
+        flood.push_back(pool.submit(priority::high, spin_for, chrono::microseconds(100)));
+    }
+    auto ran = low.get();
+    for (auto& fu : flood) {
+        fu.get();
+    }
+    cout << "starvation_limit " << limit.count() << "ms: low priority task started after "
+         << chrono::duration<double, milli>(ran - start).count() << " ms" << endl;
+}
+
+int main()
+{
+    mixed_load(schedule_policy::fifo);
+    mixed_load(schedule_policy::lanes);
+    mixed_load(schedule_policy::edf);
+    cout << endl;
+
+    starvation(chrono::milliseconds(0));
+    starvation(chrono::milliseconds(20));
+
+    return 0;
+}
@@ -0,0 +1,196 @@
+/*README:
+ * We will learn about:
+ * - Cooperative cancellation with tokens (see cancellation.h)
+ * - Cancelling a whole chain / tree of tasks
+ * - Timeouts: giving up on a result with wait_for() and dropping the work
+ * - Cancelled work giving its queue slot back immediately
+ *   (see priority_pool.h)
+ *
+ * [1] A long computation polls token.is_cancelled() between steps and
+ *     stops early when asked. fu.get() throws operation_cancelled.
+ * [2] A request owns a cancellation_source; its sub-requests use a child
+ *     source linked to it. One cancel() on the request reaches every step
+ *     of a then() chain started under the child token: the running step
+ *     finishes, the steps after it (wrapped with cancellable()) never run.
+ * [3] Timeout: wait_for(20ms) on a result that is stuck behind other work;
+ *     on timeout the caller cancels, and the queued task is dropped instead
+ *     of running later for nobody.
+ * [4] Under load: a bounded priority_pool (max_queued = 1000) is full of
+ *     batch work (50ms per task) and a producer thread is blocked in
+ *     submit(). Cancelling
+ *     the batch empties the queue before cancel() returns, the producer
+ *     gets in right away, and every batch future is already resolved with
+ *     operation_cancelled. Without cancellation the producer would wait
+ *     until the workers had chewed through the whole batch.
+ *
+ * COMPILE:
+ * g++ -O2 23_cancellation.cpp -o 23_cancellation -lpthread
+ * */
+
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "async_pool.h"
+#include "cancellation.h"
+#include "priority_pool.h"
+
+using namespace std;
+
+void spin_for(chrono::microseconds d) {
+    auto end = chrono::steady_clock::now() + d;
+    while (chrono::steady_clock::now() < end) {
+    }
+}
+
+double ms_since(chrono::steady_clock::time_point t) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t).count();
+}
+
+/******** [1] ************/
+long long_computation(cancellation_token token, int steps) {
+    long sum = 0;
+    for (int i = 0; i < steps; i++) {
+        token.throw_if_cancelled();
+        spin_for(chrono::microseconds(100));
+        sum += i;
+    }
+    return sum;
+}
+
+void cooperative()
+{
+    cancellation_source src;
+    auto start = chrono::steady_clock::now();
+    light_future<long> fu = default_pool().spawn(src.token(), long_computation, src.token(), 100000);
+    this_thread::sleep_for(chrono::milliseconds(10));
+    src.cancel();
+    try {
+        fu.get();
+    } catch (const operation_cancelled& e) {
+        cout << "[1] " << e.what() << " after " << ms_since(start)
+             << " ms (10 s of work requested)" << endl;
+    }
+}
+
+/******** [2] ************/
+void chain()
+{
+    cancellation_source request;
+    cancellation_source sub(request.token());   //child of request
+    cancellation_token t = sub.token();
+    atomic<int> steps_run{0};
+
+    light_promise<void> gate;
+    light_future<void> started = gate.get_future();
+    light_future<int> fu = default_pool()
+        .spawn(t, [&]() {
+            steps_run++;
+            gate.set_value();
+            spin_for(chrono::milliseconds(5));
+            return 1;
+        })
+        .then(cancellable(t, [&](int v) { steps_run++; return v + 1; }))
+        .then(cancellable(t, [&](int v) { steps_run++; return v + 1; }));
+
+    started.get();      //the first step is running
+    request.cancel();   //cancels sub too
+    try {
+        fu.get();
+        cout << "[2] ERROR: chain was not cancelled" << endl;
+    } catch (const operation_cancelled&) {
+        cout << "[2] chain cancelled through its parent request, steps run: "
+             << steps_run << " of 3" << endl;
+    }
+}
+
+/******** [3] ************/
+void timeout()
+{
+    priority_pool_options opts;
+    opts.threads = 1;
+    priority_pool pool(opts);
+
+    pool.submit(priority::normal, spin_for, chrono::milliseconds(100));   //keeps the worker busy
+    cancellation_source src;
+    atomic<bool> ran{false};
+    light_future<int> fu = pool.submit(src.token(), priority::normal, [&ran]() {
+        ran = true;
+        return 42;
+    });
+    if (fu.wait_for(chrono::milliseconds(20)) == future_status::timeout) {
+        src.cancel();
+        try {
+            fu.get();
+        } catch (const operation_cancelled&) {
+            cout << "[3] gave up after 20 ms, queued task dropped" << endl;
+        }
+    }
+    pool.shutdown();
+    cout << "[3] dropped task ran anyway: " << boolalpha << ran << endl;
+}
+
+/******** [4] ************/
+void capacity_under_load()
+{
+    priority_pool_options opts;
+    opts.max_queued = 1000;
+    priority_pool pool(opts);
+
+    cancellation_source batch;
+    vector<light_future<void>> batch_futures;
+    for (size_t i = 0; i < pool.size() + opts.max_queued; i++) {
+        batch_futures.push_back(
+            pool.submit(batch.token(), priority::low, spin_for, chrono::milliseconds(50)));
+    }
+
+    //the queue is full: this producer blocks in submit()
+    atomic<bool> producer_in{false};
+    chrono::steady_clock::time_point producer_at;
+    thread producer([&]() {
+        light_future<int> fu = pool.submit(priority::high, []() { return 1; });
+        producer_at = chrono::steady_clock::now();
+        producer_in = true;
+        fu.get();
+    });
+
+    this_thread::sleep_for(chrono::milliseconds(20));
+    size_t before = pool.queued_count();
+    bool blocked = !producer_in;
+
+    auto start = chrono::steady_clock::now();
+    batch.cancel();
+    double cancel_ms = ms_since(start);
+    size_t after = pool.queued_count();
+
+    size_t cancelled = 0;
+    for (auto& fu : batch_futures) {
+        if (!fu.is_ready()) {
+            continue;   //running when cancelled, not interrupted
+        }
+        try {
+            fu.get();
+        } catch (const operation_cancelled&) {
+            cancelled++;
+        }
+    }
+    producer.join();
+
+    cout << "[4] queued before cancel(): " << before << " (producer blocked: "
+         << boolalpha << blocked << ")" << endl;
+    cout << "    cancel() took " << cancel_ms << " ms, queued after: " << after
+         << ", futures already cancelled: " << cancelled << endl;
+    cout << "    producer got in " << chrono::duration<double, milli>(producer_at - start).count()
+         << " ms after cancel(); draining the batch instead would take ~"
+         << 50.0 * opts.max_queued / pool.size() << " ms" << endl;
+}
+
+int main()
+{
+    cooperative();
+    chain();
+    timeout();
+    capacity_under_load();
+    return 0;
+}
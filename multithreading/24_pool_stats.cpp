@@ -0,0 +1,151 @@
+/*README:
+ * We will learn about:
+ * - Looking inside a thread pool: per-worker counters and histograms
+ *   (see pool_stats.h, thread_pool_options::stats)
+ * - Measuring the cost of the measurement itself
+ *
+ * [1] The producer/consumer queues of 7_condition_variable.cpp and
+ *     9_packaged_task.cpp give no hint of how long tasks wait, how deep the
+ *     queue gets, or whether the consumers are busy or asleep. With
+ *     stats = true, thread_pool answers those questions per worker.
+ * [2] demo(): a fork-join computation (tasks spawned by workers, taken from
+ *     their own deques or stolen) running next to a stream of tasks posted
+ *     from outside (inject queue), with periodic_dump() printing a table
+ *     every 100ms and a final pool.stats() at the end.
+ * [3] overhead(): the task benchmarks of 16_work_stealing.cpp (fine-grained
+ *     fork-join) and 17_unique_function.cpp (post() from outside), each run
+ *     with stats off and on (interleaved, best of 5). With stats on, 15 of
+ *     16 tasks only pay for a counter increment at enqueue and one when they
+ *     are dequeued (counted by source); what is left is
+ *     usually smaller than the run-to-run noise, which for post() can be
+ *     several percent either way, so compare a few runs before reading
+ *     anything into a single number.
+ *     Usage: ./24_pool_stats [tasks]
+ *
+ * COMPILE:
+ * g++ -O2 24_pool_stats.cpp -o 24_pool_stats -lpthread
+ * */
+
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
+#include "thread_pool.h"
+
+using namespace std;
+
+const uint64_t MOD = 1000000007;
+
+uint64_t serial_product(uint64_t lo, uint64_t hi) {
+    uint64_t result = 1;
+    for (uint64_t i = lo; i <= hi; i++) {
+        result = result * i % MOD;
+    }
+    return result;
+}
+
+//16_work_stealing.cpp with spawn() (no allocation per task)
+uint64_t parallel_product(thread_pool& pool, uint64_t lo, uint64_t hi, uint64_t cutoff) {
+    if (hi - lo < cutoff) {
+        return serial_product(lo, hi);
+    }
+    uint64_t mid = lo + (hi - lo) / 2;
+    light_future<uint64_t> left = pool.spawn(parallel_product, std::ref(pool), lo, mid, cutoff);
+    uint64_t right = parallel_product(pool, mid + 1, hi, cutoff);
+    pool.wait(left);
+    return left.get() * right % MOD;
+}
+
+thread_pool_options with_stats(bool on) {
+    thread_pool_options opts;
+    opts.threads = max(1u, thread::hardware_concurrency());
+    opts.stats = on;
+    return opts;
+}
+
+/******** [2] ************/
+void demo()
+{
+    thread_pool pool(with_stats(true));
+    {
+        periodic_dump<thread_pool> dump(pool, chrono::milliseconds(100), cout);
+
+        atomic<bool> done{false};
+        thread outside([&]() {
+            while (!done) {
+                for (int i = 0; i < 100; i++) {
+                    pool.post([]() { serial_product(2, 2000); });
+                }
+                this_thread::sleep_for(chrono::milliseconds(1));
+            }
+        });
+        for (int round = 0; round < 5; round++) {
+            pool.spawn(parallel_product, std::ref(pool), 2, 20000000, 1000).get();
+        }
+        done = true;
+        outside.join();
+    }
+    cout << "final:" << endl << pool.stats();
+}
+
+/******** [3] ************/
+double fork_join_once(thread_pool& pool)
+{
+    auto start = chrono::steady_clock::now();
+    pool.spawn(parallel_product, std::ref(pool), 2, 10000000, 1000).get();
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return 10000000.0 / 1000 / sec;     //~ leaves per second
+}
+
+double post_once(thread_pool& pool, long ntasks)
+{
+    atomic<long> left{ntasks};
+    light_promise<void> all_done;
+    light_future<void> fu = all_done.get_future();
+    auto start = chrono::steady_clock::now();
+    for (long i = 0; i < ntasks; i++) {
+        pool.post([&left, &all_done]() {
+            if (left.fetch_sub(1, memory_order_acq_rel) == 1) {
+                all_done.set_value();
+            }
+        });
+    }
+    fu.get();
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return ntasks / sec;
+}
+
+//best of 5, off and on runs interleaved so both see the same machine noise
+template <typename Run>
+void compare(const char* name, Run run)
+{
+    thread_pool off_pool(with_stats(false));
+    thread_pool on_pool(with_stats(true));
+    double off = 0, on = 0;
+    for (int rep = 0; rep < 5; rep++) {
+        off = max(off, run(off_pool));
+        on = max(on, run(on_pool));
+    }
+    cout << name << "stats off " << off << " tasks/s, on " << on
+         << " tasks/s, overhead " << (off - on) / off * 100 << "%" << endl;
+}
+
+void overhead(long ntasks)
+{
+    compare("fork-join: ", fork_join_once);
+    compare("post():    ", [ntasks](thread_pool& pool) { return post_once(pool, ntasks); });
+}
+
+int main(int argc, char* argv[])
+{
+    long ntasks = argc > 1 ? atol(argv[1]) : 1000000;
+
+    demo();
+    cout << endl;
+    overhead(ntasks);
+
+    return 0;
+}
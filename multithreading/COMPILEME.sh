@@ -8,4 +8,19 @@
 #g++ 6_call_once.cpp -o 6_call_once -lpthread
 #g++  7_condition_variable.cpp -o 7_condition_variable -lpthread
 #g++ 8_async.cpp -o 8_async -lpthread
-g++ 9_packaged_task.cpp -o 9_packaged_task -lpthread
+#g++ 9_packaged_task.cpp -o 9_packaged_task -lpthread
+#g++ -O2 10_adaptive_mutex.cpp -o 10_adaptive_mutex -lpthread
+#g++ -O2 11_rwlock_seqlock.cpp -o 11_rwlock_seqlock -lpthread
+#g++ -O2 12_mpmc_queue.cpp -o 12_mpmc_queue -lpthread
+#g++ -O2 13_spsc_queue.cpp -o 13_spsc_queue -lpthread
+#g++ -O2 14_batch_dequeue.cpp -o 14_batch_dequeue -lpthread
+#g++ -O2 15_thread_pool.cpp -o 15_thread_pool -lpthread
+#g++ -O2 16_work_stealing.cpp -o 16_work_stealing -lpthread
+#g++ -O2 17_unique_function.cpp -o 17_unique_function -lpthread
+#g++ -O2 18_async_pool.cpp -o 18_async_pool -lpthread
+#g++ -O2 19_continuations.cpp -o 19_continuations -lpthread
+#g++ -std=c++20 -O2 20_coroutines.cpp -o 20_coroutines -lpthread
+#g++ -O2 21_affinity.cpp -o 21_affinity -lpthread
+#g++ -O2 22_priority_pool.cpp -o 22_priority_pool -lpthread
+#g++ -O2 23_cancellation.cpp -o 23_cancellation -lpthread
+g++ -O2 24_pool_stats.cpp -o 24_pool_stats -lpthread
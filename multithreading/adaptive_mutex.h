@@ -0,0 +1,83 @@
+/* README:
+ * - adaptive_mutex: a spin-then-park mutex for short critical sections.
+ * - It meets the Lockable requirements (lock(), try_lock(), unlock()), so it
+ *   can be used with lock_guard<>, unique_lock<> and std::lock() in place of
+ *   std::mutex.
+ *
+ * [1] state_ has three values (see "Futexes Are Tricky", U. Drepper):
+ *     0 - unlocked
+ *     1 - locked, nobody is waiting
+ *     2 - locked, there may be waiters parked on the futex
+ * [2] lock() first spins for a bounded number of rounds. Each round issues
+ *     cpu_relax() (the x86 `pause` instruction) and the number of pauses
+ *     doubles after every failed attempt (exponential backoff). Only after
+ *     spinning has failed does the thread park in the kernel with FUTEX_WAIT.
+ * [3] unlock() only does a FUTEX_WAKE syscall when state_ was 2, i.e., the
+ *     uncontended path is a single atomic exchange with no syscall at all.
+ * */
+
+#ifndef ADAPTIVE_MUTEX_H
+#define ADAPTIVE_MUTEX_H
+
+#include <atomic>
+#include <cstdint>
+#include "futex.h"
+
+class adaptive_mutex
+{
+private:
+    std::atomic<uint32_t> state_{0};
+
+    static constexpr int spin_rounds = 10;   //[2] a few hundred pauses in total
+    static constexpr int max_backoff = 1 << 6;
+
+public:
+    adaptive_mutex() = default;
+    adaptive_mutex(const adaptive_mutex&) = delete;
+    adaptive_mutex& operator=(const adaptive_mutex&) = delete;
+
+    bool try_lock() {
+        uint32_t expected = 0;
+        return state_.compare_exchange_strong(expected, 1,
+                                              std::memory_order_acquire,
+                                              std::memory_order_relaxed);
+    }
+
+    void lock() {
+        //fast path: uncontended
+        if (try_lock()) {
+            return;
+        }
+
+        //[2] spin with exponential backoff, read-only while spinning so the
+        //    cache line stays shared until it looks free
+        int backoff = 1;
+        for (int round = 0; round < spin_rounds; round++) {
+            for (int i = 0; i < backoff; i++) {
+                cpu_relax();
+            }
+            if (state_.load(std::memory_order_relaxed) == 0 && try_lock()) {
+                return;
+            }
+            if (backoff < max_backoff) {
+                backoff <<= 1;
+            }
+        }
+
+        //[1] slow path: mark the lock as contended and park
+        uint32_t c = state_.exchange(2, std::memory_order_acquire);
+        while (c != 0) {
+            futex_wait(&state_, 2);
+            c = state_.exchange(2, std::memory_order_acquire);
+        }
+    }
+
+    void unlock() {
+        //[3] wake a waiter only if someone may be parked
+        if (state_.exchange(0, std::memory_order_release) == 2) {
+            futex_wake(&state_, 1);
+        }
+    }
+};
+
+#endif //ADAPTIVE_MUTEX_H
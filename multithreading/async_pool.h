@@ -0,0 +1,58 @@
+/* README:
+ * - pool_async(): a std::async() look-alike that runs tasks on one shared,
+ *   fixed-size thread_pool instead of creating a thread per call.
+ *
+ * [1] std::async(std::launch::async, f, args...) starts a new OS thread for
+ *     every call (see 8_async.cpp). Under load that means thousands of
+ *     threads, thread creation dominating the run time, and eventually
+ *     std::system_error when the process hits its thread limit.
+ * [2] default_pool() is created on first use with hardware_concurrency()
+ *     workers and lives until the program exits.
+ * [3] The launch policy is honoured:
+ *     - std::launch::deferred: nothing runs until fu.get()/fu.wait(), then
+ *       f runs on the calling thread (same as std::async).
+ *     - std::launch::async, or async | deferred (the default): f is queued
+ *       on the pool. "async" here means "not on the calling thread", not
+ *       "on a new thread".
+ * [4] pool_async() returns a std::future, so it is a drop-in replacement,
+ *     e.g. for factorial4(std::future<int>&) in 8_async.cpp.
+ *     Note: the pool is bounded. A pooled task that blocks in fu.get()
+ *     waiting for another pooled task occupies a worker while it waits;
+ *     with enough of them the pool runs out of workers. Such dependencies
+ *     should use thread_pool::wait() or continuations instead.
+ * */
+
+#ifndef ASYNC_POOL_H
+#define ASYNC_POOL_H
+
+#include <future>
+#include <type_traits>
+#include <utility>
+#include "thread_pool.h"
+
+//[2]
+inline thread_pool& default_pool() {
+    static thread_pool pool;
+    return pool;
+}
+
+//[3]
+template <typename F, typename... Args>
+auto pool_async(std::launch policy, F&& f, Args&&... args)
+    -> std::future<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>>
+{
+    if (policy == std::launch::deferred) {
+        return std::async(std::launch::deferred, std::forward<F>(f), std::forward<Args>(args)...);
+    }
+    return default_pool().submit(std::forward<F>(f), std::forward<Args>(args)...);
+}
+
+template <typename F, typename... Args>
+auto pool_async(F&& f, Args&&... args)
+    -> std::future<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>>
+{
+    return pool_async(std::launch::async | std::launch::deferred,
+                      std::forward<F>(f), std::forward<Args>(args)...);
+}
+
+#endif //ASYNC_POOL_H
@@ -0,0 +1,123 @@
+/* README:
+ * - blocking_queue<T>: the deque + mutex + condition_variable pattern of
+ *   7_condition_variable.cpp (producer3() -> consumer3()) packed into a
+ *   class, so it can be reused and benchmarked against other queues.
+ *
+ * [1] push(): lock, push_back, unlock, notify.
+ * [2] pop(): lock, wait with a predicate (spurious wake), pop_front, unlock.
+ * [3] pop_bulk(out, max): like pop(), but once woken up it takes up to max
+ *     items in one go, so a busy consumer pays for one lock/unlock (and at
+ *     most one wake-up) per batch instead of per item.
+ * [4] Notify coalescing: consumer3() calls cond.notify_one() on every push.
+ *     Here we count the sleeping consumers (waiters) and push() notifies only
+ *     on the empty -> non-empty transition and only if somebody is sleeping.
+ *     Pushes into a non-empty queue never notify: the consumer that is
+ *     already awake will find the item. A consumer that leaves items behind
+ *     passes the baton and wakes the next sleeper, so with several consumers
+ *     nobody sleeps while there is work.
+ * [5] notify_count() returns how many notify_one() calls were issued; each
+ *     of them may be a futex syscall.
+ * */
+
+#ifndef BLOCKING_QUEUE_H
+#define BLOCKING_QUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+template <typename T>
+class blocking_queue
+{
+private:
+    std::deque<T> dq;
+    std::mutex mu;
+    std::condition_variable cond;
+    int waiters = 0;                //[4] consumers sleeping in cond.wait()
+    unsigned long notifies = 0;     //[5]
+
+    //called with mu held, returns true if the caller should notify
+    bool should_notify() {
+        if (waiters > 0 && !dq.empty()) {
+            notifies++;
+            return true;
+        }
+        return false;
+    }
+
+    void wait_not_empty(std::unique_lock<std::mutex>& locker) {
+        while (dq.empty()) {
+            waiters++;
+            cond.wait(locker);
+            waiters--;
+        }
+    }
+
+public:
+    //[1][4]
+    void push(T value) {
+        std::unique_lock<std::mutex> locker(mu);
+        bool was_empty = dq.empty();
+        dq.push_back(std::move(value));
+        bool notify = was_empty && should_notify();
+        locker.unlock();
+        if (notify) {
+            cond.notify_one();
+        }
+    }
+
+    //[2]
+    T pop() {
+        std::unique_lock<std::mutex> locker(mu);
+        wait_not_empty(locker);
+        T value = std::move(dq.front());
+        dq.pop_front();
+        bool notify = should_notify();  //[4] baton passing
+        locker.unlock();
+        if (notify) {
+            cond.notify_one();
+        }
+        return value;
+    }
+
+    //[3] blocks until at least one item is available, returns the count
+    //(0 at once for max == 0, without waiting or taking anything)
+    template <typename OutputIt>
+    size_t pop_bulk(OutputIt out, size_t max) {
+        if (max == 0) {
+            return 0;
+        }
+        std::unique_lock<std::mutex> locker(mu);
+        wait_not_empty(locker);
+        size_t count = 0;
+        while (count < max && !dq.empty()) {
+            *out++ = std::move(dq.front());
+            dq.pop_front();
+            count++;
+        }
+        bool notify = should_notify();  //[4] baton passing
+        locker.unlock();
+        if (notify) {
+            cond.notify_one();
+        }
+        return count;
+    }
+
+    bool try_pop(T& value) {
+        std::lock_guard<std::mutex> locker(mu);
+        if (dq.empty()) {
+            return false;
+        }
+        value = std::move(dq.front());
+        dq.pop_front();
+        return true;
+    }
+
+    unsigned long notify_count() {
+        std::lock_guard<std::mutex> locker(mu);
+        return notifies;
+    }
+};
+
+#endif //BLOCKING_QUEUE_H
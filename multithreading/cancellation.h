@@ -0,0 +1,220 @@
+/* README:
+ * - Cooperative cancellation: cancellation_source, cancellation_token and
+ *   cancellation_callback (the same idea as C++20's std::stop_source,
+ *   std::stop_token and std::stop_callback, usable from C++17).
+ *
+ * [1] Once a packaged_task is queued (9_packaged_task.cpp) nothing can take
+ *     it back, and fu.get() waits until somebody runs it. With cancellation:
+ *     - the owner of the work holds a cancellation_source and hands
+ *       source.token() to everything it starts. Tokens are cheap to copy
+ *       (one shared_ptr).
+ *     - source.cancel() flips the shared flag, once. Nothing is interrupted:
+ *       queued tasks are dropped before they start (see priority_pool.h and
+ *       thread_pool::spawn(token, ...)), and running tasks poll
+ *       token.is_cancelled() / token.throw_if_cancelled() at convenient
+ *       points.
+ *     - a task dropped or stopped by cancellation reports
+ *       operation_cancelled through its future, so fu.get() returns right
+ *       away, and a then() chain after it skips its remaining steps.
+ * [2] cancellation_source child(parent_token): a source that is cancelled
+ *     when the parent is (and can also be cancelled on its own). This is how
+ *     cancellation propagates down a tree of tasks: a request cancels its
+ *     sub-requests, not the other way around.
+ * [3] cancellation_callback cb(token, f): runs f once on the thread that
+ *     calls cancel() (or immediately, if the token is already cancelled).
+ *     The callback is deregistered by its destructor; if f is running on
+ *     another thread at that moment, the destructor waits for it to finish,
+ *     so f never touches an object that is already gone.
+ * [4] cancellable(token, f): f wrapped so that it throws operation_cancelled
+ *     instead of running once the token is cancelled. For the steps of a
+ *     then() chain:
+ *       spawn(t, step1).then(cancellable(t, step2)).then(cancellable(t, step3))
+ * */
+
+#ifndef CANCELLATION_H
+#define CANCELLATION_H
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include "unique_function.h"
+
+class operation_cancelled : public std::exception
+{
+public:
+    const char* what() const noexcept override {
+        return "operation cancelled";
+    }
+};
+
+class cancellation_callback;
+
+namespace detail {
+
+struct cancel_state {
+    std::atomic<bool> cancelled{false};
+    std::mutex mu;
+    cancellation_callback* head = nullptr;      //registered callbacks
+    cancellation_callback* running = nullptr;   //callback being run by cancel()
+    std::thread::id running_thread;
+    std::condition_variable done;
+
+    inline bool request_cancel();
+};
+
+} //namespace detail
+
+class cancellation_token
+{
+private:
+    std::shared_ptr<detail::cancel_state> state_;
+
+    friend class cancellation_source;
+    friend class cancellation_callback;
+    explicit cancellation_token(std::shared_ptr<detail::cancel_state> s) : state_(std::move(s)) {}
+
+public:
+    //a default constructed token is never cancelled
+    cancellation_token() = default;
+
+    bool can_be_cancelled() const {
+        return state_ != nullptr;
+    }
+
+    bool is_cancelled() const {
+        return state_ && state_->cancelled.load(std::memory_order_acquire);
+    }
+
+    void throw_if_cancelled() const {
+        if (is_cancelled()) {
+            throw operation_cancelled();
+        }
+    }
+};
+
+//[3]
+class cancellation_callback
+{
+private:
+    std::shared_ptr<detail::cancel_state> state_;
+    unique_function<void()> fn_;
+    cancellation_callback* prev_ = nullptr;
+    cancellation_callback* next_ = nullptr;
+    bool listed_ = false;
+
+    friend struct detail::cancel_state;
+
+public:
+    cancellation_callback(const cancellation_token& token, unique_function<void()> f)
+        : fn_(std::move(f)) {
+        if (!token.state_) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> locker(token.state_->mu);
+            if (!token.state_->cancelled.load(std::memory_order_relaxed)) {
+                state_ = token.state_;
+                next_ = state_->head;
+                if (next_) {
+                    next_->prev_ = this;
+                }
+                state_->head = this;
+                listed_ = true;
+                return;
+            }
+        }
+        fn_();  //already cancelled
+    }
+
+    ~cancellation_callback() {
+        if (!state_) {
+            return;
+        }
+        std::unique_lock<std::mutex> locker(state_->mu);
+        if (listed_) {
+            if (prev_) {
+                prev_->next_ = next_;
+            } else {
+                state_->head = next_;
+            }
+            if (next_) {
+                next_->prev_ = prev_;
+            }
+            return;
+        }
+        //taken off the list by cancel(); wait if it is running elsewhere
+        if (state_->running_thread != std::this_thread::get_id()) {
+            state_->done.wait(locker, [this]() { return state_->running != this; });
+        }
+    }
+
+    cancellation_callback(const cancellation_callback&) = delete;
+    cancellation_callback& operator=(const cancellation_callback&) = delete;
+};
+
+bool detail::cancel_state::request_cancel() {
+    std::unique_lock<std::mutex> locker(mu);
+    if (cancelled.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    cancelled.store(true, std::memory_order_release);
+    running_thread = std::this_thread::get_id();
+    while (head) {
+        cancellation_callback* cb = head;
+        head = cb->next_;
+        if (head) {
+            head->prev_ = nullptr;
+        }
+        cb->listed_ = false;
+        running = cb;
+        locker.unlock();
+        cb->fn_();
+        locker.lock();
+        running = nullptr;
+        done.notify_all();
+    }
+    return true;
+}
+
+class cancellation_source
+{
+private:
+    std::shared_ptr<detail::cancel_state> state_ = std::make_shared<detail::cancel_state>();
+    std::unique_ptr<cancellation_callback> link_;   //[2]
+
+public:
+    cancellation_source() = default;
+
+    //[2]
+    explicit cancellation_source(const cancellation_token& parent)
+        : link_(new cancellation_callback(parent, [s = state_]() { s->request_cancel(); })) {}
+
+    cancellation_token token() const {
+        return cancellation_token(state_);
+    }
+
+    //true if this call did the cancelling
+    bool cancel() {
+        return state_->request_cancel();
+    }
+
+    bool is_cancelled() const {
+        return state_->cancelled.load(std::memory_order_acquire);
+    }
+};
+
+//[4]
+template <typename F>
+auto cancellable(cancellation_token token, F&& f) {
+    return [token = std::move(token), f = std::forward<F>(f)](auto&&... args) mutable
+               -> decltype(f(std::forward<decltype(args)>(args)...)) {
+        token.throw_if_cancelled();
+        return f(std::forward<decltype(args)>(args)...);
+    };
+}
+
+#endif //CANCELLATION_H
@@ -0,0 +1,148 @@
+/* README:
+ * - chase_lev_deque<T>: the lock-free work-stealing deque of Chase and Lev
+ *   ("Dynamic Circular Work-Stealing Deque", 2005), with the C11 memory
+ *   orderings of Le, Pop, Cohen, Zappa Nardelli ("Correct and Efficient
+ *   Work-Stealing for Weak Memory Models", 2013).
+ *
+ * [1] One owner thread pushes and pops at the bottom (LIFO, good cache
+ *     locality for fork-join: the most recently spawned task is the hottest).
+ *     Any other thread may steal from the top (FIFO, takes the oldest and
+ *     usually biggest piece of work).
+ * [2] push()/pop() by the owner need no CAS except when the deque holds a
+ *     single element and the owner races a thief for it.
+ * [3] The ring grows when full. Old rings are kept until the deque is
+ *     destroyed, since a thief may still be reading from them.
+ * [4] T must be trivially copyable (typically a pointer), since elements are
+ *     stored in atomics.
+ * */
+
+#ifndef CHASE_LEV_DEQUE_H
+#define CHASE_LEV_DEQUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+template <typename T>
+class chase_lev_deque
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "chase_lev_deque<T> requires a trivially copyable T");
+
+private:
+    struct ring {
+        int64_t cap;
+        std::unique_ptr<std::atomic<T>[]> buf;
+
+        explicit ring(int64_t c) : cap(c), buf(new std::atomic<T>[c]) {}
+
+        T get(int64_t i) const {
+            return buf[i & (cap - 1)].load(std::memory_order_relaxed);
+        }
+        void put(int64_t i, T x) {
+            buf[i & (cap - 1)].store(x, std::memory_order_relaxed);
+        }
+    };
+
+    alignas(64) std::atomic<int64_t> top_{0};
+    alignas(64) std::atomic<int64_t> bottom_{0};
+    alignas(64) std::atomic<ring*> ring_;
+    std::vector<std::unique_ptr<ring>> rings_;  //[3] owner only
+
+    ring* grow(ring* r, int64_t b, int64_t t) {
+        rings_.emplace_back(new ring(r->cap * 2));
+        ring* bigger = rings_.back().get();
+        for (int64_t i = t; i < b; i++) {
+            bigger->put(i, r->get(i));
+        }
+        ring_.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+public:
+    explicit chase_lev_deque(int64_t capacity = 256) {
+        int64_t cap = 2;
+        while (cap < capacity) {
+            cap <<= 1;
+        }
+        rings_.emplace_back(new ring(cap));
+        ring_.store(rings_.back().get(), std::memory_order_relaxed);
+    }
+
+    chase_lev_deque(const chase_lev_deque&) = delete;
+    chase_lev_deque& operator=(const chase_lev_deque&) = delete;
+
+    //[1] owner only
+    void push(T x) {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        ring* r = ring_.load(std::memory_order_relaxed);
+        if (b - t > r->cap - 1) {
+            r = grow(r, b, t);
+        }
+        r->put(b, x);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+
+    //[1][2] owner only
+    bool pop(T& out) {
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        ring* r = ring_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            //empty
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        out = r->get(b);
+        if (t == b) {
+            //last element: race against thieves
+            bool won = top_.compare_exchange_strong(t, t + 1,
+                                                    std::memory_order_seq_cst,
+                                                    std::memory_order_relaxed);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    //[1] any thread; may fail spuriously when racing another thief
+    bool steal(T& out) {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b) {
+            return false;
+        }
+        ring* r = ring_.load(std::memory_order_acquire);
+        T x = r->get(t);
+        if (!top_.compare_exchange_strong(t, t + 1,
+                                          std::memory_order_seq_cst,
+                                          std::memory_order_relaxed)) {
+            return false;
+        }
+        out = x;
+        return true;
+    }
+
+    bool empty() const {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        return b <= t;
+    }
+
+    int64_t size() const {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        return b > t ? b - t : 0;
+    }
+};
+
+#endif //CHASE_LEV_DEQUE_H
@@ -0,0 +1,176 @@
+/* README:
+ * - Awaitable building blocks for task<T> coroutines (see coro_task.h):
+ *   async_queue<T> and timers. Needs -std=c++20.
+ *
+ * [1] async_queue<T>: the deque of 7_condition_variable.cpp, but a consumer
+ *     does `T v = co_await q.pop();` instead of cond.wait(). If the queue is
+ *     empty, the *coroutine* is suspended and its handle is parked in the
+ *     waiters list; the thread is free to run something else. push() hands
+ *     the value directly to the first waiter and posts its resumption to the
+ *     pool.
+ * [2] timer_service: one thread that keeps a min-heap of (deadline,
+ *     coroutine) and, when a deadline passes, posts the coroutine to its
+ *     pool. co_await sleep_for(timers, 10ms) suspends the coroutine for
+ *     10ms without blocking any pool thread, so 10,000 sleeping coroutines
+ *     cost 10,000 small heap entries, not 10,000 sleeping threads.
+ * */
+
+#ifndef CORO_AWAITABLES_H
+#define CORO_AWAITABLES_H
+
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <vector>
+#include "coro_task.h"
+#include "thread_pool.h"
+
+//[1]
+template <typename T>
+class async_queue
+{
+private:
+    struct waiter {
+        std::coroutine_handle<> h;
+        std::optional<T> slot;
+    };
+
+    std::mutex mu;
+    std::deque<T> dq;
+    std::deque<waiter*> waiters;
+    thread_pool& pool;
+
+public:
+    explicit async_queue(thread_pool& p) : pool(p) {}
+
+    void push(T value) {
+        std::unique_lock<std::mutex> locker(mu);
+        if (waiters.empty()) {
+            dq.push_back(std::move(value));
+            return;
+        }
+        waiter* w = waiters.front();
+        waiters.pop_front();
+        locker.unlock();
+
+        w->slot.emplace(std::move(value));
+        std::coroutine_handle<> h = w->h;
+        pool.post([h]() { h.resume(); });
+    }
+
+    auto pop() {
+        struct awaiter {
+            async_queue& q;
+            waiter w;
+
+            bool await_ready() noexcept { return false; }
+
+            bool await_suspend(std::coroutine_handle<> h) {
+                std::lock_guard<std::mutex> locker(q.mu);
+                if (!q.dq.empty()) {
+                    w.slot.emplace(std::move(q.dq.front()));
+                    q.dq.pop_front();
+                    return false;   //do not suspend, value is here
+                }
+                w.h = h;
+                q.waiters.push_back(&w);
+                return true;
+            }
+
+            T await_resume() {
+                return std::move(*w.slot);
+            }
+        };
+        return awaiter{*this, {}};
+    }
+};
+
+//[2]
+class timer_service
+{
+private:
+    struct entry {
+        std::chrono::steady_clock::time_point deadline;
+        std::coroutine_handle<> h;
+        bool operator>(const entry& other) const {
+            return deadline > other.deadline;
+        }
+    };
+
+    std::mutex mu;
+    std::condition_variable cond;
+    std::priority_queue<entry, std::vector<entry>, std::greater<entry>> heap;
+    bool stop = false;
+    thread_pool& pool;
+    std::thread th;
+
+    void run() {
+        std::unique_lock<std::mutex> locker(mu);
+        while (!stop) {
+            if (heap.empty()) {
+                cond.wait(locker);
+                continue;
+            }
+            //copy: heap.top() may move while we wait
+            auto deadline = heap.top().deadline;
+            if (deadline > std::chrono::steady_clock::now()) {
+                cond.wait_until(locker, deadline);
+                continue;
+            }
+            std::coroutine_handle<> h = heap.top().h;
+            heap.pop();
+            pool.post([h]() { h.resume(); });
+        }
+    }
+
+public:
+    explicit timer_service(thread_pool& p) : pool(p), th(&timer_service::run, this) {}
+
+    ~timer_service() {
+        {
+            std::lock_guard<std::mutex> locker(mu);
+            stop = true;
+        }
+        cond.notify_one();
+        th.join();
+    }
+
+    void add(std::chrono::steady_clock::time_point deadline, std::coroutine_handle<> h) {
+        bool earliest;
+        {
+            std::lock_guard<std::mutex> locker(mu);
+            earliest = heap.empty() || deadline < heap.top().deadline;
+            heap.push(entry{deadline, h});
+        }
+        if (earliest) {
+            cond.notify_one();
+        }
+    }
+};
+
+inline auto sleep_until(timer_service& timers, std::chrono::steady_clock::time_point deadline) {
+    struct awaiter {
+        timer_service& timers;
+        std::chrono::steady_clock::time_point deadline;
+        bool await_ready() const noexcept {
+            return std::chrono::steady_clock::now() >= deadline;
+        }
+        void await_suspend(std::coroutine_handle<> h) {
+            timers.add(deadline, h);
+        }
+        void await_resume() noexcept {}
+    };
+    return awaiter{timers, deadline};
+}
+
+template <typename Rep, typename Period>
+auto sleep_for(timer_service& timers, std::chrono::duration<Rep, Period> d) {
+    return sleep_until(timers, std::chrono::steady_clock::now() + d);
+}
+
+#endif //CORO_AWAITABLES_H
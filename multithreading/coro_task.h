@@ -0,0 +1,219 @@
+/* README:
+ * - task<T>: a lazily started C++20 coroutine that produces a T, and the
+ *   glue to run coroutines on a thread_pool. Needs -std=c++20.
+ *
+ * [1] A coroutine frame holds only the locals that live across a co_await
+ *     (typically a few hundred bytes), while a thread needs a whole stack
+ *     (8 MB of address space by default). So tens of thousands of in-flight
+ *     operations can be coroutines where they could never be threads.
+ * [2] task<T> is lazy: calling a task coroutine only creates the frame.
+ *     It starts when it is co_await'ed. When it finishes, final_suspend
+ *     resumes the awaiting coroutine through *symmetric transfer*
+ *     (await_suspend returns the handle to resume next), so a long chain of
+ *     tasks completing one after another does not grow the stack.
+ * [3] co_await schedule(pool): suspends the current coroutine and resumes
+ *     it on one of pool's worker threads (thread_pool::post()).
+ * [4] co_spawn(pool, task) starts a task on the pool without waiting for it
+ *     and returns a light_future<T> (see light_future.h) for the result.
+ *     sync_wait(task) runs a task and blocks the calling (non-coroutine)
+ *     thread until it is done, e.g. from main().
+ * */
+
+#ifndef CORO_TASK_H
+#define CORO_TASK_H
+
+#include <coroutine>
+#include <exception>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include "light_future.h"
+#include "thread_pool.h"
+
+template <typename T = void>
+class task;
+
+namespace detail {
+
+struct task_promise_base {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }   //[2] lazy
+
+    //[2] symmetric transfer back to whoever awaited us
+    struct final_awaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+            std::coroutine_handle<> next = h.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+    final_awaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() noexcept {
+        error = std::current_exception();
+    }
+};
+
+template <typename T>
+struct task_promise : task_promise_base {
+    std::variant<std::monostate, T> value;
+
+    task<T> get_return_object() noexcept;
+
+    template <typename U>
+    void return_value(U&& v) {
+        value.template emplace<1>(std::forward<U>(v));
+    }
+
+    T result() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return std::move(std::get<1>(value));
+    }
+};
+
+template <>
+struct task_promise<void> : task_promise_base {
+    task<void> get_return_object() noexcept;
+
+    void return_void() noexcept {}
+
+    void result() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+};
+
+} //namespace detail
+
+template <typename T>
+class task
+{
+public:
+    using promise_type = detail::task_promise<T>;
+    using handle = std::coroutine_handle<promise_type>;
+
+private:
+    handle h_;
+
+public:
+    explicit task(handle h) noexcept : h_(h) {}
+    task(task&& other) noexcept : h_(std::exchange(other.h_, {})) {}
+    task& operator=(task&& other) noexcept {
+        if (this != &other) {
+            if (h_) {
+                h_.destroy();
+            }
+            h_ = std::exchange(other.h_, {});
+        }
+        return *this;
+    }
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+
+    ~task() {
+        if (h_) {
+            h_.destroy();
+        }
+    }
+
+    //[2] co_await starts the child and suspends the parent
+    auto operator co_await() && noexcept {
+        struct awaiter {
+            handle child;
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> parent) noexcept {
+                child.promise().continuation = parent;
+                return child;   //symmetric transfer into the child
+            }
+            T await_resume() {
+                return child.promise().result();
+            }
+        };
+        return awaiter{h_};
+    }
+};
+
+namespace detail {
+
+template <typename T>
+task<T> task_promise<T>::get_return_object() noexcept {
+    return task<T>(std::coroutine_handle<task_promise<T>>::from_promise(*this));
+}
+
+inline task<void> task_promise<void>::get_return_object() noexcept {
+    return task<void>(std::coroutine_handle<task_promise<void>>::from_promise(*this));
+}
+
+//a coroutine that starts eagerly and frees itself when done
+struct detached_task {
+    struct promise_type {
+        detached_task get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+} //namespace detail
+
+//[3]
+inline auto schedule(thread_pool& pool) {
+    struct awaiter {
+        thread_pool& pool;
+        bool await_ready() noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) {
+            pool.post([h]() { h.resume(); });
+        }
+        void await_resume() noexcept {}
+    };
+    return awaiter{pool};
+}
+
+namespace detail {
+
+template <typename T>
+detached_task run_into(task<T> t, light_promise<T> prom, thread_pool* pool) {
+    try {
+        if (pool) {
+            co_await schedule(*pool);
+        }
+        if constexpr (std::is_void<T>::value) {
+            co_await std::move(t);
+            prom.set_value();
+        } else {
+            prom.set_value(co_await std::move(t));
+        }
+    } catch (...) {
+        prom.set_exception(std::current_exception());
+    }
+}
+
+} //namespace detail
+
+//[4]
+template <typename T>
+light_future<T> co_spawn(thread_pool& pool, task<T> t) {
+    light_promise<T> prom;
+    light_future<T> fu = prom.get_future();
+    detail::run_into(std::move(t), std::move(prom), &pool);
+    return fu;
+}
+
+//[4]
+template <typename T>
+T sync_wait(task<T> t) {
+    light_promise<T> prom;
+    light_future<T> fu = prom.get_future();
+    detail::run_into(std::move(t), std::move(prom), nullptr);
+    return fu.get();
+}
+
+#endif //CORO_TASK_H
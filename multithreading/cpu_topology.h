@@ -0,0 +1,172 @@
+/* README:
+ * - cpu_topology: which logical CPUs this process may run on, and how they
+ *   map to physical cores and sockets (read from sysfs).
+ * - pin_this_thread() / name_this_thread(): thread affinity and thread names.
+ *
+ * [1] std::thread::hardware_concurrency() (see 1_thread_mgmt.cpp) is only a
+ *     count. Linux describes every logical CPU N in
+ *       /sys/devices/system/cpu/cpuN/topology/
+ *         core_id, physical_package_id
+ *     Two logical CPUs with the same (package, core) are SMT siblings
+ *     (hyper-threads): they share the core's execution units and its L1/L2
+ *     caches. Only CPUs in our affinity mask (sched_getaffinity(), e.g.
+ *     restricted by taskset or a container) are listed.
+ * [2] placement(n, avoid_smt) picks the CPUs for n threads:
+ *     - one CPU per physical core first, cores of the same package next to
+ *       each other (neighbouring workers share the L3),
+ *     - then the remaining SMT siblings, unless avoid_smt is set; with
+ *       avoid_smt, threads beyond the number of cores wrap around onto the
+ *       first CPU of each core again.
+ * [3] pin_this_thread(cpu): pthread_setaffinity_np() with a single CPU. A
+ *     pinned thread is never migrated by the scheduler, so the data it has
+ *     pulled into its core's caches stays there.
+ * [4] name_this_thread(name): pthread_setname_np(). The name shows up in
+ *     top -H, perf, gdb's "info threads" and /proc/<pid>/task/<tid>/comm.
+ *     Linux limits it to 15 characters; longer names are cut.
+ * */
+
+#ifndef CPU_TOPOLOGY_H
+#define CPU_TOPOLOGY_H
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+
+//[1]
+struct cpu_info {
+    unsigned cpu = 0;           //logical CPU number, as used by CPU_SET()
+    int core = 0;               //core_id, unique within a package
+    int package = 0;            //physical_package_id (socket)
+    unsigned smt_rank = 0;      //0 for the first logical CPU of its core
+};
+
+class cpu_topology
+{
+private:
+    std::vector<cpu_info> cpus_;    //sorted by (package, core, smt_rank)
+    size_t cores_ = 0;
+
+    static bool read_int(const std::string& path, int& value) {
+        std::ifstream in(path);
+        return static_cast<bool>(in >> value);
+    }
+
+public:
+    cpu_topology() {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+            unsigned n = std::max(1u, std::thread::hardware_concurrency());
+            for (unsigned i = 0; i < n && i < CPU_SETSIZE; i++) {
+                CPU_SET(i, &allowed);
+            }
+        }
+
+        for (unsigned cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (!CPU_ISSET(cpu, &allowed)) {
+                continue;
+            }
+            std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+            cpu_info info;
+            info.cpu = cpu;
+            //no sysfs (some containers): every CPU is its own core
+            if (!read_int(dir + "core_id", info.core)) {
+                info.core = static_cast<int>(cpu);
+            }
+            if (!read_int(dir + "physical_package_id", info.package)) {
+                info.package = 0;
+            }
+            cpus_.push_back(info);
+        }
+
+        std::sort(cpus_.begin(), cpus_.end(), [](const cpu_info& a, const cpu_info& b) {
+            if (a.package != b.package) {
+                return a.package < b.package;
+            }
+            if (a.core != b.core) {
+                return a.core < b.core;
+            }
+            return a.cpu < b.cpu;
+        });
+        for (size_t i = 0; i < cpus_.size(); i++) {
+            bool same_core = i > 0 && cpus_[i].package == cpus_[i - 1].package &&
+                             cpus_[i].core == cpus_[i - 1].core;
+            cpus_[i].smt_rank = same_core ? cpus_[i - 1].smt_rank + 1 : 0;
+            if (!same_core) {
+                cores_++;
+            }
+        }
+    }
+
+    //logical CPUs we may run on
+    const std::vector<cpu_info>& cpus() const {
+        return cpus_;
+    }
+
+    size_t physical_cores() const {
+        return cores_;
+    }
+
+    //logical CPUs sharing a core with cpu, cpu included
+    std::vector<unsigned> siblings(unsigned cpu) const {
+        std::vector<unsigned> result;
+        auto it = std::find_if(cpus_.begin(), cpus_.end(),
+                               [cpu](const cpu_info& c) { return c.cpu == cpu; });
+        if (it == cpus_.end()) {
+            return result;
+        }
+        for (const cpu_info& c : cpus_) {
+            if (c.package == it->package && c.core == it->core) {
+                result.push_back(c.cpu);
+            }
+        }
+        return result;
+    }
+
+    //[2]
+    std::vector<unsigned> placement(size_t n, bool avoid_smt) const {
+        std::vector<unsigned> order;
+        for (const cpu_info& c : cpus_) {
+            if (c.smt_rank == 0) {
+                order.push_back(c.cpu);
+            }
+        }
+        if (!avoid_smt) {
+            for (const cpu_info& c : cpus_) {
+                if (c.smt_rank != 0) {
+                    order.push_back(c.cpu);
+                }
+            }
+        }
+        std::vector<unsigned> result;
+        for (size_t i = 0; i < n && !order.empty(); i++) {
+            result.push_back(order[i % order.size()]);
+        }
+        return result;
+    }
+};
+
+//[3]
+inline bool pin_this_thread(unsigned cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+//[4]
+inline bool name_this_thread(const std::string& name) {
+    return pthread_setname_np(pthread_self(), name.substr(0, 15).c_str()) == 0;
+}
+
+inline std::string this_thread_name() {
+    char buf[16] = {};
+    pthread_getname_np(pthread_self(), buf, sizeof(buf));
+    return buf;
+}
+
+#endif //CPU_TOPOLOGY_H
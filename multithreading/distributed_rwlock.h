@@ -0,0 +1,144 @@
+/* README:
+ * - distributed_rwlock: a reader-writer lock whose reader count is split
+ *   into one cache-line sized counter per core.
+ * - It meets the SharedLockable requirements (lock(), unlock(),
+ *   lock_shared(), unlock_shared(), ...), so it can be used with
+ *   lock_guard<>, unique_lock<> and shared_lock<> like std::shared_mutex.
+ *
+ * [1] std::shared_mutex keeps a single reader count. Every lock_shared() is
+ *     an atomic RMW on the same cache line, so with many readers the line
+ *     bounces between cores and readers slow each other down even though
+ *     they never block each other.
+ * [2] Here each reader increments only its own slot. A thread picks its slot
+ *     once (from the core it first runs on, see sched_getcpu()) and keeps
+ *     using it, so lock_shared()/unlock_shared() touch the same counter even
+ *     if the thread migrates in between.
+ * [3] Writer: takes writer_mu (writers are serialized), raises writer_ and
+ *     then waits until every reader slot drains to zero.
+ *     Reader: increments its slot, then checks writer_. If a writer is
+ *     active, it undoes the increment and waits for the writer to finish.
+ *     Both sides use seq_cst so that either the writer sees the reader's
+ *     increment or the reader sees writer_ (Dekker style handshake).
+ *     writer_ is 1 while a writer is active, 3 once a reader may be
+ *     parked on it; unlock() only pays for FUTEX_WAKE in the latter case
+ *     (the same trick as bit 0 of the futex words of the queues).
+ * [4] Writers are expensive (they scan all slots), so this lock is meant
+ *     for read-mostly data.
+ * */
+
+#ifndef DISTRIBUTED_RWLOCK_H
+#define DISTRIBUTED_RWLOCK_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <sched.h>
+#include "adaptive_mutex.h"
+#include "futex.h"
+
+class distributed_rwlock
+{
+private:
+    struct alignas(64) slot {
+        std::atomic<int> readers{0};
+    };
+
+    unsigned nslots_;
+    std::unique_ptr<slot[]> slots_;
+    std::atomic<uint32_t> writer_{0};     //[3] 0, 1 = active, parked = active + readers parked
+    adaptive_mutex writer_mu_;
+
+    static constexpr uint32_t parked = 3;
+
+    //[2] stable per-thread slot, chosen from the core we first ran on
+    unsigned my_slot() const {
+        static thread_local int cpu = -1;
+        if (cpu < 0) {
+            cpu = sched_getcpu();
+            if (cpu < 0) {
+                cpu = static_cast<int>(
+                    std::hash<std::thread::id>()(std::this_thread::get_id()));
+            }
+        }
+        return static_cast<unsigned>(cpu) % nslots_;
+    }
+
+    //[3] wake parked readers only if there are any
+    void release_writer() {
+        if (writer_.exchange(0, std::memory_order_release) == parked) {
+            futex_wake_all(&writer_);
+        }
+        writer_mu_.unlock();
+    }
+
+public:
+    explicit distributed_rwlock(unsigned nslots = std::thread::hardware_concurrency())
+        : nslots_(nslots ? nslots : 1), slots_(new slot[nslots_]) {}
+
+    distributed_rwlock(const distributed_rwlock&) = delete;
+    distributed_rwlock& operator=(const distributed_rwlock&) = delete;
+
+    /******** shared (reader) side ************/
+    bool try_lock_shared() {
+        slot& s = slots_[my_slot()];
+        s.readers.fetch_add(1, std::memory_order_seq_cst);
+        if (writer_.load(std::memory_order_seq_cst) == 0) {
+            return true;
+        }
+        s.readers.fetch_sub(1, std::memory_order_release);
+        return false;
+    }
+
+    void lock_shared() {
+        while (!try_lock_shared()) {
+            //wait for the writer to go away, parking if it takes long
+            int spins = 0;
+            uint32_t w;
+            while ((w = writer_.load(std::memory_order_acquire)) != 0) {
+                if (++spins < 100) {
+                    cpu_relax();
+                } else if (w == parked || writer_.compare_exchange_weak(w, parked)) {
+                    futex_wait(&writer_, parked);
+                }
+            }
+        }
+    }
+
+    void unlock_shared() {
+        slots_[my_slot()].readers.fetch_sub(1, std::memory_order_release);
+    }
+
+    /******** exclusive (writer) side ************/
+    void lock() {
+        writer_mu_.lock();
+        writer_.store(1, std::memory_order_seq_cst);
+        for (unsigned i = 0; i < nslots_; i++) {
+            while (slots_[i].readers.load(std::memory_order_seq_cst) != 0) {
+                cpu_relax();
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    bool try_lock() {
+        if (!writer_mu_.try_lock()) {
+            return false;
+        }
+        writer_.store(1, std::memory_order_seq_cst);
+        for (unsigned i = 0; i < nslots_; i++) {
+            if (slots_[i].readers.load(std::memory_order_seq_cst) != 0) {
+                release_writer();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void unlock() {
+        release_writer();
+    }
+};
+
+#endif //DISTRIBUTED_RWLOCK_H
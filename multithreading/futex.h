@@ -0,0 +1,96 @@
+/* README:
+ * - The futex and spin helpers shared by adaptive_mutex.h and the other
+ *   synchronization primitives of this directory.
+ *
+ * [1] cpu_relax(): one spin-wait hint (`pause` on x86, `yield` on ARM).
+ * [2] futex_wait()/futex_wait_for()/futex_wake(): thin wrappers of the
+ *     FUTEX_WAIT/FUTEX_WAKE syscalls on a std::atomic<uint32_t>, private to
+ *     the process.
+ * [3] futex_park()/futex_notify(): the parking handshake on an "event" word,
+ *     described below.
+ * */
+
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+//[1]
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#else
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+//[2]
+inline long futex_wait(std::atomic<uint32_t> *addr, uint32_t expected) {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr),
+                   FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+//like futex_wait(), but gives up after a relative timeout (-1, ETIMEDOUT)
+inline long futex_wait_for(std::atomic<uint32_t> *addr, uint32_t expected,
+                           std::chrono::nanoseconds timeout) {
+    struct timespec ts;
+    ts.tv_sec = static_cast<time_t>(timeout.count() / 1000000000);
+    ts.tv_nsec = static_cast<long>(timeout.count() % 1000000000);
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr),
+                   FUTEX_WAIT_PRIVATE, expected, &ts, nullptr, 0);
+}
+
+inline long futex_wake(std::atomic<uint32_t> *addr, int count) {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr),
+                   FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+inline long futex_wake_all(std::atomic<uint32_t> *addr) {
+    return futex_wake(addr, INT_MAX);
+}
+
+/* [3] Parking on an "event" word (used by the queues):
+ * - bit 0 means "somebody may be sleeping on this word", the other bits are a
+ *   wake-up counter.
+ * - futex_park(): announce the sleeper (set bit 0), re-check the condition
+ *   and sleep only if it is still false. Returns true if the re-check
+ *   succeeded, false after a wake-up (which may be spurious).
+ * - futex_notify(): called after the condition became true. It only pays for
+ *   the FUTEX_WAKE syscall when bit 0 is set, and clears it, so one notify
+ *   wakes all current sleepers and later notifies are free again.
+ * - The two seq_cst fences guarantee that either the sleeper sees the new
+ *   state or the notifier sees bit 0, so no wake-up is lost.
+ * */
+inline void futex_notify(std::atomic<uint32_t>& word) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint32_t w = word.load(std::memory_order_relaxed);
+    if ((w & 1) && word.compare_exchange_strong(w, (w + 2) & ~1u)) {
+        futex_wake_all(&word);
+    }
+}
+
+template <typename Try>
+bool futex_park(std::atomic<uint32_t>& word, Try try_again) {
+    uint32_t e = word.fetch_or(1, std::memory_order_relaxed) | 1;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (try_again()) {
+        return true;
+    }
+    futex_wait(&word, e);
+    return false;
+}
+
+#endif //FUTEX_H
@@ -0,0 +1,142 @@
+/* README:
+ * - latency_histogram: a lock-free histogram of durations with power-of-two
+ *   buckets, cheap enough to record every task.
+ *
+ * [1] Bucket b counts durations d (in nanoseconds) with 2^(b-1) <= d < 2^b
+ *     (bucket 0 is d == 0; the last bucket also takes anything longer).
+ *     Finding the bucket is one count-leading-zeros instruction.
+ * [2] record() is a handful of relaxed atomic operations: no lock, no
+ *     allocation. Readers may see a record() half done (count already
+ *     incremented, sum not yet), which is fine for statistics.
+ *     record_owned() is for a histogram only one thread ever records into
+ *     (e.g. one per worker): plain loads and stores, no locked instructions.
+ * [3] snapshot() copies the counters into a plain histogram_snapshot that
+ *     can be added up (e.g. over workers) and queried:
+ *     percentile(0.99) returns the upper bound of the bucket holding the
+ *     99th percentile, so it is exact to within a factor of 2.
+ * */
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+//[3]
+struct histogram_snapshot {
+    static constexpr size_t buckets = 64;
+
+    std::array<uint64_t, buckets> counts{};
+    uint64_t count = 0;
+    uint64_t sum_ns = 0;
+    uint64_t max_ns = 0;
+
+    histogram_snapshot& operator+=(const histogram_snapshot& other) {
+        for (size_t b = 0; b < buckets; b++) {
+            counts[b] += other.counts[b];
+        }
+        count += other.count;
+        sum_ns += other.sum_ns;
+        if (other.max_ns > max_ns) {
+            max_ns = other.max_ns;
+        }
+        return *this;
+    }
+
+    double mean_ns() const {
+        return count ? double(sum_ns) / count : 0.0;
+    }
+
+    //upper bound (ns) of the bucket holding the p-th fraction of samples
+    uint64_t percentile(double p) const {
+        uint64_t total = 0;
+        for (uint64_t c : counts) {
+            total += c;
+        }
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(p * (total - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t b = 0; b < buckets; b++) {
+            seen += counts[b];
+            if (seen >= rank) {
+                uint64_t upper = b == 0 ? 0 : (uint64_t(1) << b) - 1;
+                return upper < max_ns ? upper : max_ns;
+            }
+        }
+        return max_ns;
+    }
+};
+
+//"n=.. mean=..us p50<=..us p99<=..us max=..us"
+inline std::ostream& operator<<(std::ostream& out, const histogram_snapshot& h) {
+    return out << "n=" << h.count
+               << " mean=" << h.mean_ns() / 1000 << "us"
+               << " p50<=" << h.percentile(0.50) / 1000.0 << "us"
+               << " p99<=" << h.percentile(0.99) / 1000.0 << "us"
+               << " max=" << h.max_ns / 1000.0 << "us";
+}
+
+class latency_histogram
+{
+private:
+    std::array<std::atomic<uint64_t>, histogram_snapshot::buckets> counts_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_ns_{0};
+    std::atomic<uint64_t> max_ns_{0};
+
+    //[1]
+    static size_t bucket(uint64_t ns) {
+        return ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+    }
+
+public:
+    //[2]
+    void record(uint64_t ns) {
+        size_t b = bucket(ns);
+        counts_[b < histogram_snapshot::buckets ? b : histogram_snapshot::buckets - 1]
+            .fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+        uint64_t m = max_ns_.load(std::memory_order_relaxed);
+        while (ns > m && !max_ns_.compare_exchange_weak(m, ns, std::memory_order_relaxed)) {
+        }
+    }
+
+    //[2] single writer
+    void record_owned(uint64_t ns) {
+        size_t b = bucket(ns);
+        auto& c = counts_[b < histogram_snapshot::buckets ? b : histogram_snapshot::buckets - 1];
+        c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        count_.store(count_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        sum_ns_.store(sum_ns_.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+        if (ns > max_ns_.load(std::memory_order_relaxed)) {
+            max_ns_.store(ns, std::memory_order_relaxed);
+        }
+    }
+
+    template <typename Rep, typename Period>
+    void record(std::chrono::duration<Rep, Period> d) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+        record(static_cast<uint64_t>(ns > 0 ? ns : 0));
+    }
+
+    //[3]
+    histogram_snapshot snapshot() const {
+        histogram_snapshot s;
+        for (size_t b = 0; b < histogram_snapshot::buckets; b++) {
+            s.counts[b] = counts_[b].load(std::memory_order_relaxed);
+        }
+        s.count = count_.load(std::memory_order_relaxed);
+        s.sum_ns = sum_ns_.load(std::memory_order_relaxed);
+        s.max_ns = max_ns_.load(std::memory_order_relaxed);
+        return s;
+    }
+};
+
+#endif //LATENCY_HISTOGRAM_H
@@ -0,0 +1,446 @@
+/* README:
+ * - light_promise<T> / light_future<T>: a minimal promise/future pair whose
+ *   shared state does not go through malloc in steady state.
+ *
+ * [1] std::promise/std::future (and std::packaged_task) allocate a shared
+ *     state on the heap for every value they transfer. Here the shared state
+ *     is a recycled<> object (see recycled.h): freed states are kept in a
+ *     cache and reused by the next promise.
+ * [2] The state holds a std::variant of "not set", the value, or an
+ *     exception_ptr, a reference count (one for the promise, one for the
+ *     future) and a futex word used to sleep in wait():
+ *       0 = not ready, 1 = ready, 2 = not ready and somebody is waiting
+ *     set_value() only pays for FUTEX_WAKE if the word was 2.
+ * [3] Destroying a promise that was never satisfied stores
+ *     std::future_error(broken_promise), like std::promise.
+ * [4] wait_for(d) returns std::future_status like std::future, so
+ *     thread_pool::wait(fu) accepts both kinds of futures. It sleeps on the
+ *     futex word with a timeout, so a caller can give up on a result (and
+ *     cancel the work, see cancellation.h) after d.
+ * [5] Continuations: instead of blocking in get(), attach the next step.
+ *     - on_ready(f): runs f inline on the thread that makes the future ready
+ *       (or right away if it already is). The state keeps at most one
+ *       continuation; cont_mu orders on_ready() against set_value().
+ *     - std::move(fu).then(f) / then(executor, f): when fu is ready, posts
+ *       f(value) to the executor (default_pool() from async_pool.h, or any
+ *       object with post()) and returns the light_future of f's result. If
+ *       fu holds an exception, f is skipped and the exception is passed on.
+ *     - when_all(futures) / when_any(futures): see below.
+ *     No thread ever sleeps waiting for a dependency: each step is queued
+ *     only once its inputs are ready.
+ * */
+
+#ifndef LIGHT_FUTURE_H
+#define LIGHT_FUTURE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+#include "adaptive_mutex.h"
+#include "futex.h"
+#include "recycled.h"
+#include "unique_function.h"
+
+template <typename T>
+class light_future;
+
+template <typename T>
+class light_promise;
+
+//defined in async_pool.h, used by light_future::then(f)
+class thread_pool;
+inline thread_pool& default_pool();
+
+namespace detail {
+
+template <typename T>
+using stored_t = std::conditional_t<std::is_void<T>::value, std::monostate, T>;
+
+//[2]
+template <typename T>
+struct light_state : recycled<light_state<T>>
+{
+    std::atomic<uint32_t> word{0};
+    std::atomic<int> refs{2};
+    std::variant<std::monostate, stored_t<T>, std::exception_ptr> result;
+    adaptive_mutex cont_mu;                 //[5]
+    unique_function<void()> continuation;
+
+    void release() {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+
+    void mark_ready() {
+        unique_function<void()> cont;
+        uint32_t old;
+        {
+            std::lock_guard<adaptive_mutex> locker(cont_mu);
+            old = word.exchange(1, std::memory_order_release);
+            cont = std::move(continuation);
+        }
+        if (old == 2) {
+            futex_wake_all(&word);
+        }
+        if (cont) {
+            cont();
+        }
+    }
+
+    //[5]
+    void set_continuation(unique_function<void()>&& f) {
+        {
+            std::lock_guard<adaptive_mutex> locker(cont_mu);
+            if (!is_ready()) {
+                continuation = std::move(f);
+                return;
+            }
+        }
+        f();
+    }
+
+    bool is_ready() const {
+        return word.load(std::memory_order_acquire) == 1;
+    }
+
+    //[4] false on timeout
+    bool wait_until(std::chrono::steady_clock::time_point deadline) {
+        uint32_t s = word.load(std::memory_order_acquire);
+        while (s != 1) {
+            //check first: a zero timeout (polling) must not announce a waiter
+            auto left = deadline - std::chrono::steady_clock::now();
+            if (left <= std::chrono::steady_clock::duration::zero()) {
+                return false;
+            }
+            if (s == 0 && !word.compare_exchange_weak(s, 2, std::memory_order_acquire)) {
+                continue;
+            }
+            futex_wait_for(&word, 2, left);
+            s = word.load(std::memory_order_acquire);
+        }
+        return true;
+    }
+
+    void wait() {
+        uint32_t s = word.load(std::memory_order_acquire);
+        while (s != 1) {
+            if (s == 0 && !word.compare_exchange_weak(s, 2, std::memory_order_acquire)) {
+                continue;
+            }
+            futex_wait(&word, 2);
+            s = word.load(std::memory_order_acquire);
+        }
+    }
+};
+
+} //namespace detail
+
+template <typename T>
+class light_promise
+{
+private:
+    detail::light_state<T>* state_;
+    bool future_taken_ = false;
+
+    void check() const {
+        if (!state_) {
+            throw std::future_error(std::future_errc::no_state);
+        }
+        if (state_->result.index() != 0) {
+            throw std::future_error(std::future_errc::promise_already_satisfied);
+        }
+    }
+
+public:
+    light_promise() : state_(new detail::light_state<T>) {}
+
+    light_promise(light_promise&& other) noexcept
+        : state_(std::exchange(other.state_, nullptr)),
+          future_taken_(other.future_taken_) {}
+
+    light_promise& operator=(light_promise&& other) noexcept {
+        if (this != &other) {
+            this->~light_promise();
+            state_ = std::exchange(other.state_, nullptr);
+            future_taken_ = other.future_taken_;
+        }
+        return *this;
+    }
+
+    ~light_promise() {
+        if (!state_) {
+            return;
+        }
+        if (state_->result.index() == 0) {   //[3]
+            state_->result.template emplace<2>(std::make_exception_ptr(
+                std::future_error(std::future_errc::broken_promise)));
+            state_->mark_ready();
+        }
+        if (!future_taken_) {
+            state_->release();  //nobody will ever hold the future's reference
+        }
+        state_->release();
+    }
+
+    light_future<T> get_future() {
+        if (!state_) {
+            throw std::future_error(std::future_errc::no_state);
+        }
+        if (future_taken_) {
+            throw std::future_error(std::future_errc::future_already_retrieved);
+        }
+        future_taken_ = true;
+        return light_future<T>(state_);
+    }
+
+    template <typename U = T, typename = std::enable_if_t<!std::is_void<U>::value>>
+    void set_value(U value) {
+        check();
+        state_->result.template emplace<1>(std::move(value));
+        state_->mark_ready();
+    }
+
+    template <typename U = T, typename = std::enable_if_t<std::is_void<U>::value>>
+    void set_value() {
+        check();
+        state_->result.template emplace<1>();
+        state_->mark_ready();
+    }
+
+    void set_exception(std::exception_ptr e) {
+        check();
+        state_->result.template emplace<2>(std::move(e));
+        state_->mark_ready();
+    }
+};
+
+template <typename T>
+class light_future
+{
+private:
+    detail::light_state<T>* state_ = nullptr;
+
+    friend class light_promise<T>;
+    explicit light_future(detail::light_state<T>* s) : state_(s) {}
+
+    //f(value) for T, f() for void
+    template <typename F>
+    static auto apply(F& f, light_future& fu) {
+        if constexpr (std::is_void<T>::value) {
+            fu.get();
+            return f();
+        } else {
+            return f(fu.get());
+        }
+    }
+
+    template <typename F>
+    using then_result_t = decltype(apply(std::declval<F&>(), std::declval<light_future&>()));
+
+public:
+    light_future() = default;
+
+    light_future(light_future&& other) noexcept
+        : state_(std::exchange(other.state_, nullptr)) {}
+
+    light_future& operator=(light_future&& other) noexcept {
+        if (this != &other) {
+            if (state_) {
+                state_->release();
+            }
+            state_ = std::exchange(other.state_, nullptr);
+        }
+        return *this;
+    }
+
+    ~light_future() {
+        if (state_) {
+            state_->release();
+        }
+    }
+
+    bool valid() const {
+        return state_ != nullptr;
+    }
+
+    bool is_ready() const {
+        return state_ && state_->is_ready();
+    }
+
+    void wait() const {
+        state_->wait();
+    }
+
+    //[4]
+    template <typename Rep, typename Period>
+    std::future_status wait_for(const std::chrono::duration<Rep, Period>& d) const {
+        if (state_->is_ready()) {
+            return std::future_status::ready;
+        }
+        auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::duration_cast<std::chrono::steady_clock::duration>(d);
+        return state_->wait_until(deadline) ? std::future_status::ready
+                                            : std::future_status::timeout;
+    }
+
+    //[5] f runs inline once the future is ready; the future stays valid
+    void on_ready(unique_function<void()> f) {
+        if (!state_) {
+            throw std::future_error(std::future_errc::no_state);
+        }
+        state_->set_continuation(std::move(f));
+    }
+
+    //[5] consumes the future
+    template <typename Executor, typename F>
+    auto then(Executor& ex, F&& f) && -> light_future<then_result_t<std::decay_t<F>>> {
+        using R = then_result_t<std::decay_t<F>>;
+
+        light_promise<R> prom;
+        light_future<R> next = prom.get_future();
+        detail::light_state<T>* s = state_;
+        s->set_continuation(
+            [&ex, self = std::move(*this), prom = std::move(prom), f = std::forward<F>(f)]() mutable {
+                ex.post([self = std::move(self), prom = std::move(prom), f = std::move(f)]() mutable {
+                    try {
+                        if constexpr (std::is_void<R>::value) {
+                            apply(f, self);
+                            prom.set_value();
+                        } else {
+                            prom.set_value(apply(f, self));
+                        }
+                    } catch (...) {
+                        prom.set_exception(std::current_exception());
+                    }
+                });
+            });
+        return next;
+    }
+
+    template <typename F>
+    auto then(F&& f) && {
+        return std::move(*this).then(default_pool(), std::forward<F>(f));
+    }
+
+    //like std::future::get(): may be called once, invalidates the future
+    T get() {
+        if (!state_) {
+            throw std::future_error(std::future_errc::no_state);
+        }
+        state_->wait();
+        detail::light_state<T>* s = std::exchange(state_, nullptr);
+
+        if (s->result.index() == 2) {
+            std::exception_ptr e = std::get<2>(s->result);
+            s->release();
+            std::rethrow_exception(e);
+        }
+        if constexpr (std::is_void<T>::value) {
+            s->release();
+        } else {
+            T value = std::move(std::get<1>(s->result));
+            s->release();
+            return value;
+        }
+    }
+};
+
+/* [5] when_all(futures): a future that becomes ready when every input is
+ *     ready, holding the (ready) input futures in their original order.
+ *     Each input's on_ready() decrements a shared counter; the last one sets
+ *     the result. Nothing blocks and nothing is scheduled.
+ * */
+template <typename T>
+light_future<std::vector<light_future<T>>> when_all(std::vector<light_future<T>> futures)
+{
+    struct control {
+        std::vector<light_future<T>> futures;
+        std::atomic<size_t> remaining;
+        light_promise<std::vector<light_future<T>>> prom;
+    };
+
+    auto ctrl = std::make_shared<control>();
+    auto result = ctrl->prom.get_future();
+    ctrl->futures = std::move(futures);
+    ctrl->remaining.store(ctrl->futures.size() + 1, std::memory_order_relaxed);
+
+    auto arrive = [](const std::shared_ptr<control>& c) {
+        if (c->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            c->prom.set_value(std::move(c->futures));
+        }
+    };
+    for (auto& fu : ctrl->futures) {
+        fu.on_ready([ctrl, arrive]() { arrive(ctrl); });
+    }
+    arrive(ctrl);   //the extra count keeps an empty input from finishing early
+    return result;
+}
+
+/* [5] when_any(futures): ready as soon as one input is ready. The result
+ *     tells which one (index) and gives back all the input futures. With
+ *     no input at all it is ready at once, with index == size_t(-1).
+ * */
+template <typename T>
+struct when_any_result {
+    size_t index;
+    std::vector<light_future<T>> futures;
+};
+
+template <typename T>
+light_future<when_any_result<T>> when_any(std::vector<light_future<T>> futures)
+{
+    /* The futures may only be moved into the result once we are done
+     * attaching continuations to them. So two events have to happen, the
+     * first input becoming ready and the attach loop finishing; whichever
+     * comes second sets the result.
+     * */
+    if (futures.empty()) {
+        light_promise<when_any_result<T>> prom;
+        auto result = prom.get_future();
+        prom.set_value(when_any_result<T>{size_t(-1), std::move(futures)});
+        return result;
+    }
+
+    struct control {
+        std::vector<light_future<T>> futures;
+        std::atomic<bool> done{false};
+        std::atomic<size_t> index{0};
+        std::atomic<int> pending{2};
+        light_promise<when_any_result<T>> prom;
+
+        void arrive() {
+            if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                prom.set_value(when_any_result<T>{index.load(std::memory_order_relaxed),
+                                                  std::move(futures)});
+            }
+        }
+    };
+
+    auto ctrl = std::make_shared<control>();
+    auto result = ctrl->prom.get_future();
+    ctrl->futures = std::move(futures);
+
+    for (size_t i = 0; i < ctrl->futures.size(); i++) {
+        ctrl->futures[i].on_ready([ctrl, i]() {
+            if (!ctrl->done.exchange(true, std::memory_order_acq_rel)) {
+                ctrl->index.store(i, std::memory_order_relaxed);
+                ctrl->arrive();
+            }
+        });
+        if (ctrl->done.load(std::memory_order_acquire)) {
+            break;  //already have a winner, no need to attach the rest
+        }
+    }
+    ctrl->arrive();
+    return result;
+}
+
+#endif //LIGHT_FUTURE_H
@@ -0,0 +1,162 @@
+/* README:
+ * - mpmc_queue<T>: a bounded, lock-free, multi-producer multi-consumer ring
+ *   queue (D. Vyukov's bounded MPMC queue) with blocking push()/pop().
+ *
+ * [1] The ring has a power-of-two number of cells. Each cell carries a
+ *     sequence number that tells whether it is ready to be written (seq ==
+ *     pos) or ready to be read (seq == pos + 1). Producers claim a position
+ *     with a CAS on enqueue_pos_, consumers on dequeue_pos_; no mutex is
+ *     ever taken.
+ * [2] enqueue_pos_, dequeue_pos_ and every cell live on their own cache line
+ *     (alignas(64)), so producers and consumers do not false-share.
+ * [3] try_push()/try_pop() never block. push()/pop() spin briefly and then
+ *     park on a futex, but only when the queue is full/empty. A producer
+ *     only pays the FUTEX_WAKE syscall if some consumer is actually parked
+ *     (and vice versa), so in steady state there are no syscalls at all.
+ * [4] Parking handshake (consumer side, producer side is symmetric, see
+ *     futex_park()/futex_notify() in futex.h). Bit 0 of the futex
+ *     word means "somebody may be sleeping here", the other bits are a
+ *     wake-up counter:
+ *       consumer: e = not_empty_.fetch_or(1) | 1; fence; try_pop() again;
+ *                 futex_wait(not_empty_, e)
+ *       producer: publish cell; fence; if (not_empty_ & 1) {
+ *                 clear bit 0 and bump the counter; wake all sleepers }
+ *     The two seq_cst fences guarantee that either the consumer sees the new
+ *     element or the producer sees bit 0, so no wake-up is lost. Clearing the
+ *     bit means only the first push after the queue ran dry pays for the
+ *     syscall; the woken threads set the bit again if they have to sleep.
+ * */
+
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include "futex.h"
+
+template <typename T>
+class mpmc_queue
+{
+private:
+    struct alignas(64) cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    //[2]
+    alignas(64) std::atomic<size_t> enqueue_pos_{0};
+    alignas(64) std::atomic<size_t> dequeue_pos_{0};
+
+    //[3][4] futex words
+    alignas(64) std::atomic<uint32_t> not_empty_{0};
+    alignas(64) std::atomic<uint32_t> not_full_{0};
+
+    alignas(64) size_t mask_;
+    std::unique_ptr<cell[]> cells_;
+
+    static constexpr int spin_count = 64;
+
+public:
+    explicit mpmc_queue(size_t capacity) : mask_(capacity - 1), cells_(new cell[capacity]) {
+        if (capacity < 2 || (capacity & (capacity - 1)) != 0) {
+            throw std::invalid_argument("mpmc_queue capacity must be a power of two");
+        }
+        for (size_t i = 0; i < capacity; i++) {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    mpmc_queue(const mpmc_queue&) = delete;
+    mpmc_queue& operator=(const mpmc_queue&) = delete;
+
+    size_t capacity() const {
+        return mask_ + 1;
+    }
+
+    //[1]
+    bool try_push(T& value) {
+        cell* c;
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            c = &cells_[pos & mask_];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;   //full
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        c->data = std::move(value);
+        c->seq.store(pos + 1, std::memory_order_release);
+        futex_notify(not_empty_);
+        return true;
+    }
+
+    bool try_pop(T& value) {
+        cell* c;
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            c = &cells_[pos & mask_];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;   //empty
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        value = std::move(c->data);
+        c->seq.store(pos + mask_ + 1, std::memory_order_release);
+        futex_notify(not_full_);
+        return true;
+    }
+
+    //[3] blocks only while the queue is full
+    void push(T value) {
+        for (int i = 0; i < spin_count; i++) {
+            if (try_push(value)) {
+                return;
+            }
+            cpu_relax();
+        }
+        //[4]
+        while (!futex_park(not_full_, [&]() { return try_push(value); })) {
+            if (try_push(value)) {
+                return;
+            }
+        }
+    }
+
+    //[3] blocks only while the queue is empty
+    T pop() {
+        T value;
+        for (int i = 0; i < spin_count; i++) {
+            if (try_pop(value)) {
+                return value;
+            }
+            cpu_relax();
+        }
+        //[4]
+        while (!futex_park(not_empty_, [&]() { return try_pop(value); })) {
+            if (try_pop(value)) {
+                return value;
+            }
+        }
+        return value;
+    }
+};
+
+#endif //MPMC_QUEUE_H
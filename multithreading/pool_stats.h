@@ -0,0 +1,252 @@
+/* README:
+ * - Instrumentation for thread_pool (see thread_pool_options::stats):
+ *   per-worker counters and histograms, a snapshot API and a periodic text
+ *   dump.
+ *
+ * [1] What is measured, per worker:
+ *     - tasks taken from its own deque, from the inject queue, and stolen
+ *       from other workers; steal sweeps that found nothing
+ *     - parks (times it went to sleep) and idle time (time spent asleep)
+ *     - queue latency: enqueue -> start of execution
+ *     - run time of the task
+ *     - queue depth seen when a task is dequeued (own deque + inject queue)
+ * [2] Keeping it cheap:
+ *     - every worker writes only its own worker_stats, so counters are
+ *       relaxed load + store (no locked instructions) and never shared
+ *       between cores while the pool runs; readers just load them.
+ *     - timestamps come from the CPU's time stamp counter (rdtsc, ~25
+ *       cycles) instead of steady_clock, converted to ns with a ratio
+ *       calibrated once per process.
+ *     - every task is counted by source (local, injected, stolen): one
+ *       relaxed store on a counter the worker owns, nothing next to the
+ *       steal CAS. Only the timing is *sampled*: every
+ *       stats_sample_every-th task (16 by default) is stamped at enqueue
+ *       and goes into the histograms. All counters are exact; the
+ *       histograms hold one task in stats_sample_every.
+ * [3] pool.stats() returns a pool_stats_snapshot: a plain copy of every
+ *     worker's numbers, plus total() over all workers; operator<< prints it
+ *     as a table. periodic_dump(pool, period, out) prints one every period
+ *     from a background thread until it is destroyed.
+ * */
+
+#ifndef POOL_STATS_H
+#define POOL_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "latency_histogram.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace detail {
+
+//[2]
+inline uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+inline double ns_per_tick() {
+    static const double ratio = []() {
+        auto t0 = std::chrono::steady_clock::now();
+        uint64_t c0 = ticks();
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        auto t1 = std::chrono::steady_clock::now();
+        uint64_t c1 = ticks();
+        double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+        return c1 > c0 ? ns / double(c1 - c0) : 1.0;
+    }();
+    return ratio;
+}
+
+inline uint64_t ticks_to_ns(uint64_t t) {
+    return static_cast<uint64_t>(double(t) * ns_per_tick());
+}
+
+} //namespace detail
+
+struct worker_stats_snapshot {
+    uint64_t local = 0;         //tasks from its own deque
+    uint64_t injected = 0;      //tasks from the inject queue
+    uint64_t stolen = 0;        //tasks stolen from other workers
+    uint64_t steal_misses = 0;  //sweeps over all queues that found nothing
+    uint64_t parks = 0;
+    uint64_t idle_ns = 0;
+    uint64_t uptime_ns = 0;
+    histogram_snapshot queue_latency;
+    histogram_snapshot run_time;
+    histogram_snapshot queue_depth;     //values are task counts, not ns
+
+    uint64_t tasks() const {
+        return local + injected + stolen;
+    }
+
+    double idle_fraction() const {
+        return uptime_ns ? double(idle_ns) / uptime_ns : 0.0;
+    }
+
+    worker_stats_snapshot& operator+=(const worker_stats_snapshot& o) {
+        local += o.local;
+        injected += o.injected;
+        stolen += o.stolen;
+        steal_misses += o.steal_misses;
+        parks += o.parks;
+        idle_ns += o.idle_ns;
+        uptime_ns += o.uptime_ns;
+        queue_latency += o.queue_latency;
+        run_time += o.run_time;
+        queue_depth += o.queue_depth;
+        return *this;
+    }
+};
+
+//[3]
+struct pool_stats_snapshot {
+    std::vector<worker_stats_snapshot> workers;
+    size_t queued = 0;      //tasks waiting right now, all queues
+
+    worker_stats_snapshot total() const {
+        worker_stats_snapshot t;
+        for (const auto& w : workers) {
+            t += w;
+        }
+        return t;
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& out, const pool_stats_snapshot& s) {
+    auto row = [&out](const std::string& name, const worker_stats_snapshot& w) {
+        out << std::setw(7) << name
+            << std::setw(10) << w.tasks()
+            << std::setw(9) << w.local
+            << std::setw(9) << w.injected
+            << std::setw(9) << w.stolen
+            << std::setw(8) << w.steal_misses
+            << std::setw(7) << w.parks
+            << std::setw(6) << std::fixed << std::setprecision(0) << w.idle_fraction() * 100 << "%"
+            << std::setw(9) << std::setprecision(1) << w.queue_latency.percentile(0.5) / 1000.0
+            << std::setw(9) << w.queue_latency.percentile(0.99) / 1000.0
+            << std::setw(9) << w.run_time.percentile(0.5) / 1000.0
+            << std::setw(9) << w.run_time.percentile(0.99) / 1000.0
+            << std::setw(7) << w.queue_depth.percentile(0.99)
+            << std::defaultfloat << std::setprecision(6) << "\n";
+    };
+    out << "queued now: " << s.queued << "\n"
+        << std::setw(7) << "worker" << std::setw(10) << "tasks" << std::setw(9) << "local"
+        << std::setw(9) << "inject" << std::setw(9) << "stolen" << std::setw(8) << "misses"
+        << std::setw(7) << "parks" << std::setw(7) << "idle"
+        << std::setw(9) << "wait50" << std::setw(9) << "wait99"
+        << std::setw(9) << "run50" << std::setw(9) << "run99"
+        << std::setw(7) << "dep99" << "   (times in us, sampled)\n";
+    for (size_t i = 0; i < s.workers.size(); i++) {
+        row(std::to_string(i), s.workers[i]);
+    }
+    row("all", s.total());
+    return out;
+}
+
+//[1] owned and written by one worker; snapshot() may be called from anywhere
+class worker_stats
+{
+private:
+    std::atomic<uint64_t> local_{0}, injected_{0}, stolen_{0};
+    std::atomic<uint64_t> steal_misses_{0}, parks_{0}, idle_ticks_{0};
+    std::atomic<uint64_t> start_ticks_{0};
+
+    static void bump(std::atomic<uint64_t>& c, uint64_t n = 1) {
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+public:
+    latency_histogram queue_latency;
+    latency_histogram run_time;
+    latency_histogram queue_depth;
+
+    enum source { from_local, from_inject, from_steal };
+
+    void start() {
+        start_ticks_.store(detail::ticks(), std::memory_order_relaxed);
+    }
+
+    void took(source s) {
+        bump(s == from_local ? local_ : s == from_inject ? injected_ : stolen_);
+    }
+
+    void missed() {
+        bump(steal_misses_);
+    }
+
+    void parked(uint64_t ticks) {
+        bump(parks_);
+        bump(idle_ticks_, ticks);
+    }
+
+    worker_stats_snapshot snapshot() const {
+        worker_stats_snapshot s;
+        s.local = local_.load(std::memory_order_relaxed);
+        s.injected = injected_.load(std::memory_order_relaxed);
+        s.stolen = stolen_.load(std::memory_order_relaxed);
+        s.steal_misses = steal_misses_.load(std::memory_order_relaxed);
+        s.parks = parks_.load(std::memory_order_relaxed);
+        s.idle_ns = detail::ticks_to_ns(idle_ticks_.load(std::memory_order_relaxed));
+        uint64_t start = start_ticks_.load(std::memory_order_relaxed);
+        s.uptime_ns = start ? detail::ticks_to_ns(detail::ticks() - start) : 0;
+        s.queue_latency = queue_latency.snapshot();
+        s.run_time = run_time.snapshot();
+        s.queue_depth = queue_depth.snapshot();
+        return s;
+    }
+};
+
+//[3] prints pool.stats() to out every period, from its own thread
+template <typename Pool>
+class periodic_dump
+{
+private:
+    Pool& pool;
+    std::chrono::milliseconds period;
+    std::ostream& out;
+    std::mutex mu;
+    std::condition_variable cond;
+    bool stop = false;
+    std::thread th;
+
+    void run() {
+        std::unique_lock<std::mutex> locker(mu);
+        while (!cond.wait_for(locker, period, [this]() { return stop; })) {
+            out << pool.stats() << std::flush;
+        }
+    }
+
+public:
+    periodic_dump(Pool& p, std::chrono::milliseconds every, std::ostream& o)
+        : pool(p), period(every), out(o), th(&periodic_dump::run, this) {}
+
+    ~periodic_dump() {
+        {
+            std::lock_guard<std::mutex> locker(mu);
+            stop = true;
+        }
+        cond.notify_one();
+        th.join();
+    }
+
+    periodic_dump(const periodic_dump&) = delete;
+    periodic_dump& operator=(const periodic_dump&) = delete;
+};
+
+#endif //POOL_STATS_H
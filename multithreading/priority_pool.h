@@ -0,0 +1,437 @@
+/* README:
+ * - priority_pool: a thread pool whose queue is not FIFO. Tasks carry a
+ *   priority (and a deadline), and idle workers pick the most urgent one.
+ *
+ * [1] task_q in 9_packaged_task.cpp (and the inject queue of thread_pool)
+ *     is FIFO: a short, latency-sensitive task submitted behind 1000 batch
+ *     jobs waits for all of them. The queue policy decides what runs next:
+ *     - schedule_policy::fifo: one lane, arrival order (the baseline).
+ *     - schedule_policy::lanes: one FIFO lane per priority (high, normal,
+ *       low); a worker always takes from the highest non-empty lane.
+ *     - schedule_policy::edf: earliest deadline first, a min-heap ordered by
+ *       deadline. submit(p, f) gives the task the deadline
+ *       now + budget[p] (1ms / 10ms / 100ms by default); submit_by(deadline,
+ *       f) sets it explicitly.
+ * [2] Starvation protection. With strict lanes, a steady stream of high
+ *     priority work means low priority work never runs. So before taking
+ *     from the highest lane, a worker checks the oldest task of each lower
+ *     lane: if it has been waiting longer than starvation_limit, it runs
+ *     first (aging). Starving tasks get at most every other pick, so a
+ *     backlog of old low priority work cannot in turn starve the high lane.
+ *     EDF needs no extra rule: a low priority task's deadline eventually
+ *     becomes the earliest one.
+ * [3] For every priority the pool records the queue latency (enqueue ->
+ *     start of execution) in a latency_histogram (see latency_histogram.h)
+ *     and counts the tasks that started after their deadline:
+ *       pool.queue_latency(priority::high).percentile(0.99)
+ *       pool.deadline_misses(priority::high)
+ * [4] Like thread_pool: tasks are recycled job nodes holding a
+ *     unique_function, submit() returns a light_future, shutdown() (and
+ *     the destructor) runs everything already queued and joins the workers.
+ *     The queue itself is the deque + mutex + condition_variable of
+ *     7_condition_variable.cpp, notifying only when a worker is asleep.
+ * [5] Cancellation (see cancellation.h): submit(token, p, f) registers a
+ *     cancellation_callback for the queued task. When the token is
+ *     cancelled, the callback (on the cancelling thread) takes the task out
+ *     of the count of queued tasks, destroys its closure and sets
+ *     operation_cancelled on its future, all before cancel() returns. What
+ *     stays in the lane is an empty node that workers throw away. A task
+ *     that has already started is not interrupted; it sees the token
+ *     itself if it captured it.
+ * [6] max_queued bounds the queue: submit() blocks while max_queued tasks
+ *     are waiting (backpressure). Cancelled tasks stop counting at once
+ *     [5], so cancelling a batch immediately lets blocked submitters in.
+ * */
+
+#ifndef PRIORITY_POOL_H
+#define PRIORITY_POOL_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#include "cancellation.h"
+#include "cpu_topology.h"
+#include "latency_histogram.h"
+#include "light_future.h"
+#include "recycled.h"
+#include "unique_function.h"
+
+enum class priority { high = 0, normal = 1, low = 2 };
+constexpr size_t priority_levels = 3;
+
+//[1]
+enum class schedule_policy { fifo, lanes, edf };
+
+struct priority_pool_options {
+    unsigned threads = std::thread::hardware_concurrency();
+    schedule_policy policy = schedule_policy::lanes;
+    //[2] 0 turns aging off
+    std::chrono::steady_clock::duration starvation_limit = std::chrono::milliseconds(50);
+    //[1] EDF deadline of submit(p, f) is now + budget[p]
+    std::array<std::chrono::steady_clock::duration, priority_levels> budget{
+        std::chrono::milliseconds(1), std::chrono::milliseconds(10), std::chrono::milliseconds(100)};
+    size_t max_queued = 0;      //[6] 0: unbounded
+    std::string name = "prio";
+};
+
+class priority_pool
+{
+private:
+    using clock = std::chrono::steady_clock;
+
+    enum class job_state { pending, queued, running, cancelled };
+
+    struct job_node : recycled<job_node> {
+        unique_function<void(bool)> fn;     //fn(true): only report operation_cancelled
+        priority prio;
+        clock::time_point enqueued;
+        clock::time_point deadline;
+        uint64_t seq;           //FIFO order among equal deadlines
+        job_state state = job_state::pending;
+        std::optional<cancellation_callback> on_cancel;     //[5]
+    };
+    using job = job_node*;
+
+    struct later_deadline {
+        bool operator()(job a, job b) const {
+            if (a->deadline != b->deadline) {
+                return a->deadline > b->deadline;
+            }
+            return a->seq > b->seq;
+        }
+    };
+
+    priority_pool_options opts_;
+    std::mutex mu;
+    std::condition_variable cond;
+    std::condition_variable not_full;   //[6]
+    int waiters = 0;
+    int full_waiters = 0;
+    bool stop = false;
+    uint64_t next_seq = 0;
+    size_t queued = 0;          //live tasks, without cancelled ones [5]
+    uint64_t cancelled_ = 0;
+    bool aged_last = false;     //[2] the previous pick was a starving task
+
+    std::array<std::deque<job>, priority_levels> lanes_;          //fifo uses lanes_[0]
+    std::priority_queue<job, std::vector<job>, later_deadline> edf_;
+
+    std::array<latency_histogram, priority_levels> latency_;      //[3]
+    std::array<std::atomic<uint64_t>, priority_levels> misses_{};
+    std::vector<std::thread> workers;
+
+    static size_t lane(priority p) {
+        return static_cast<size_t>(p);
+    }
+
+    //called with mu held
+    void push_locked(job j) {
+        switch (opts_.policy) {
+        case schedule_policy::fifo:
+            lanes_[0].push_back(j);
+            break;
+        case schedule_policy::lanes:
+            lanes_[lane(j->prio)].push_back(j);
+            break;
+        case schedule_policy::edf:
+            edf_.push(j);
+            break;
+        }
+        queued++;
+    }
+
+    //[5] called with mu held: moves cancelled nodes off the fronts of the
+    //lanes (and the top of the heap) into dead, to be deleted without mu
+    void purge_locked(std::vector<job>& dead) {
+        for (auto& l : lanes_) {
+            while (!l.empty() && l.front()->state == job_state::cancelled) {
+                dead.push_back(l.front());
+                l.pop_front();
+            }
+        }
+        while (!edf_.empty() && edf_.top()->state == job_state::cancelled) {
+            dead.push_back(edf_.top());
+            edf_.pop();
+        }
+    }
+
+    static void destroy(job j) {
+        j->on_cancel.reset();   //waits if the callback is running right now
+        delete j;
+    }
+
+    //called with mu held, queued > 0 and purge_locked() done
+    job pop_locked(clock::time_point now) {
+        job j = nullptr;
+        if (opts_.policy == schedule_policy::edf) {
+            j = edf_.top();
+            edf_.pop();
+        } else if (opts_.policy == schedule_policy::fifo) {
+            j = lanes_[0].front();
+            lanes_[0].pop_front();
+        } else {
+            size_t top = 0;
+            while (lanes_[top].empty()) {
+                top++;
+            }
+            size_t pick = top;
+            //[2] the oldest starving task of a lower lane, every other pick
+            if (!aged_last && opts_.starvation_limit > clock::duration::zero()) {
+                for (size_t l = priority_levels; l-- > top + 1;) {
+                    if (!lanes_[l].empty() &&
+                        now - lanes_[l].front()->enqueued > opts_.starvation_limit) {
+                        pick = l;
+                        break;
+                    }
+                }
+            }
+            aged_last = pick != top;
+            j = lanes_[pick].front();
+            lanes_[pick].pop_front();
+        }
+        queued--;
+        j->state = job_state::running;
+        return j;
+    }
+
+    //[5] runs on the thread calling cancel()
+    void cancel_job(job j) {
+        unique_function<void(bool)> fn;
+        bool notify;
+        {
+            std::lock_guard<std::mutex> locker(mu);
+            if (j->state != job_state::pending && j->state != job_state::queued) {
+                return;     //already started
+            }
+            if (j->state == job_state::queued) {
+                queued--;
+            }
+            j->state = job_state::cancelled;
+            cancelled_++;
+            fn = std::move(j->fn);
+            notify = full_waiters > 0;
+        }
+        if (notify) {
+            not_full.notify_all();
+        }
+        fn(true);
+    }
+
+    void worker_loop(size_t self) {
+        name_this_thread(opts_.name + "-" + std::to_string(self));
+        std::vector<job> dead;
+        for (;;) {
+            job j = nullptr;
+            bool notify_full;
+            {
+                std::unique_lock<std::mutex> locker(mu);
+                while (queued == 0 && !stop) {
+                    waiters++;
+                    cond.wait(locker);
+                    waiters--;
+                }
+                purge_locked(dead);
+                if (queued != 0) {
+                    j = pop_locked(clock::now());
+                }
+                notify_full = full_waiters > 0;
+            }
+            for (job d : dead) {
+                destroy(d);
+            }
+            dead.clear();
+            if (!j) {
+                return;     //stop was requested and the queue is drained
+            }
+            if (notify_full) {
+                not_full.notify_one();
+            }
+            j->on_cancel.reset();   //[5] too late to cancel, it is starting
+            //[3]
+            clock::time_point start = clock::now();
+            latency_[lane(j->prio)].record(start - j->enqueued);
+            if (start > j->deadline) {
+                misses_[lane(j->prio)].fetch_add(1, std::memory_order_relaxed);
+            }
+            j->fn(false);
+            delete j;
+        }
+    }
+
+    void enqueue(const cancellation_token& token, priority p, clock::time_point deadline,
+                 unique_function<void(bool)>&& f) {
+        job j = new job_node;
+        j->fn = std::move(f);
+        j->prio = p;
+        j->enqueued = clock::now();
+        j->deadline = deadline;
+        //[5] registered while pending: cancel_job() may run right here
+        if (token.can_be_cancelled()) {
+            j->on_cancel.emplace(token, [this, j]() { cancel_job(j); });
+        }
+        bool notify = false;
+        bool dropped = false;
+        {
+            std::unique_lock<std::mutex> locker(mu);
+            //[6] backpressure
+            while (opts_.max_queued != 0 && queued >= opts_.max_queued && !stop &&
+                   j->state != job_state::cancelled) {
+                full_waiters++;
+                not_full.wait(locker);
+                full_waiters--;
+            }
+            if (stop) {
+                locker.unlock();
+                destroy(j);
+                throw std::runtime_error("priority_pool: submit() after shutdown()");
+            }
+            if (j->state == job_state::cancelled) {
+                dropped = true;
+            } else {
+                j->state = job_state::queued;
+                j->seq = next_seq++;
+                push_locked(j);
+                notify = waiters > 0;
+            }
+        }
+        if (dropped) {
+            destroy(j);     //its future already holds operation_cancelled
+        }
+        if (notify) {
+            cond.notify_one();
+        }
+    }
+
+    //f(args...) -> prom, as in thread_pool::spawn()
+    template <typename R, typename F, typename... Args>
+    static unique_function<void(bool)> make_task(light_promise<R> prom, F&& f, Args&&... args) {
+        return [prom = std::move(prom), f = std::forward<F>(f),
+                tup = std::make_tuple(std::forward<Args>(args)...)](bool cancelled) mutable {
+            if (cancelled) {
+                prom.set_exception(std::make_exception_ptr(operation_cancelled()));
+                return;
+            }
+            try {
+                if constexpr (std::is_void<R>::value) {
+                    std::apply(std::move(f), std::move(tup));
+                    prom.set_value();
+                } else {
+                    prom.set_value(std::apply(std::move(f), std::move(tup)));
+                }
+            } catch (...) {
+                prom.set_exception(std::current_exception());
+            }
+        };
+    }
+
+public:
+    explicit priority_pool(const priority_pool_options& opts = priority_pool_options()) : opts_(opts) {
+        unsigned n = opts_.threads ? opts_.threads : 1;
+        for (unsigned i = 0; i < n; i++) {
+            workers.emplace_back(&priority_pool::worker_loop, this, i);
+        }
+    }
+
+    ~priority_pool() {
+        shutdown();
+        std::vector<job> dead;
+        purge_locked(dead);     //workers are gone, only cancelled nodes are left
+        for (job d : dead) {
+            destroy(d);
+        }
+    }
+
+    priority_pool(const priority_pool&) = delete;
+    priority_pool& operator=(const priority_pool&) = delete;
+
+    size_t size() const {
+        return workers.size();
+    }
+
+    //[1] deadline = now + budget[p]
+    template <typename F, typename... Args>
+    auto submit(priority p, F&& f, Args&&... args) {
+        return submit(cancellation_token(), p, std::forward<F>(f), std::forward<Args>(args)...);
+    }
+
+    //[5]
+    template <typename F, typename... Args>
+    auto submit(const cancellation_token& token, priority p, F&& f, Args&&... args)
+        -> light_future<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>>
+    {
+        using R = std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>;
+        light_promise<R> prom;
+        light_future<R> fu = prom.get_future();
+        enqueue(token, p, clock::now() + opts_.budget[lane(p)],
+                make_task(std::move(prom), std::forward<F>(f), std::forward<Args>(args)...));
+        return fu;
+    }
+
+    //[1] explicit deadline; the task is accounted (and laned) as normal priority
+    template <typename F, typename... Args>
+    auto submit_by(clock::time_point deadline, F&& f, Args&&... args) {
+        return submit_by(cancellation_token(), deadline, std::forward<F>(f), std::forward<Args>(args)...);
+    }
+
+    template <typename F, typename... Args>
+    auto submit_by(const cancellation_token& token, clock::time_point deadline, F&& f, Args&&... args)
+        -> light_future<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>>
+    {
+        using R = std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>;
+        light_promise<R> prom;
+        light_future<R> fu = prom.get_future();
+        enqueue(token, priority::normal, deadline,
+                make_task(std::move(prom), std::forward<F>(f), std::forward<Args>(args)...));
+        return fu;
+    }
+
+    //[5][6] tasks waiting to start, cancelled ones not included
+    size_t queued_count() {
+        std::lock_guard<std::mutex> locker(mu);
+        return queued;
+    }
+
+    uint64_t cancelled_count() {
+        std::lock_guard<std::mutex> locker(mu);
+        return cancelled_;
+    }
+
+    //[3]
+    histogram_snapshot queue_latency(priority p) const {
+        return latency_[lane(p)].snapshot();
+    }
+
+    uint64_t deadline_misses(priority p) const {
+        return misses_[lane(p)].load(std::memory_order_relaxed);
+    }
+
+    //[4]
+    void shutdown() {
+        {
+            std::lock_guard<std::mutex> locker(mu);
+            if (stop) {
+                return;
+            }
+            stop = true;
+        }
+        cond.notify_all();
+        not_full.notify_all();
+        for (auto& th : workers) {
+            th.join();
+        }
+    }
+};
+
+#endif //PRIORITY_POOL_H
@@ -0,0 +1,137 @@
+/* README:
+ * - recycled<Derived>: gives a class its own operator new/delete that reuse
+ *   freed objects instead of going to malloc every time.
+ *
+ * [1] A task object is typically allocated by the submitting thread and
+ *     freed by a worker thread. A plain thread-local free list would then
+ *     grow on the workers and stay empty on the submitter. So each thread
+ *     keeps a small local list, and when it grows too long a batch of
+ *     blocks is handed to a shared depot; a thread whose list is empty takes
+ *     a whole batch back. The depot mutex is taken once per batch, not once
+ *     per object.
+ * [2] Freed blocks are linked through their own memory (free_block), so
+ *     recycling never allocates.
+ * [3] Memory in the caches is never returned to malloc; it is meant for
+ *     objects that are created and destroyed at a high rate.
+ * [4] The depot is leaked on purpose. A thread_local cache is flushed into
+ *     it when its thread exits, and that can happen during static
+ *     destruction (the workers of a static thread_pool, see
+ *     default_pool() in async_pool.h), after a function-local static depot
+ *     would already be gone.
+ * */
+
+#ifndef RECYCLED_H
+#define RECYCLED_H
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+
+template <typename Derived>
+class recycled
+{
+private:
+    //[2]
+    struct free_block {
+        free_block* next;
+        free_block* next_batch;  //only used in the depot
+        size_t count;            //only valid in a batch head
+    };
+
+    static constexpr size_t batch_size = 64;
+
+    struct depot {
+        std::mutex mu;
+        free_block* batches = nullptr;
+    };
+
+    struct local_cache {
+        free_block* head = nullptr;
+        size_t count = 0;
+
+        ~local_cache() {
+            //give the leftovers to the depot when the thread exits
+            if (head) {
+                head->count = count;
+                give(head);
+            }
+        }
+    };
+
+    //[4] never destroyed
+    static depot& shared() {
+        static depot& d = *new depot;
+        return d;
+    }
+
+    static local_cache& local() {
+        static thread_local local_cache c;
+        return c;
+    }
+
+    static void give(free_block* batch) {
+        depot& d = shared();
+        std::lock_guard<std::mutex> locker(d.mu);
+        batch->next_batch = d.batches;
+        d.batches = batch;
+    }
+
+    static free_block* take(size_t& count) {
+        depot& d = shared();
+        std::lock_guard<std::mutex> locker(d.mu);
+        free_block* batch = d.batches;
+        if (batch) {
+            d.batches = batch->next_batch;
+            count = batch->count;
+        }
+        return batch;
+    }
+
+public:
+    static void* operator new(size_t size) {
+        static_assert(sizeof(Derived) >= sizeof(free_block),
+                      "recycled<T> needs objects of at least sizeof(free_block)");
+        if (size != sizeof(Derived)) {
+            return ::operator new(size);  //a class derived from Derived
+        }
+        local_cache& c = local();
+        if (!c.head) {
+            c.head = take(c.count);     //[1]
+        }
+        if (!c.head) {
+            return ::operator new(size);
+        }
+        free_block* b = c.head;
+        c.head = b->next;
+        c.count--;
+        return b;
+    }
+
+    static void operator delete(void* p, size_t size) {
+        if (size != sizeof(Derived)) {
+            ::operator delete(p);
+            return;
+        }
+        local_cache& c = local();
+        free_block* b = static_cast<free_block*>(p);
+        b->next = c.head;
+        c.head = b;
+        c.count++;
+
+        if (c.count >= 2 * batch_size) {
+            //[1] hand the first batch_size blocks to the depot
+            free_block* batch = c.head;
+            free_block* last = batch;
+            for (size_t i = 1; i < batch_size; i++) {
+                last = last->next;
+            }
+            c.head = last->next;
+            c.count -= batch_size;
+            last->next = nullptr;
+            batch->count = batch_size;
+            give(batch);
+        }
+    }
+};
+
+#endif //RECYCLED_H
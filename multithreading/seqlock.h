@@ -0,0 +1,118 @@
+/* README:
+ * - seqlock<T>: a sequence lock protecting a small trivially copyable
+ *   value (a POD snapshot such as a few counters or a config struct).
+ *
+ * [1] Writer: seq_ is made odd, the value is written, seq_ is made even
+ *     again. Writers are serialized with a mutex.
+ * [2] Reader: reads seq_, copies the value, reads seq_ again. If seq_ was odd
+ *     or has changed, a writer was active and the copy may be torn, so the
+ *     reader simply retries.
+ * [3] Readers never write to shared memory, so any number of readers can run
+ *     in parallel without bouncing a cache line between cores. The price is
+ *     that a reader may have to retry when writes are frequent.
+ * [4] The value is stored as an array of atomic words and copied with relaxed
+ *     loads/stores, so the concurrent (torn) read is not a data race in the
+ *     C++ memory model.
+ * */
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <type_traits>
+#include "adaptive_mutex.h"
+#include "futex.h"
+
+template <typename T>
+class seqlock
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "seqlock<T> requires a trivially copyable T");
+
+private:
+    static constexpr size_t nwords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    alignas(64) std::atomic<uint32_t> seq_{0};
+    std::atomic<uint64_t> data_[nwords];
+    adaptive_mutex writer_mu_;
+
+    void store_words(const T& value) {
+        uint64_t words[nwords] = {};
+        std::memcpy(words, &value, sizeof(T));
+        for (size_t i = 0; i < nwords; i++) {
+            data_[i].store(words[i], std::memory_order_relaxed);
+        }
+    }
+
+public:
+    seqlock() : seqlock(T{}) {}
+
+    explicit seqlock(const T& value) {
+        store_words(value);
+    }
+
+    seqlock(const seqlock&) = delete;
+    seqlock& operator=(const seqlock&) = delete;
+
+    //[1]
+    void store(const T& value) {
+        std::lock_guard<adaptive_mutex> locker(writer_mu_);
+        uint32_t s = seq_.load(std::memory_order_relaxed);
+        seq_.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        store_words(value);
+        seq_.store(s + 2, std::memory_order_release);
+    }
+
+    //read-modify-write under the writer lock, e.g. bumping a counter
+    template <typename Func>
+    void update(Func func) {
+        std::lock_guard<adaptive_mutex> locker(writer_mu_);
+        T value = load_unlocked();
+        func(value);
+        uint32_t s = seq_.load(std::memory_order_relaxed);
+        seq_.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        store_words(value);
+        seq_.store(s + 2, std::memory_order_release);
+    }
+
+    //[2]
+    T load() const {
+        uint64_t words[nwords];
+        uint32_t s1, s2;
+        do {
+            s1 = seq_.load(std::memory_order_acquire);
+            while (s1 & 1) {
+                cpu_relax();
+                s1 = seq_.load(std::memory_order_acquire);
+            }
+            for (size_t i = 0; i < nwords; i++) {
+                words[i] = data_[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            s2 = seq_.load(std::memory_order_relaxed);
+        } while (s1 != s2);
+
+        T value;
+        std::memcpy(&value, words, sizeof(T));
+        return value;
+    }
+
+private:
+    //only valid while holding writer_mu_
+    T load_unlocked() const {
+        uint64_t words[nwords];
+        for (size_t i = 0; i < nwords; i++) {
+            words[i] = data_[i].load(std::memory_order_relaxed);
+        }
+        T value;
+        std::memcpy(&value, words, sizeof(T));
+        return value;
+    }
+};
+
+#endif //SEQLOCK_H
@@ -0,0 +1,202 @@
+/* README:
+ * - spsc_queue<T, Blocking>: a bounded, wait-free, single-producer
+ *   single-consumer ring buffer.
+ *
+ * [1] With exactly one producer and one consumer no CAS is needed: only the
+ *     producer writes tail_ and only the consumer writes head_. Every
+ *     try_push()/try_pop() finishes in a bounded number of steps (wait-free).
+ * [2] Cached indices: the producer keeps a private copy of head_
+ *     (cached_head_) and only re-reads the shared head_ when the ring looks
+ *     full; the consumer does the same with tail_. In steady state each side
+ *     touches only its own cache line, which is what makes the queue fast.
+ * [3] Batch operations: try_push_n()/try_pop_n() move up to n items and
+ *     publish them with a single store of tail_/head_.
+ * [4] Optional blocking (Blocking = true): push()/pop() park on a futex when
+ *     the ring is full/empty (see futex_park()/futex_notify() in
+ *     futex.h). This costs a seq_cst fence per operation, so with
+ *     Blocking = false (the default) push()/pop() just spin and yield.
+ * [5] Only one thread may push and only one thread may pop. Using it from
+ *     more threads is undefined; use mpmc_queue for that.
+ * */
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include "futex.h"
+
+template <typename T, bool Blocking = false>
+class spsc_queue
+{
+private:
+    //consumer side
+    alignas(64) std::atomic<size_t> head_{0};
+    size_t cached_tail_ = 0;        //[2]
+
+    //producer side
+    alignas(64) std::atomic<size_t> tail_{0};
+    size_t cached_head_ = 0;        //[2]
+
+    //[4] futex words, only used when Blocking
+    alignas(64) std::atomic<uint32_t> not_empty_{0};
+    alignas(64) std::atomic<uint32_t> not_full_{0};
+
+    alignas(64) size_t mask_;
+    std::unique_ptr<T[]> buf_;
+
+    static constexpr int spin_count = 64;
+
+    void notify(std::atomic<uint32_t>& word) {
+        if (Blocking) {
+            futex_notify(word);
+        }
+    }
+
+    template <typename Try>
+    void wait(std::atomic<uint32_t>& word, Try try_again) {
+        for (int i = 0; i < spin_count; i++) {
+            if (try_again()) {
+                return;
+            }
+            cpu_relax();
+        }
+        for (;;) {
+            if (Blocking) {
+                if (futex_park(word, try_again)) {
+                    return;
+                }
+            } else {
+                std::this_thread::yield();
+            }
+            if (try_again()) {
+                return;
+            }
+        }
+    }
+
+public:
+    explicit spsc_queue(size_t capacity) : mask_(capacity - 1), buf_(new T[capacity]) {
+        if (capacity < 2 || (capacity & (capacity - 1)) != 0) {
+            throw std::invalid_argument("spsc_queue capacity must be a power of two");
+        }
+    }
+
+    spsc_queue(const spsc_queue&) = delete;
+    spsc_queue& operator=(const spsc_queue&) = delete;
+
+    size_t capacity() const {
+        return mask_ + 1;
+    }
+
+    /******** producer side ************/
+    bool try_push(T& value) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cached_head_ > mask_) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ > mask_) {
+                return false;   //full
+            }
+        }
+        buf_[tail & mask_] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        notify(not_empty_);
+        return true;
+    }
+
+    //[3] moves up to n items from items[], returns how many were pushed
+    size_t try_push_n(T* items, size_t n) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t room = mask_ + 1 - (tail - cached_head_);
+        if (room < n) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            room = mask_ + 1 - (tail - cached_head_);
+        }
+        size_t count = n < room ? n : room;
+        for (size_t i = 0; i < count; i++) {
+            buf_[(tail + i) & mask_] = std::move(items[i]);
+        }
+        if (count) {
+            tail_.store(tail + count, std::memory_order_release);
+            notify(not_empty_);
+        }
+        return count;
+    }
+
+    void push(T value) {
+        wait(not_full_, [&]() { return try_push(value); });
+    }
+
+    //pushes all n items, waiting for room as needed
+    void push_n(T* items, size_t n) {
+        size_t done = 0;
+        while (done < n) {
+            wait(not_full_, [&]() {
+                size_t k = try_push_n(items + done, n - done);
+                done += k;
+                return k != 0;
+            });
+        }
+    }
+
+    /******** consumer side ************/
+    bool try_pop(T& value) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == cached_tail_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_) {
+                return false;   //empty
+            }
+        }
+        value = std::move(buf_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        notify(not_full_);
+        return true;
+    }
+
+    //[3] moves up to max items into out[], returns how many were popped
+    size_t try_pop_n(T* out, size_t max) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t avail = cached_tail_ - head;
+        if (avail < max) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            avail = cached_tail_ - head;
+        }
+        size_t count = max < avail ? max : avail;
+        for (size_t i = 0; i < count; i++) {
+            out[i] = std::move(buf_[(head + i) & mask_]);
+        }
+        if (count) {
+            head_.store(head + count, std::memory_order_release);
+            notify(not_full_);
+        }
+        return count;
+    }
+
+    T pop() {
+        T value;
+        wait(not_empty_, [&]() { return try_pop(value); });
+        return value;
+    }
+
+    //waits until at least one item is available, then pops up to max
+    //(0 at once for max == 0: there is nothing to wait for)
+    size_t pop_n(T* out, size_t max) {
+        if (max == 0) {
+            return 0;
+        }
+        size_t count = 0;
+        wait(not_empty_, [&]() {
+            count = try_pop_n(out, max);
+            return count != 0;
+        });
+        return count;
+    }
+};
+
+#endif //SPSC_QUEUE_H
@@ -0,0 +1,523 @@
+/* README:
+ * - thread_pool: a fixed number of long-lived worker threads with
+ *   work-stealing scheduling.
+ *
+ * [1] main6() in 9_packaged_task.cpp pushes a packaged_task into task_q and a
+ *     single thread_1 runs exactly one task and exits. thread_pool keeps its
+ *     workers alive: they loop, look for a task, run it, look for the next
+ *     one, until the pool is shut down.
+ * [2] submit(f, args...) accepts any callable, wraps it in a
+ *     std::packaged_task<R()> and returns the std::future<R>. Exceptions
+ *     thrown by the task are stored in the future, just like with
+ *     std::async().
+ * [3] shutdown() (also called by the destructor) stops accepting new tasks,
+ *     lets the workers finish everything that is already queued, and joins
+ *     them. submit() after shutdown() throws std::runtime_error.
+ * [4] Work stealing: a single task_q behind one mutex does not scale past a
+ *     handful of cores. Each worker owns a chase_lev_deque (see
+ *     chase_lev_deque.h):
+ *     - submit() called *from a worker* pushes onto that worker's own deque,
+ *       lock-free.
+ *     - submit() called from any other thread goes to the shared inject_q
+ *       (mutex protected; outside threads are rarely the bottleneck).
+ *     - A worker looks for work in this order: its own deque (LIFO), the
+ *       inject_q, then steals from the top of a random other worker's deque.
+ *     - Workers that find nothing park on a futex. submit() wakes one of
+ *       them, and only pays for the syscall when somebody is sleeping.
+ * [5] Fork-join: wait(fu) called from a worker does not block that worker.
+ *     While the future is not ready it keeps running other tasks (possibly
+ *     the very child it is waiting for), so recursive divide-and-conquer
+ *     tasks never tie up worker threads. Called from any other thread,
+ *     wait(fu) is just fu.wait().
+ * [6] Tasks are queued as unique_function<void()> (see unique_function.h)
+ *     inside a recycled job node (see recycled.h), so queuing a small
+ *     closure allocates nothing:
+ *     - post(f): fire and forget. An exception escaping f terminates the
+ *       program, as it would on a std::thread.
+ *     - spawn(f, args...): returns a light_future<R> (see light_future.h),
+ *       whose shared state is recycled too.
+ *     - submit(f, args...): returns a std::future<R>; the std::packaged_task
+ *       still allocates its shared state.
+ * [7] Placement (see cpu_topology.h): thread_pool(thread_pool_options)
+ *     - name: workers are called "<name>-<index>" (pthread_setname_np), so
+ *       they can be told apart in top -H, perf and gdb.
+ *     - pin: worker i is pinned to placement()[i] of the CPU topology, one
+ *       worker per physical core first. Pinned workers keep their caches
+ *       warm; unpinned ones may be moved by the scheduler at any time.
+ *     - avoid_smt: never put two workers on SMT siblings of one core; the
+ *       default number of workers becomes the number of physical cores.
+ * [8] spawn(token, f, args...) (see cancellation.h): if the token is
+ *     cancelled before a worker gets to the task, f is not run and the
+ *     future holds operation_cancelled. The deques cannot give a slot back
+ *     early, so the dropped task is only skipped when it is dequeued; for a
+ *     queue whose capacity is released at cancel() time see priority_pool.h.
+ * [9] Instrumentation (see pool_stats.h): with thread_pool_options::stats
+ *     set, every worker keeps counters (tasks by source, steals, parks,
+ *     idle time) and sampled histograms (queue latency, run time, queue
+ *     depth). pool.stats() returns a snapshot. With stats off (the default)
+ *     the cost is one predictable branch per task; with stats on, every
+ *     task is counted, but only one in stats_sample_every is stamped and
+ *     timed, the others cost a counter increment at enqueue.
+ * */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#include "futex.h"
+#include "cancellation.h"
+#include "chase_lev_deque.h"
+#include "cpu_topology.h"
+#include "light_future.h"
+#include "pool_stats.h"
+#include "recycled.h"
+#include "unique_function.h"
+
+//[7]
+struct thread_pool_options {
+    unsigned threads = 0;       //0: one per usable CPU (per core with avoid_smt)
+    bool pin = false;
+    bool avoid_smt = false;
+    std::string name = "pool";
+    bool stats = false;                 //[9]
+    unsigned stats_sample_every = 16;   //[9] time one task in this many
+};
+
+class thread_pool
+{
+private:
+    //[6]
+    struct job_node : recycled<job_node> {
+        unique_function<void()> fn;
+        uint64_t enqueued_ticks = 0;    //[9] 0: not sampled
+        explicit job_node(unique_function<void()>&& f) : fn(std::move(f)) {}
+    };
+    using job = job_node*;
+
+    struct alignas(64) worker {
+        chase_lev_deque<job> dq;
+        std::thread th;
+        int cpu = -1;           //[7] -1: not pinned
+        worker_stats stats;     //[9]
+        unsigned sample_n = 0;  //[9] tasks this worker pushed since the last sample
+    };
+
+    std::vector<std::unique_ptr<worker>> workers;
+    std::string name_;
+    bool stats_ = false;                //[9]
+    unsigned sample_every_ = 16;
+    unsigned inject_sample_n_ = 0;      //[9] guarded by inject_mu
+
+    //growable ring of jobs; unlike std::deque it keeps its memory, so
+    //steady-state pushes and pops do not allocate [6]
+    struct job_ring {
+        std::vector<job> buf = std::vector<job>(64);
+        size_t head = 0;
+        size_t count = 0;
+
+        bool empty() const {
+            return count == 0;
+        }
+        void push_back(job j) {
+            if (count == buf.size()) {
+                std::vector<job> bigger(buf.size() * 2);
+                for (size_t i = 0; i < count; i++) {
+                    bigger[i] = buf[(head + i) % buf.size()];
+                }
+                buf.swap(bigger);
+                head = 0;
+            }
+            buf[(head + count) % buf.size()] = j;
+            count++;
+        }
+        job pop_front() {
+            job j = buf[head];
+            head = (head + 1) % buf.size();
+            count--;
+            return j;
+        }
+    };
+
+    job_ring inject_q;                      //[4] submissions from outside
+    std::mutex inject_mu;
+    std::atomic<size_t> inject_size{0};
+
+    std::atomic<uint32_t> idle_word{0};     //[4] parked workers sleep here
+    std::atomic<int> sleepers{0};
+    std::atomic<bool> stop{false};
+
+    //which pool/worker the calling thread belongs to
+    struct worker_id {
+        const thread_pool* pool = nullptr;
+        size_t index = 0;
+    };
+    static worker_id& current() {
+        static thread_local worker_id id;
+        return id;
+    }
+
+    static uint32_t next_random() {
+        static thread_local uint32_t x = 2463534242u ^
+            static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        return x;
+    }
+
+    bool pop_inject(job& j) {
+        if (inject_size.load(std::memory_order_relaxed) == 0) {
+            return false;
+        }
+        std::lock_guard<std::mutex> locker(inject_mu);
+        if (inject_q.empty()) {
+            return false;
+        }
+        j = inject_q.pop_front();
+        inject_size.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    //[4] own deque -> inject_q -> steal
+    bool find_job(size_t self, job& j, worker_stats::source& from) {
+        if (workers[self]->dq.pop(j)) {
+            from = worker_stats::from_local;
+            return true;
+        }
+        if (pop_inject(j)) {
+            from = worker_stats::from_inject;
+            return true;
+        }
+        size_t n = workers.size();
+        size_t start = next_random() % n;
+        for (size_t k = 0; k < n; k++) {
+            size_t victim = (start + k) % n;
+            if (victim != self && workers[victim]->dq.steal(j)) {
+                from = worker_stats::from_steal;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t queued() const {
+        size_t n = inject_size.load(std::memory_order_relaxed);
+        for (const auto& w : workers) {
+            n += static_cast<size_t>(w->dq.size());
+        }
+        return n;
+    }
+
+    bool has_work() const {
+        if (inject_size.load(std::memory_order_relaxed) != 0) {
+            return true;
+        }
+        for (const auto& w : workers) {
+            if (!w->dq.empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void run(job j) {
+        j->fn();
+        delete j;
+    }
+
+    //[9] only for sampled tasks
+    void run_timed(size_t self, job j) {
+        worker_stats& st = workers[self]->stats;
+        uint64_t start = detail::ticks();
+        st.queue_latency.record_owned(detail::ticks_to_ns(start - j->enqueued_ticks));
+        st.queue_depth.record_owned(workers[self]->dq.size() +
+                                    inject_size.load(std::memory_order_relaxed));
+        run(j);
+        st.run_time.record_owned(detail::ticks_to_ns(detail::ticks() - start));
+    }
+
+    void run_job(size_t self, job j, worker_stats::source from) {
+        if (!stats_) {
+            run(j);
+            return;
+        }
+        workers[self]->stats.took(from);
+        if (j->enqueued_ticks) {
+            run_timed(self, j);
+        } else {
+            run(j);
+        }
+    }
+
+    void worker_loop(size_t self) {
+        current() = worker_id{this, self};
+        name_this_thread(name_ + "-" + std::to_string(self));  //[7]
+        if (workers[self]->cpu >= 0) {
+            pin_this_thread(static_cast<unsigned>(workers[self]->cpu));
+        }
+        if (stats_) {
+            workers[self]->stats.start();
+        }
+        for (;;) {
+            job j;
+            worker_stats::source from;
+            if (find_job(self, j, from)) {
+                run_job(self, j, from);
+                continue;
+            }
+            if (stop.load(std::memory_order_acquire) && !has_work()) {
+                return; //stop was requested and all queues are drained
+            }
+            if (stats_) {
+                workers[self]->stats.missed();
+                uint64_t t0 = detail::ticks();
+                park();
+                workers[self]->stats.parked(detail::ticks() - t0);
+            } else {
+                park();
+            }
+        }
+    }
+
+    //[4] sleepers++ and the re-check are ordered against the enqueue and
+    //the sleepers load in wake_one() by seq_cst fences, so no wake-up is lost
+    void park() {
+        uint32_t e = idle_word.load(std::memory_order_acquire);
+        sleepers.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!stop.load(std::memory_order_relaxed) && !has_work()) {
+            futex_wait(&idle_word, e);
+        }
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void wake_one() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_relaxed) > 0) {
+            idle_word.fetch_add(1, std::memory_order_relaxed);
+            futex_wake(&idle_word, 1);
+        }
+    }
+
+    //[9] stamp one task in sample_every_; n is owned by the caller
+    void sample(job j, unsigned& n) {
+        if (++n >= sample_every_) {
+            n = 0;
+            j->enqueued_ticks = detail::ticks();
+        }
+    }
+
+    void enqueue(job j) {
+        worker_id& id = current();
+        if (id.pool == this) {
+            if (stats_) {
+                sample(j, workers[id.index]->sample_n);
+            }
+            workers[id.index]->dq.push(j);  //[4] lock-free local push
+        } else {
+            std::lock_guard<std::mutex> locker(inject_mu);
+            if (stop.load(std::memory_order_relaxed)) {
+                delete j;
+                throw std::runtime_error("thread_pool: submit() after shutdown()");
+            }
+            if (stats_) {
+                sample(j, inject_sample_n_);
+            }
+            inject_q.push_back(j);
+            inject_size.fetch_add(1, std::memory_order_relaxed);
+        }
+        wake_one();
+    }
+
+public:
+    explicit thread_pool(unsigned nthreads = std::thread::hardware_concurrency())
+        : thread_pool(thread_pool_options{nthreads == 0 ? 1 : nthreads}) {}
+
+    //[7]
+    explicit thread_pool(const thread_pool_options& opts)
+        : name_(opts.name), stats_(opts.stats),
+          sample_every_(opts.stats_sample_every ? opts.stats_sample_every : 1) {
+        if (stats_) {
+            detail::ns_per_tick();  //[9] calibrate before the workers start
+        }
+        unsigned nthreads = opts.threads;
+        std::vector<unsigned> cpus;
+        if (nthreads == 0 || opts.pin) {
+            cpu_topology topo;
+            if (nthreads == 0) {
+                nthreads = static_cast<unsigned>(
+                    opts.avoid_smt ? topo.physical_cores() : topo.cpus().size());
+            }
+            if (opts.pin) {
+                cpus = topo.placement(nthreads, opts.avoid_smt);
+            }
+        }
+        if (nthreads == 0) {
+            nthreads = 1;
+        }
+        for (unsigned i = 0; i < nthreads; i++) {
+            workers.emplace_back(new worker);
+            if (i < cpus.size()) {
+                workers[i]->cpu = static_cast<int>(cpus[i]);
+            }
+        }
+        //start the threads only after every deque exists, they steal from each other
+        for (unsigned i = 0; i < nthreads; i++) {
+            workers[i]->th = std::thread(&thread_pool::worker_loop, this, i);
+        }
+    }
+
+    ~thread_pool() {
+        shutdown();
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    size_t size() const {
+        return workers.size();
+    }
+
+    //[9] all zeros unless the pool was created with stats
+    pool_stats_snapshot stats() const {
+        pool_stats_snapshot s;
+        for (const auto& w : workers) {
+            s.workers.push_back(w->stats.snapshot());
+        }
+        s.queued = queued();
+        return s;
+    }
+
+    //[7] CPU worker i is pinned to, -1 if it is not pinned
+    int worker_cpu(size_t i) const {
+        return workers[i]->cpu;
+    }
+
+    //true if the calling thread is one of this pool's workers
+    bool in_pool() const {
+        return current().pool == this;
+    }
+
+    //[2]
+    template <typename F, typename... Args>
+    auto submit(F&& f, Args&&... args)
+        -> std::future<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>>
+    {
+        using R = std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>;
+
+        std::packaged_task<R()> task(
+            [f = std::forward<F>(f), tup = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+                return std::apply(std::move(f), std::move(tup));
+            });
+        std::future<R> fu = task.get_future();
+
+        post(std::move(task));
+        return fu;
+    }
+
+    //[6]
+    template <typename F>
+    void post(F&& f) {
+        enqueue(new job_node(unique_function<void()>(std::forward<F>(f))));
+    }
+
+    //[6]
+    template <typename F, typename... Args>
+    auto spawn(F&& f, Args&&... args)
+        -> light_future<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>>
+    {
+        using R = std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>;
+
+        light_promise<R> prom;
+        light_future<R> fu = prom.get_future();
+        post([prom = std::move(prom), f = std::forward<F>(f),
+              tup = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+            try {
+                if constexpr (std::is_void<R>::value) {
+                    std::apply(std::move(f), std::move(tup));
+                    prom.set_value();
+                } else {
+                    prom.set_value(std::apply(std::move(f), std::move(tup)));
+                }
+            } catch (...) {
+                prom.set_exception(std::current_exception());
+            }
+        });
+        return fu;
+    }
+
+    //[8]
+    template <typename F, typename... Args>
+    auto spawn(const cancellation_token& token, F&& f, Args&&... args)
+        -> light_future<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>>
+    {
+        using R = std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>;
+
+        light_promise<R> prom;
+        light_future<R> fu = prom.get_future();
+        post([token, prom = std::move(prom), f = std::forward<F>(f),
+              tup = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+            try {
+                token.throw_if_cancelled();
+                if constexpr (std::is_void<R>::value) {
+                    std::apply(std::move(f), std::move(tup));
+                    prom.set_value();
+                } else {
+                    prom.set_value(std::apply(std::move(f), std::move(tup)));
+                }
+            } catch (...) {
+                prom.set_exception(std::current_exception());
+            }
+        });
+        return fu;
+    }
+
+    //[5] helps with other tasks while fu is not ready
+    template <typename Future>
+    void wait(const Future& fu) {
+        if (!in_pool()) {
+            fu.wait();
+            return;
+        }
+        size_t self = current().index;
+        while (fu.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            job j;
+            worker_stats::source from;
+            if (find_job(self, j, from)) {
+                run_job(self, j, from);
+            } else {
+                cpu_relax();
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    //[3]
+    void shutdown() {
+        {
+            std::lock_guard<std::mutex> locker(inject_mu);
+            if (stop.load(std::memory_order_relaxed)) {
+                return;
+            }
+            stop.store(true, std::memory_order_release);
+        }
+        idle_word.fetch_add(1, std::memory_order_seq_cst);
+        futex_wake_all(&idle_word);
+        for (auto& w : workers) {
+            w->th.join();
+        }
+    }
+};
+
+#endif //THREAD_POOL_H
@@ -0,0 +1,151 @@
+/* README:
+ * - unique_function<R(Args...)>: a move-only std::function with 64 bytes of
+ *   inline storage (small buffer optimization).
+ *
+ * [1] std::function must be copyable, so it cannot hold a move-only callable
+ *     such as a lambda that captured a std::promise or a packaged_task. That
+ *     is why the queues in 9_packaged_task.cpp store packaged_task itself.
+ *     unique_function is move-only, so it can hold anything movable.
+ * [2] A callable of up to inline_size bytes with a noexcept move constructor
+ *     is stored inside the unique_function object itself: wrapping it
+ *     allocates nothing. Bigger callables go to the heap.
+ * [3] Type erasure is done with a static table of three function pointers
+ *     (invoke, move, destroy) per stored callable type.
+ * */
+
+#ifndef UNIQUE_FUNCTION_H
+#define UNIQUE_FUNCTION_H
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+template <typename Signature>
+class unique_function;
+
+template <typename R, typename... Args>
+class unique_function<R(Args...)>
+{
+public:
+    static constexpr size_t inline_size = 64;
+
+private:
+    //[3]
+    struct ops {
+        R (*invoke)(void* storage, Args&&... args);
+        void (*move)(void* dst, void* src);  //move-construct dst, destroy src
+        void (*destroy)(void* storage);
+    };
+
+    template <typename F>
+    static constexpr bool fits_inline =
+        sizeof(F) <= inline_size &&
+        alignof(F) <= alignof(std::max_align_t) &&
+        std::is_nothrow_move_constructible<F>::value;
+
+    //[2] callable stored in the buffer
+    template <typename F>
+    struct inline_ops {
+        static F* get(void* s) {
+            return std::launder(static_cast<F*>(s));
+        }
+        static R invoke(void* s, Args&&... args) {
+            return std::invoke(*get(s), std::forward<Args>(args)...);
+        }
+        static void move(void* dst, void* src) {
+            ::new (dst) F(std::move(*get(src)));
+            get(src)->~F();
+        }
+        static void destroy(void* s) {
+            get(s)->~F();
+        }
+        static constexpr ops table{invoke, move, destroy};
+    };
+
+    //[2] buffer holds a pointer to a heap allocated callable
+    template <typename F>
+    struct heap_ops {
+        static F*& get(void* s) {
+            return *std::launder(static_cast<F**>(s));
+        }
+        static R invoke(void* s, Args&&... args) {
+            return std::invoke(*get(s), std::forward<Args>(args)...);
+        }
+        static void move(void* dst, void* src) {
+            ::new (dst) F*(get(src));
+        }
+        static void destroy(void* s) {
+            delete get(s);
+        }
+        static constexpr ops table{invoke, move, destroy};
+    };
+
+    alignas(std::max_align_t) unsigned char storage_[inline_size];
+    const ops* ops_ = nullptr;
+
+public:
+    unique_function() noexcept = default;
+    unique_function(std::nullptr_t) noexcept {}
+
+    template <typename F,
+              typename D = std::decay_t<F>,
+              typename = std::enable_if_t<!std::is_same<D, unique_function>::value &&
+                                          std::is_invocable_r<R, D&, Args...>::value>>
+    unique_function(F&& f) {
+        if constexpr (fits_inline<D>) {
+            ::new (static_cast<void*>(storage_)) D(std::forward<F>(f));
+            ops_ = &inline_ops<D>::table;
+        } else {
+            ::new (static_cast<void*>(storage_)) D*(new D(std::forward<F>(f)));
+            ops_ = &heap_ops<D>::table;
+        }
+    }
+
+    unique_function(unique_function&& other) noexcept : ops_(other.ops_) {
+        if (ops_) {
+            ops_->move(storage_, other.storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    unique_function& operator=(unique_function&& other) noexcept {
+        if (this != &other) {
+            reset();
+            if (other.ops_) {
+                other.ops_->move(storage_, other.storage_);
+                ops_ = other.ops_;
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    unique_function(const unique_function&) = delete;
+    unique_function& operator=(const unique_function&) = delete;
+
+    ~unique_function() {
+        reset();
+    }
+
+    void reset() noexcept {
+        if (ops_) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    explicit operator bool() const noexcept {
+        return ops_ != nullptr;
+    }
+
+    R operator()(Args... args) {
+        if (!ops_) {
+            throw std::bad_function_call();
+        }
+        return ops_->invoke(storage_, std::forward<Args>(args)...);
+    }
+};
+
+#endif //UNIQUE_FUNCTION_H